@@ -38,6 +38,9 @@
 #include "Key.h"
 #include "KeyHint.h"
 #include "KeyRing.h"
+#include "RequestScheduler.h"
+#include "CancelToken.h"
+#include "SegmentSizer.h"
 
 #endif
 
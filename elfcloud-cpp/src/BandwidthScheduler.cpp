@@ -0,0 +1,140 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+
+#include "BandwidthScheduler.h"
+
+#include <thread>
+
+using namespace std;
+
+namespace elfcloud {
+
+BandwidthScheduler& BandwidthScheduler::getInstance() {
+	static BandwidthScheduler instance;
+	return instance;
+}
+
+BandwidthScheduler::BandwidthScheduler() {
+	for (unsigned int i=0; i<ELFCLOUD_BANDWIDTH_DIRECTIONS; i++) {
+		buckets[i].rate=0;
+		buckets[i].tokens=0;
+		buckets[i].capacity=0;
+		buckets[i].activeTransfers=0;
+		buckets[i].refilled=chrono::steady_clock::now();
+	}
+}
+
+void BandwidthScheduler::setLimit(const BandwidthDirection pInDirection, const uint64_t pInBytesPerSecond) {
+	lock_guard<mutex> lock(bucketMutex);
+	tokenBucket &bucket=buckets[pInDirection];
+
+	refill(bucket, chrono::steady_clock::now());
+
+	// Burst of a quarter second, at least a few libcurl buffers worth
+	bucket.rate=pInBytesPerSecond;
+	bucket.capacity=pInBytesPerSecond/4.0;
+	if (bucket.capacity<64*1024)
+		bucket.capacity=64*1024;
+	if (bucket.tokens>bucket.capacity)
+		bucket.tokens=bucket.capacity;
+}
+
+uint64_t BandwidthScheduler::getLimit(const BandwidthDirection pInDirection) {
+	lock_guard<mutex> lock(bucketMutex);
+	return buckets[pInDirection].rate;
+}
+
+void BandwidthScheduler::refill(tokenBucket &pInOutBucket, const chrono::steady_clock::time_point pInNow) {
+	double elapsed=chrono::duration<double>(pInNow-pInOutBucket.refilled).count();
+	pInOutBucket.refilled=pInNow;
+
+	pInOutBucket.tokens+=elapsed*pInOutBucket.rate;
+	if (pInOutBucket.tokens>pInOutBucket.capacity)
+		pInOutBucket.tokens=pInOutBucket.capacity;
+}
+
+void BandwidthScheduler::consume(const BandwidthDirection pInDirection, const uint64_t pInBytes) {
+	if (!pInBytes)
+		return;
+
+	double waitSeconds=0;
+	{
+		lock_guard<mutex> lock(bucketMutex);
+		tokenBucket &bucket=buckets[pInDirection];
+
+		if (!bucket.rate)
+			return;
+
+		refill(bucket, chrono::steady_clock::now());
+		bucket.tokens-=pInBytes;
+
+		if (bucket.tokens>=0)
+			return;
+
+		// Saturated: pay for these bytes at the fair share rate, never longer than it takes to clear the debt
+		double activeTransfers=bucket.activeTransfers ? bucket.activeTransfers : 1;
+		double fairShareCost=pInBytes*activeTransfers;
+		double debt=-bucket.tokens;
+		waitSeconds=(fairShareCost<debt ? fairShareCost : debt)/bucket.rate;
+	}
+
+	if (waitSeconds*1000>maxWaitMilliseconds)
+		waitSeconds=maxWaitMilliseconds/1000.0;
+
+	this_thread::sleep_for(chrono::duration<double>(waitSeconds));
+}
+
+void BandwidthScheduler::addTransfer(const BandwidthDirection pInDirection, const int pInDelta) {
+	lock_guard<mutex> lock(bucketMutex);
+	buckets[pInDirection].activeTransfers+=pInDelta;
+}
+
+BandwidthScheduler::Transfer::Transfer(const bool pInSend, const bool pInReceive):
+		send(pInSend), receive(pInReceive), bytesSent(0), bytesReceived(0) {
+	if (send)
+		BandwidthScheduler::getInstance().addTransfer(ELFCLOUD_BANDWIDTH_SEND, 1);
+	if (receive)
+		BandwidthScheduler::getInstance().addTransfer(ELFCLOUD_BANDWIDTH_RECEIVE, 1);
+}
+
+BandwidthScheduler::Transfer::~Transfer() {
+	if (send)
+		BandwidthScheduler::getInstance().addTransfer(ELFCLOUD_BANDWIDTH_SEND, -1);
+	if (receive)
+		BandwidthScheduler::getInstance().addTransfer(ELFCLOUD_BANDWIDTH_RECEIVE, -1);
+}
+
+void BandwidthScheduler::Transfer::update(const uint64_t pInBytesSent, const uint64_t pInBytesReceived) {
+	// libcurl reports cumulative counts, they restart from zero if the handle resends the request
+	if (pInBytesSent>bytesSent)
+		BandwidthScheduler::getInstance().consume(ELFCLOUD_BANDWIDTH_SEND, pInBytesSent-bytesSent);
+	if (pInBytesReceived>bytesReceived)
+		BandwidthScheduler::getInstance().consume(ELFCLOUD_BANDWIDTH_RECEIVE, pInBytesReceived-bytesReceived);
+
+	bytesSent=pInBytesSent;
+	bytesReceived=pInBytesReceived;
+}
+
+}
@@ -0,0 +1,100 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+
+#ifndef ELFCLOUD_BANDWIDTHSCHEDULER_H_
+#define ELFCLOUD_BANDWIDTHSCHEDULER_H_
+
+#include "Object.h"
+
+#include <mutex>
+#include <chrono>
+#include <stdint.h>
+
+namespace elfcloud {
+
+typedef enum BandwidthDirection {
+	ELFCLOUD_BANDWIDTH_SEND = 0,
+	ELFCLOUD_BANDWIDTH_RECEIVE,
+	ELFCLOUD_BANDWIDTH_DIRECTIONS
+} BandwidthDirection;
+
+// Process-wide bandwidth limits shared by all transfers of all connections. Each direction has one token
+// bucket refilled at the configured rate. Transfers report the bytes they have moved with consume() and are
+// put to sleep while the bucket is in debt. When the link is saturated each transfer pays for its own bytes
+// at rate/active transfers, so concurrent transfers get an equal share of the limit.
+//
+// Limits are set through Client::setConf("http.limit.send.Bps" / "http.limit.receive.Bps") and take effect
+// immediately, also for transfers already running.
+class BandwidthScheduler: public Object {
+public:
+	static BandwidthScheduler& getInstance();
+
+	// Bytes/second, 0 means unlimited
+	void setLimit(const BandwidthDirection pInDirection, const uint64_t pInBytesPerSecond);
+	uint64_t getLimit(const BandwidthDirection pInDirection);
+
+	// Accounts pInBytes moved by a transfer, blocks the caller while the shared bucket is in debt
+	void consume(const BandwidthDirection pInDirection, const uint64_t pInBytes);
+
+	// Progress of one HTTP transfer. Registers the transfer for fair sharing in the directions it uses and
+	// converts libcurl's cumulative byte counts into consume() calls.
+	class Transfer {
+	public:
+		Transfer(const bool pInSend, const bool pInReceive);
+		~Transfer();
+
+		void update(const uint64_t pInBytesSent, const uint64_t pInBytesReceived);
+
+	private:
+		bool send;
+		bool receive;
+		uint64_t bytesSent;
+		uint64_t bytesReceived;
+	};
+
+private:
+	BandwidthScheduler();
+
+	typedef struct tokenBucket {
+		uint64_t rate;
+		double tokens;
+		double capacity;
+		unsigned int activeTransfers;
+		std::chrono::steady_clock::time_point refilled;
+	} tokenBucket;
+
+	tokenBucket buckets[ELFCLOUD_BANDWIDTH_DIRECTIONS];
+	std::mutex bucketMutex;
+
+	// Longest single sleep, keeps transfers responsive to limit changes
+	static const unsigned int maxWaitMilliseconds=1000;
+
+	void refill(tokenBucket &pInOutBucket, const std::chrono::steady_clock::time_point pInNow);
+	void addTransfer(const BandwidthDirection pInDirection, const int pInDelta);
+};
+
+}
+
+#endif /* ELFCLOUD_BANDWIDTHSCHEDULER_H_ */
@@ -0,0 +1,78 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+#include "CancelToken.h"
+
+using namespace std;
+
+namespace elfcloud {
+
+// Token of the calling thread, 0 when no Scope is active
+static __thread CancelToken *currentToken=0;
+
+CancelToken::CancelToken(): cancelled(false) {
+}
+
+void CancelToken::cancel() {
+	cancelled=true;
+}
+
+bool CancelToken::isCancelled() {
+	if (cancelled)
+		return true;
+
+	unique_lock<mutex> lock(checkMutex, try_to_lock);
+	if (!lock.owns_lock() || !check)
+		return false;
+
+	chrono::steady_clock::time_point now=chrono::steady_clock::now();
+	if (now-lastCheck<chrono::milliseconds(checkIntervalMilliseconds))
+		return false;
+	lastCheck=now;
+
+	if (check())
+		cancelled=true;
+
+	return cancelled;
+}
+
+void CancelToken::setCheck(const function<bool ()> &pInCheck) {
+	lock_guard<mutex> lock(checkMutex);
+	check=pInCheck;
+	lastCheck=chrono::steady_clock::time_point();
+}
+
+CancelToken *CancelToken::getCurrent() {
+	return currentToken;
+}
+
+CancelToken::Scope::Scope(CancelToken &pInToken): previous(currentToken) {
+	currentToken=&pInToken;
+}
+
+CancelToken::Scope::~Scope() {
+	currentToken=previous;
+}
+
+}
@@ -0,0 +1,81 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+
+#ifndef ELFCLOUD_CANCELTOKEN_H_
+#define ELFCLOUD_CANCELTOKEN_H_
+
+#include "Object.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+namespace elfcloud {
+
+// Cancellation of server transfers. A token is made current for the calling thread with a Scope, transfers
+// started by the thread check it from the libcurl progress callback and abort with
+// Exception(ECSCI_EXC_REQUEST_CANCELLED) once it is cancelled. Failed transfers are not retried after that.
+//
+// A token is cancelled explicitly with cancel() or by its check function, which is evaluated at most every
+// checkIntervalMilliseconds while a transfer is running:
+//    CancelToken token;
+//    token.setCheck([]() { return userGaveUp(); });
+//    CancelToken::Scope scope(token);
+//    cluster->fetchDataItem(dataItem);
+class CancelToken: public Object {
+public:
+	CancelToken();
+
+	void cancel();
+	bool isCancelled();
+
+	void setCheck(const std::function<bool ()> &pInCheck);
+
+	// Token of the calling thread, 0 when no Scope is active
+	static CancelToken *getCurrent();
+
+	// Makes the token current for the calling thread while in scope, scopes can be nested
+	class Scope {
+	public:
+		Scope(CancelToken &pInToken);
+		~Scope();
+	private:
+		CancelToken *previous;
+	};
+
+	static const unsigned int checkIntervalMilliseconds=50;
+
+private:
+	std::atomic<bool> cancelled;
+
+	std::mutex checkMutex;
+	std::function<bool ()> check;
+	std::chrono::steady_clock::time_point lastCheck;
+};
+
+}
+
+#endif /* ELFCLOUD_CANCELTOKEN_H_ */
@@ -0,0 +1,81 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+
+#include "CipherEngine.h"
+#include "Exception.h"
+
+using namespace CryptoPP;
+
+namespace elfcloud {
+
+// Mode running on a private copy of a prepared key schedule. Crypto++ block cipher objects may use internal
+// scratch space, so one schedule is never shared by engines that can run at the same time.
+template <class MODE> class ModeEngine: public CipherEngine {
+public:
+    ModeEngine(const PreparedCipher &pInPrepared, const byte *pInIV, const int pInFeedbackSize):
+        cipher(pInPrepared.cipher), mode(cipher, pInIV, pInFeedbackSize) {}
+
+    void process(const byte *pInData, byte *pOutData, const size_t pInDataSize) {
+        mode.ProcessData(pOutData, pInData, pInDataSize);
+    }
+
+    bool isSeekable() const {
+        return mode.IsRandomAccess();
+    }
+
+    void seek(const uint64_t pInOffset) {
+        mode.Seek(pInOffset);
+    }
+
+private:
+    AES::Encryption cipher;
+    MODE mode;
+};
+
+CipherEngine *CipherEngine::create(const PreparedCipher &pInPrepared, const ECCipherMode pInMode, const bool pInEncrypt,
+        const byte *pInIV, const uint64_t pInOffset) {
+
+    switch (pInMode) {
+        case ECSCI_CIPHERMODE_CFB8: {
+            if (pInOffset)
+                throw Exception(ECSCI_EXC_ENCRYPTION_ERROR, "CFB8 stream cannot start at an offset");
+            if (pInEncrypt)
+                return new ModeEngine<CFB_Mode_ExternalCipher::Encryption>(pInPrepared, pInIV, 1);
+            return new ModeEngine<CFB_Mode_ExternalCipher::Decryption>(pInPrepared, pInIV, 1);
+        }
+        case ECSCI_CIPHERMODE_CTR: {
+            // Encryption and decryption are the same operation
+            ModeEngine<CTR_Mode_ExternalCipher::Encryption> *engine=new ModeEngine<CTR_Mode_ExternalCipher::Encryption>(pInPrepared, pInIV, 0);
+            if (pInOffset)
+                engine->seek(pInOffset);
+            return engine;
+        }
+        default: {
+            throw Exception(ECSCI_EXC_ENCRYPTION_ERROR, "Unknown cipher mode");
+        }
+    }
+}
+
+}
@@ -0,0 +1,74 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+
+#ifndef ELFCLOUD_CIPHERENGINE_H_
+#define ELFCLOUD_CIPHERENGINE_H_
+
+#include "Object.h"
+#include "Types.h"
+
+#include <stdint.h>
+
+#include "ext_cryptopp.h"
+
+namespace elfcloud {
+
+// AES key schedule and IV of an AES key, expanded once when the key is created (see KeyImpl). Immutable,
+// each cipher stream runs on its own copy of the schedule so that the AES key setup is not repeated per stream.
+struct PreparedCipher {
+    CryptoPP::AES::Encryption cipher;
+    CryptoPP::SecByteBlock iv;
+
+    PreparedCipher(const CryptoPP::SecByteBlock &pInKey, const CryptoPP::SecByteBlock &pInIV):
+        cipher(pInKey.m_ptr, pInKey.size()), iv(pInIV) {}
+};
+
+// Cipher stream over the content of one data item, encrypting or decrypting consecutive pieces of it.
+// Created with create() for the cipher mode of the data item:
+//  - ECSCI_CIPHERMODE_CFB8 starts from a 16 byte feedback register, the key IV at the start of the content or
+//    the last 16 ciphertext bytes before the position. Encryption is serial.
+//  - ECSCI_CIPHERMODE_CTR starts from the initial counter block of the data item at any byte offset, so that
+//    any part of the content can be encrypted or decrypted on its own.
+class CipherEngine: public Object {
+public:
+    virtual ~CipherEngine() {}
+
+    // In place when pInData and pOutData are the same
+    virtual void process(const byte *pInData, byte *pOutData, const size_t pInDataSize)=0;
+
+    // Random access engines can be created at any offset of the content
+    virtual bool isSeekable() const=0;
+
+    static const unsigned int ivSize=16;
+
+    // pInIV is the CFB8 feedback register or the CTR initial counter block, pInOffset the position of the CTR
+    // stream in the content. Throws Exception(ECSCI_EXC_ENCRYPTION_ERROR) for an offset CFB8 cannot start at.
+    static CipherEngine *create(const PreparedCipher &pInPrepared, const ECCipherMode pInMode, const bool pInEncrypt,
+            const byte *pInIV, const uint64_t pInOffset=0);
+};
+
+}
+
+#endif /* ELFCLOUD_CIPHERENGINE_H_ */
@@ -34,6 +34,9 @@
 #include "Key.h"
 #include "KeyRing.h"
 #include "Config.h"
+#include "BandwidthScheduler.h"
+#include "RequestScheduler.h"
+#include "SegmentSizer.h"
 #include <stdio.h>
 
 #ifdef WINDOWS
@@ -62,6 +65,10 @@ namespace elfcloud {
 	DllExport Client::Client()
     {
 	    serverConn = NULL;
+        requestScheduler = new RequestScheduler();
+        segmentSizer = new SegmentSizer();
+        containerCache = new MetadataCache<Container>();
+        dataItemCache = new MetadataCache<DataItem>();
     	serverConn = new ServerConnection(this);
 
         //_impl_data = new _Client_impl_data();
@@ -79,6 +86,9 @@ namespace elfcloud {
 
     Client::~Client()
     {
+        if (warmupThread.joinable())
+            warmupThread.join();
+
         if (serverConn) {
             delete serverConn;
             serverConn=NULL;
@@ -88,8 +98,27 @@ namespace elfcloud {
             delete keyRing;
         }
 
-        mCacheContainer.clear();
-        mCacheDataItem.clear();
+        delete requestScheduler;
+        delete segmentSizer;
+
+        delete containerCache;
+        delete dataItemCache;
+    }
+
+    void Client::warmup()
+    {
+        if (warmupThread.joinable())
+            return;
+
+        ServerConnection *conn=serverConn;
+        warmupThread=std::thread([conn]() {
+            try {
+                conn->warmup();
+            } catch (elfcloud::Exception &e) {
+                // Not fatal, the first request authenticates and reports the error again
+                log("Client/warmup(): " + e.getMsg(), 1);
+            }
+        });
     }
 
     Vault *Client::addVault(const string pInName, const string pInType)
@@ -151,6 +180,14 @@ namespace elfcloud {
     	return serverConn;
     }
 
+    RequestScheduler* Client::getRequestScheduler() {
+        return requestScheduler;
+    }
+
+    SegmentSizer* Client::getSegmentSizer() {
+        return segmentSizer;
+    }
+
     string Client::getAuthMethod() {
     	return authMethod;
     }
@@ -213,67 +250,96 @@ namespace elfcloud {
 
     void Client::setConf(std::string pInKey, std::string pInValue)
     {
-        mConf[pInKey]=pInValue;
+        {
+            std::lock_guard<std::mutex> lock(confMutex);
+            mConf[pInKey]=pInValue;
+        }
+
+        if (!pInKey.compare(0, 5, "http."))
+            serverConn->updateConnectionProfile();
 
         std::string prefixSpeedLimit("http.limit.");
-        if (serverConn && !pInKey.compare(0, prefixSpeedLimit.size(), prefixSpeedLimit)) {
+        if (!pInKey.compare(0, prefixSpeedLimit.size(), prefixSpeedLimit)) {
             if (!pInKey.compare("http.limit.receive.Bps"))
-                serverConn->setSpeedLimitReceive(atoi(pInValue.c_str()));
+                BandwidthScheduler::getInstance().setLimit(ELFCLOUD_BANDWIDTH_RECEIVE, strtoull(pInValue.c_str(), 0, 10));
             if (!pInKey.compare("http.limit.send.Bps"))
-                serverConn->setSpeedLimitSend(atoi(pInValue.c_str()));
+                BandwidthScheduler::getInstance().setLimit(ELFCLOUD_BANDWIDTH_SEND, strtoull(pInValue.c_str(), 0, 10));
+        }
+
+        std::string prefixSchedulerLimit("http.scheduler.limit.");
+        if (!pInKey.compare("http.scheduler.slots")) {
+            requestScheduler->setSlots(strtoul(pInValue.c_str(), 0, 10));
+        } else if (!pInKey.compare(0, prefixSchedulerLimit.size(), prefixSchedulerLimit)) {
+            RequestPriority priority;
+            if (RequestScheduler::getPriorityByName(pInKey.substr(prefixSchedulerLimit.size()), priority))
+                requestScheduler->setClassLimit(priority, strtoul(pInValue.c_str(), 0, 10));
+        }
+
+        if (!pInKey.compare("http.segment.size.bytes")) {
+            if (!pInValue.compare("auto")) {
+                segmentSizer->setAdaptive(true);
+            } else {
+                unsigned int size=strtoul(pInValue.c_str(), 0, 10);
+                if (size>10240) {
+                    segmentSizer->setFixedSize(size);
+                    segmentSizer->setAdaptive(false);
+                }
+            }
+        } else if (!pInKey.compare("http.segment.size.min.bytes")) {
+            segmentSizer->setBounds(strtoul(pInValue.c_str(), 0, 10), 0);
+        } else if (!pInKey.compare("http.segment.size.max.bytes")) {
+            segmentSizer->setBounds(0, strtoul(pInValue.c_str(), 0, 10));
+        }
+
+        if (!pInKey.compare("cache.metadata.entries")) {
+            containerCache->setCapacity(strtoull(pInValue.c_str(), 0, 10));
+            dataItemCache->setCapacity(strtoull(pInValue.c_str(), 0, 10));
+        } else if (!pInKey.compare("cache.metadata.ttl.seconds")) {
+            containerCache->setTTL(strtoul(pInValue.c_str(), 0, 10));
+            dataItemCache->setTTL(strtoul(pInValue.c_str(), 0, 10));
         }
+
+        if (!pInKey.compare("data.decrypt.threads"))
+            CryptoHelper::setDecryptionThreads(strtoul(pInValue.c_str(), 0, 10));
     }
 
     shared_ptr<Container> Client::getCacheContainer(uint64_t pInContainerId) {
-        return mCacheContainer[pInContainerId];
+        return containerCache->get(pInContainerId);
+    }
+
+    vector<shared_ptr<Container>> Client::getContainersById(const vector<uint64_t>& pInContainerIds) {
+        return Container::getContainersById(this, pInContainerIds);
     }
 
     shared_ptr<Container> Client::setCacheContainer(shared_ptr<Container> pInContainer) {
 
-        shared_ptr<Container> current=mCacheContainer[pInContainer->getContainerId()];
+        // An already cached object is replaced, not modified, existing pointers keep their contents
+        bool updated;
+        shared_ptr<Container> current=containerCache->set(pInContainer->getContainerId(), pInContainer, updated);
 
-        if (current) {
-            // Update cached object with current data without replacing cached object,
-            // existing pointers remain valid and the objects get updated contents.
-            current->assign(pInContainer);
-            stringstream ss;
-            ss << "set(): Container cache update id " << pInContainer->getContainerId() << ", cache size= " << mCacheContainer.size();
-            Client::log(ss.str(), 9);
-            return current;
-        } else {
-            // New cache entry, store the object
-            mCacheContainer[pInContainer->getContainerId()]=pInContainer;
+        if (isLogged(9)) {
             stringstream ss;
-            ss << "set(): Container cache insert id " << pInContainer->getContainerId() << ", cache size= " << mCacheContainer.size();
+            ss << "set(): Container cache " << (updated ? "update" : "insert") << " id " << pInContainer->getContainerId() << ", cache size= " << containerCache->size();
             Client::log(ss.str(), 9);
-            return pInContainer;
         }
+        return current;
     }
 
     shared_ptr<DataItem> Client::getCacheDataItem(uint64_t pInDataItemId) {
-        return mCacheDataItem[pInDataItemId];
+        return dataItemCache->get(pInDataItemId);
     }
 
     shared_ptr<DataItem> Client::setCacheDataItem(shared_ptr<DataItem> pInDataItem) {
 
-        shared_ptr<DataItem> current=mCacheDataItem[pInDataItem->getId()];
+        bool updated;
+        shared_ptr<DataItem> current=dataItemCache->set(pInDataItem->getId(), pInDataItem, updated);
 
-        if (current) {
-            // Update cached object with current data without replacing cached object,
-            // existing pointers remain valid and the objects get updated contents.
-            current->assign(pInDataItem);
-            stringstream ss;
-            ss << "set(): DataItem cache update id " << pInDataItem->getId() << ", cache size= " << mCacheDataItem.size();
-            Client::log(ss.str(), 9);
-            return current;
-        } else {
-            // New cache entry, store the object
-            mCacheDataItem[pInDataItem->getId()]=pInDataItem;
+        if (isLogged(9)) {
             stringstream ss;
-            ss << "set(): DataItem cache insert id " << pInDataItem->getId() << ", cache size= " << mCacheDataItem.size();
+            ss << "set(): DataItem cache " << (updated ? "update" : "insert") << " id " << pInDataItem->getId() << ", cache size= " << dataItemCache->size();
             Client::log(ss.str(), 9);
-            return pInDataItem;
         }
+        return current;
     }
 
     void Client::clearCache() {
@@ -282,11 +348,19 @@ namespace elfcloud {
     }
 
     void Client::clearCacheContainer() {
-        mCacheContainer.clear();
+        containerCache->clear();
     }
 
     void Client::clearCacheDataItem() {
-        mCacheDataItem.clear();
+        dataItemCache->clear();
+    }
+
+    MetadataCacheStats Client::getCacheContainerStats() {
+        return containerCache->getStats();
+    }
+
+    MetadataCacheStats Client::getCacheDataItemStats() {
+        return dataItemCache->getStats();
     }
 
 } // ns elfcloud
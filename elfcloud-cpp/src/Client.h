@@ -28,10 +28,14 @@
 #include <string>
 #include <list>
 #include <map>
+#include <vector>
 #include <stdlib.h>
 #include <memory>
+#include <thread>
+#include <mutex>
 
 #include "Object.h"
+#include "MetadataCache.h"
 
 namespace elfcloud {
 
@@ -42,6 +46,8 @@ class CryptoHelper;
 class ServerConnection;
 class Container;
 class DataItem;
+class RequestScheduler;
+class SegmentSizer;
 
 class Client: public elfcloud::Object {
 private:
@@ -55,8 +61,15 @@ private:
 
     elfcloud::CryptoHelper *cryptoHelper;
     elfcloud::KeyRing *keyRing;
+    elfcloud::RequestScheduler *requestScheduler;
+    elfcloud::SegmentSizer *segmentSizer;
 
+    // Runs ServerConnection::warmup() started by warmup(), joined before the connection is destroyed
+    std::thread warmupThread;
+
+    // Read by transfer and warmup threads while the configuration may change
     std::map<std::string, std::string> mConf;
+    std::mutex confMutex;
     void initializeServerConnection();
 
     // Controls library logging, 0 = disabled, higher values produces more log output (9=highest debug)
@@ -64,8 +77,9 @@ private:
 
     static std::string logPath;
 
-    std::map<uint64_t, std::shared_ptr<Container>> mCacheContainer;
-    std::map<uint64_t, std::shared_ptr<DataItem>> mCacheDataItem;
+    // Bounded by cache.metadata.entries and cache.metadata.ttl.seconds, see MetadataCache
+    elfcloud::MetadataCache<Container> *containerCache;
+    elfcloud::MetadataCache<DataItem> *dataItemCache;
 
 public:
     DllExport Client();
@@ -74,6 +88,11 @@ public:
     static void log(const std::string &pInLog);
     static void log(const std::string &pInLog, unsigned int pInEntryLevel);
 
+    // True when an entry of the given level would be written, use to skip formatting of log messages
+    static bool isLogged(unsigned int pInEntryLevel) {
+        return logLevel && pInEntryLevel<=logLevel;
+    }
+
     // Level of logging, 0 = Disabled (default), 1 = Minimal, 9 = Maximum
     // Effective immediately during library use.
     static void setLogLevel(unsigned int pInLogLevel) {
@@ -89,6 +108,7 @@ public:
     // CONFIGURATION OPTIONS MANAGEMENT
 
     std::string getConf(std::string pInKey) {
+        std::lock_guard<std::mutex> lock(confMutex);
         std::map<std::string, std::string>::iterator i=mConf.find(pInKey);
         if (i==mConf.end()) return "not found";
         return (*i).second;
@@ -97,6 +117,8 @@ public:
     elfcloud::KeyRing *getKeyRing();
 
     std::shared_ptr<Container> getCacheContainer(uint64_t);
+    // Batched container lookup, see Container::getContainersById()
+    std::vector<std::shared_ptr<Container>> getContainersById(const std::vector<uint64_t>& pInContainerIds);
     std::shared_ptr<Container> setCacheContainer(std::shared_ptr<Container>);
 
     std::shared_ptr<DataItem> getCacheDataItem(uint64_t pInDataItemId);
@@ -106,6 +128,10 @@ public:
     void clearCacheContainer();
     void clearCacheDataItem();
 
+    // Hit, miss and eviction counts of the metadata caches
+    MetadataCacheStats getCacheContainerStats();
+    MetadataCacheStats getCacheDataItemStats();
+
     DllExport void readUserConfig(const std::string &pInPath);
 
     // http.proxy in hostname:port format, can be prefixed as said in libcurl docs:
@@ -123,8 +149,46 @@ public:
     //
     // http.limit.receive.Bps = Bytes/s speed limit reading from cloud
     // http.limit.send.Bps    = Bytes/s speed limit pushing to cloud
+    //   Limits are shared by all transfers in the process and take effect immediately,
+    //   also for transfers in progress (see BandwidthScheduler).
+    //
+    // http.segment.size.bytes = segment size to cloud store (in bytes, default 20MB), "auto" adapts
+    //   the size to the measured upload throughput and round trip time (see SegmentSizer)
+    // http.segment.size.min.bytes / http.segment.size.max.bytes = bounds of the adaptive size
+    //   (default 1MB and 128MB)
+    // http.segment.retries    = retries of a failed store segment before the upload is
+    //   abandoned (default 5), delay doubles from 1 s between the attempts
+    // http.fetch.retries      = retries of an interrupted passthrough fetch (default 5), the
+    //   transfer continues from the bytes already received with a ranged request. Only connection
+    //   failures are retried, a hash mismatch or an unwritable target file fails at once
+    // http.fetch.stripes      = connections a large uncompressed passthrough fetch is split over
+    //   (default 1), each fetches its own byte range and the ranges are decrypted in parallel.
+    //   Every range takes a request slot of its own, see http.scheduler.slots
+    // http.fetch.stripe.min.bytes = smallest range given to one connection (default 64MB)
+    //
+    // data.compression       = "zlib" compresses data item content before encryption on store,
+    //   content that does not compress is stored as is. Compressed items are always readable.
+    // data.compression.level = zlib compression level 1-9 (default 1)
+    // data.decrypt.threads   = threads decrypting large buffers, and encrypting CTR content
+    //   (default 0 = one per core)
+    // data.cipher.mode       = "CTR" writes new data items in AES-CTR mode with a random per item
+    //   counter block (default CFB8). CTR items can be processed in parallel and from any offset but
+    //   cannot be read by clients that only know CFB8. CFB8 items are always readable.
     //
-    // http.segment.size.bytes = segment size to cloud store (in bytes)
+    // http.scheduler.slots    = server requests running at the same time (default 1)
+    // http.scheduler.limit.<class> = concurrency limit of a request class, class is one of
+    //   foreground, metadata, prefetch or background (default 0 = slot count only)
+    //
+    // cache.metadata.entries  = containers and data items kept in the metadata caches, each (default
+    //   100000, 0 = unbounded). Least recently used entries are evicted, objects still held elsewhere
+    //   stay valid but are no longer cached.
+    // cache.metadata.ttl.seconds = age after which a cached container or data item is fetched from the
+    //   server again (default 0 = never)
+    //
+    // http.session.file       = file the session cookie is kept in between runs (mode 0600). A stored
+    //   session is used without authenticating again until the server rejects it.
+    //
+    // getConf() and setConf() can be called while other threads run requests.
     void setConf(std::string pInKey, std::string pInValue);
 
     elfcloud::Vault *addVault(const std::string pInName, const std::string pInType);
@@ -140,10 +204,20 @@ public:
 	std::string getAuthUsername();
 	std::string getAddress();
 
+	// Authenticates (or restores the persisted session) and connects to the server in the background,
+	// so that the first request does not pay for it. Set the configuration and credentials first.
+	void warmup();
+
 	DllExport void setPasswordAuthenticationCredentials(const std::string pInUsername, const std::string pInPassword);
 
 	elfcloud::ServerConnection *getServerConnection();
 
+	// Admission control and per class queue statistics of server requests, see RequestScheduler
+	elfcloud::RequestScheduler *getRequestScheduler();
+
+	// Segment size of segmented stores and the sizes chosen so far, see SegmentSizer
+	elfcloud::SegmentSizer *getSegmentSizer();
+
 private:
     struct _Client_impl_data *_impl_data;
 
@@ -24,6 +24,7 @@
 
 #include "Cluster.h"
 #include "ServerConnection.h"
+#include "JsonStreamReader.h"
 
 using namespace std;
 
@@ -241,6 +242,51 @@ void Cluster::initWithDictionary(Json::Value& pInClusterDict) {
 	return;
 }
 
+void Cluster::initWithReader(JsonStreamReader& pInReader) {
+
+	if (!pInReader.isObject()) throw Exception();
+
+	// Members may arrive in any order, values are collected first so that the name is set before the ID
+	// as in initWithDictionary()
+	string type, name, lastAccessedDate, modifiedDate;
+	uint64_t id=0, dataitems=0, descendants=0, size=0;
+	vector<string> perms;
+	unsigned int found=0;
+
+	string key;
+	pInReader.beginObject();
+	while (pInReader.nextMember(key)) {
+		if (!key.compare("type")) { type=pInReader.readString(); found|=0x001; }
+		else if (!key.compare("name")) { name=pInReader.readString(); found|=0x002; }
+		else if (!key.compare("id")) { id=pInReader.readUInt64(); found|=0x004; }
+		else if (!key.compare("dataitems")) { dataitems=pInReader.readUInt64(); found|=0x008; }
+		else if (!key.compare("descendants")) { descendants=pInReader.readUInt64(); found|=0x010; }
+		else if (!key.compare("size")) { size=pInReader.readUInt64(); found|=0x020; }
+		else if (!key.compare("last_accessed_date")) { lastAccessedDate=pInReader.readString(); found|=0x040; }
+		else if (!key.compare("modified_date")) { modifiedDate=pInReader.readString(); found|=0x080; }
+		else if (!key.compare("permissions")) {
+			if (!pInReader.isArray()) throw Exception();
+			pInReader.beginArray();
+			while (pInReader.nextElement())
+				perms.push_back(pInReader.readString());
+			found|=0x100;
+		}
+		else pInReader.skipValue();
+	}
+
+	if (found!=0x1FF) throw Exception();
+	if (type.compare("cluster")) throw Exception();
+
+	setClusterName(name);
+	setClusterID(id);
+	setClusterDataItems(dataitems);
+	setClusterDescendants(descendants);
+	setSizeBytes(size);
+	setLastAccessed(lastAccessedDate);
+	setLastModified(modifiedDate);
+	permissions.swap(perms);
+}
+
 string Cluster::getContainerType() const {
     return "cluster";
 }
@@ -64,6 +64,7 @@ private:
 
 #ifdef ELFCLOUD_LIB
     void initWithDictionary(Json::Value&);
+    void initWithReader(JsonStreamReader&);
 #endif
 
 public:
@@ -0,0 +1,146 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+
+#include "CompressionHelper.h"
+#include "Exception.h"
+
+#include <zlib.h>
+
+namespace elfcloud {
+
+    CompressionHelper::CompressionHelper(): stream(0), compressing(false), finished(false) {
+    }
+
+    CompressionHelper::~CompressionHelper() {
+        endStream();
+    }
+
+    void CompressionHelper::endStream() {
+        if (!stream)
+            return;
+
+        if (compressing)
+            deflateEnd(stream);
+        else
+            inflateEnd(stream);
+
+        delete stream;
+        stream=0;
+    }
+
+    bool CompressionHelper::isSupported(const std::string &pInMetaValue) {
+        return !pInMetaValue.compare(getMetaValue());
+    }
+
+    void CompressionHelper::compressStreamBegin(const int pInLevel) {
+        endStream();
+
+        stream=new z_stream();
+        compressing=true;
+        finished=false;
+
+        if (deflateInit(stream, pInLevel)!=Z_OK) {
+            delete stream;
+            stream=0;
+            throw Exception(ECSCI_EXC_COMPRESSION_ERROR, "Unable to initialize compression");
+        }
+    }
+
+    void CompressionHelper::compressStreamContinue(const byte *pInData, const size_t pInDataSize, const bool pInFinish, std::vector<byte> &pOutData) {
+        if (!stream || !compressing || finished)
+            throw Exception(ECSCI_EXC_COMPRESSION_ERROR, "Compression stream not initialized");
+
+        const int flush=pInFinish ? Z_FINISH : Z_SYNC_FLUSH;
+
+        stream->next_in=(Bytef*) pInData;
+        stream->avail_in=pInDataSize;
+
+        // Reserve the worst case output up front, deflate() is then normally done in a single call
+        size_t outputStart=pOutData.size();
+        pOutData.resize(outputStart+deflateBound(stream, pInDataSize)+16);
+
+        int ret;
+        do {
+            if (pOutData.size()==outputStart)
+                pOutData.resize(outputStart+64*1024);
+
+            stream->next_out=&pOutData[outputStart];
+            stream->avail_out=pOutData.size()-outputStart;
+
+            ret=deflate(stream, flush);
+            if (Z_STREAM_ERROR==ret)
+                throw Exception(ECSCI_EXC_COMPRESSION_ERROR, "Compression failed");
+
+            outputStart=pOutData.size()-stream->avail_out;
+            pOutData.resize(outputStart);
+        } while (pInFinish ? ret!=Z_STREAM_END : (stream->avail_in>0 || 0==stream->avail_out));
+
+        finished=pInFinish;
+    }
+
+    void CompressionHelper::decompressStreamBegin() {
+        endStream();
+
+        stream=new z_stream();
+        compressing=false;
+        finished=false;
+
+        if (inflateInit(stream)!=Z_OK) {
+            delete stream;
+            stream=0;
+            throw Exception(ECSCI_EXC_COMPRESSION_ERROR, "Unable to initialize decompression");
+        }
+    }
+
+    bool CompressionHelper::decompressStreamContinue(const byte *pInData, const size_t pInDataSize, std::vector<byte> &pOutData) {
+        if (!stream || compressing)
+            return false;
+
+        stream->next_in=(Bytef*) pInData;
+        stream->avail_in=pInDataSize;
+
+        while (stream->avail_in>0 && !finished) {
+            // Grow the output geometrically, text typically expands several times
+            size_t outputStart=pOutData.size();
+            size_t growth=pInDataSize*4>64*1024 ? pInDataSize*4 : 64*1024;
+            pOutData.resize(outputStart+growth);
+
+            stream->next_out=&pOutData[outputStart];
+            stream->avail_out=growth;
+
+            int ret=inflate(stream, Z_NO_FLUSH);
+            pOutData.resize(pOutData.size()-stream->avail_out);
+
+            if (Z_STREAM_END==ret)
+                finished=true;
+            else if (ret!=Z_OK && ret!=Z_BUF_ERROR)
+                return false;
+        }
+
+        // Trailing bytes after the end of the stream mean corrupted input
+        return 0==stream->avail_in;
+    }
+
+}
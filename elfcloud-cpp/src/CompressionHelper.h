@@ -0,0 +1,73 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+
+#ifndef ELFCLOUD_COMPRESSIONHELPER_H_
+#define ELFCLOUD_COMPRESSIONHELPER_H_
+
+#include "Object.h"
+#include "Types.h"
+
+#include <string>
+#include <vector>
+
+struct z_stream_s;
+
+namespace elfcloud {
+
+// Optional compression of data item content, applied before encryption on store and after decryption on fetch.
+// Compressed data items carry "CMP:ZLIB" and the uncompressed length "CSZ:<bytes>" in their v1 meta header,
+// items without the CMP key are stored as is.
+class CompressionHelper: public elfcloud::Object {
+private:
+    struct z_stream_s *stream;
+    bool compressing;
+    bool finished;
+
+    void endStream();
+
+public:
+    CompressionHelper();
+    virtual ~CompressionHelper();
+
+    // Value of the CMP meta key written by this helper
+    static const char *getMetaValue() { return "ZLIB"; }
+    // Whether data items with the given CMP meta value can be decompressed
+    static bool isSupported(const std::string &pInMetaValue);
+
+    // Compressed output is appended to pOutData. Unless pInFinish is set the output is flushed so that
+    // everything given so far can be decompressed from it, pInFinish ends the stream.
+    void compressStreamBegin(const int pInLevel);
+    void compressStreamContinue(const byte *pInData, const size_t pInDataSize, const bool pInFinish, std::vector<byte> &pOutData);
+
+    // Decompressed output is appended to pOutData, returns false on corrupted input
+    void decompressStreamBegin();
+    bool decompressStreamContinue(const byte *pInData, const size_t pInDataSize, std::vector<byte> &pOutData);
+
+    // True once the end of the compressed stream has been seen
+    bool isStreamFinished() const { return finished; }
+};
+
+}
+#endif /* ELFCLOUD_COMPRESSIONHELPER_H_ */
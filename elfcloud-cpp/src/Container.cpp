@@ -28,14 +28,22 @@
 #include "Exception.h"
 #include "ServerConnection.h"
 #include "KeyHint.h"
+#include "JsonStreamReader.h"
+#include "CompressionHelper.h"
+#include "SegmentSizer.h"
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <sstream>
 
 #include <fstream>
 #include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <thread>
+#include <chrono>
 
 using std::string;
 using std::map;
@@ -76,9 +84,8 @@ namespace elfcloud {
     			responseHeaders, &responseBody, &responseBodyLength, ELFCLOUD_INTERFACE_FETCH);
         cout << "done core request" << endl;
 
-    	// Data pointed to by finalData will be ultimately placed inside the DataItem object
+    	// Response buffer is decrypted in place and handed over to the DataItem object as is
     	byte *finalData=responseBody;
-    	bool mustFreeResponseBuffer=false;
 
     	std::map<string, string>::iterator it=responseHeaders.find("X-ELFCLOUD-RESULT");
     	bool fetchSuccessful=false;
@@ -88,22 +95,6 @@ namespace elfcloud {
     			fetchSuccessful=true;
     	}
 
-    	// VERIFY RESPONSE HASH FROM X-ELFCLOUD-HASH
-    	string localHash=CryptoHelper::getHashMD5AsHexString(responseBody, responseBodyLength);
-
-    	if ((it=responseHeaders.find("X-ELFCLOUD-HASH"))!=responseHeaders.end()) {
-    		string serverHash=(*it).second;
-
-    		if (localHash.compare(serverHash)) {
-    			// Response hash mismatch
-                stringstream ss;
-                ss << "Fetch X-ELFCLOUD-HASH mismatch, local: " << localHash << ", remote: " << serverHash;
-                Client::log(ss.str(), 1);
-                delete[] finalData;
-    			return false;
-    		}
-    	}
-
     	// PARSE META HEADER
     	// Example: X-ELFCLOUD-META: v1:ENC:AES256:KHA:5216ddcc58e8dade5256075e77f642da:CHA:5216ddcc58e8dade5256075e77f642da::
 
@@ -112,6 +103,15 @@ namespace elfcloud {
     	}
     	map<string, string> metaTokens=pInOutDataItem->getMetaHeaderKVPairs();
 
+    	// Response hash (X-ELFCLOUD-HASH) and content hash (CHA) are calculated during decryption when possible,
+    	// the content hash covers the decompressed content and takes a pass of its own for compressed items
+    	string serverHash, localHash, localContentHash;
+    	bool hasServerHash=(it=responseHeaders.find("X-ELFCLOUD-HASH"))!=responseHeaders.end();
+    	if (hasServerHash)
+    		serverHash=(*it).second;
+    	bool contentHashFused=metaTokens.count("CHA") && !metaTokens.count("CMP");
+    	bool responseHashFused=false;
+
     	if (metaTokens.count("ENC")) {
     		string encValue=(*metaTokens.find("ENC")).second;
 
@@ -125,54 +125,99 @@ namespace elfcloud {
                     cout << "Warning fetch could not find KHA meta, relying on default key decryption" << endl;
                 }
 
-    			finalData=new byte[responseBodyLength];
-                memset(finalData, 0, responseBodyLength);
-    			mustFreeResponseBuffer=true;
-
                 bool res;
 
-                // Key pointers returned by KeyRing are copies and must be free'd
-                auto_ptr<elfcloud::Key> key;
+                // Shared with the key ring, no copy of the key is made
+                shared_ptr<const elfcloud::Key> key;
 
                 try {
                     // Pointer is owned by DI
                     KeyHint *keyHint=pInOutDataItem->getKeyHint();
 
                     if (!keyHint) {
-                        key.reset(client->getKeyRing()->getDefaultCipherKey());
+                        key=client->getKeyRing()->getSharedDefaultCipherKey();
                     } else {
-                        key.reset(client->getKeyRing()->getCipherKey(*keyHint));
+                        key=client->getKeyRing()->getSharedCipherKey(*keyHint);
                     }
-                    res=CryptoHelper::decryptData(key.get(), responseBody, finalData, responseBodyLength);
+                    byte iv[CipherEngine::ivSize];
+                    ECCipherMode mode=pInOutDataItem->getCipherMode();
+                    if (ECSCI_CIPHERMODE_CTR==mode && !pInOutDataItem->getCipherIV(iv))
+                        res=false;
+                    else
+                        res=CryptoHelper::decryptDataInPlace(key.get(), finalData, responseBodyLength,
+                                hasServerHash ? &localHash : 0, contentHashFused ? &localContentHash : 0, mode, iv);
+                    responseHashFused=true;
                 }
                 catch (Exception &e) {
+                    free(finalData);
                     string errMsg="Failed to resolve content key for decryption during fetch data item operation ("+e.getMsg()+")";
                     throw Exception(ECSCI_EXC_KEYMGMT_KEY_NOT_FOUND, errMsg);
                 }
 
                 if (!res) {
                     // Decrypt has failed
-                    delete[] finalData;
-                    delete[] responseBody;
+                    free(finalData);
                     throw Exception(ECSCI_EXC_ENCRYPTION_ERROR, "Decryption failed during fetch operation");
                 }
 
     		} // decryption is needed
     	}
 
-    	if (mustFreeResponseBuffer) {
-    		delete[] responseBody;
+    	if (!responseHashFused) {
+    		// Not encrypted, content and response are the same bytes
+    		if (hasServerHash)
+    			localHash=CryptoHelper::getHashMD5AsHexString(finalData, responseBodyLength);
+    		if (contentHashFused)
+    			localContentHash=hasServerHash ? localHash : CryptoHelper::getHashMD5AsHexString(finalData, responseBodyLength);
+    	}
+
+    	// VERIFY RESPONSE HASH FROM X-ELFCLOUD-HASH
+    	if (hasServerHash && localHash.compare(serverHash)) {
+    		// Response hash mismatch
+            stringstream ss;
+            ss << "Fetch X-ELFCLOUD-HASH mismatch, local: " << localHash << ", remote: " << serverHash;
+            Client::log(ss.str(), 1);
+            free(finalData);
+    		return false;
+    	}
+
+    	if (metaTokens.count("CMP")) {
+    		string compression=(*metaTokens.find("CMP")).second;
+    		if (!CompressionHelper::isSupported(compression)) {
+    			free(finalData);
+    			throw Exception(ECSCI_EXC_COMPRESSION_ERROR, "Unsupported data item compression "+compression);
+    		}
+
+    		std::vector<byte> decompressed;
+    		decompressed.reserve(pInOutDataItem->getContentLength());
+
+    		CompressionHelper decompressor;
+    		decompressor.decompressStreamBegin();
+    		bool ok=decompressor.decompressStreamContinue(finalData, responseBodyLength, decompressed) && decompressor.isStreamFinished();
+    		free(finalData);
+    		finalData=0;
+
+    		if (!ok)
+    			throw Exception(ECSCI_EXC_COMPRESSION_ERROR, "Corrupted compressed data item content");
+
+    		responseBodyLength=decompressed.size();
+    		finalData=(byte*) malloc(responseBodyLength ? responseBodyLength : 1);
+    		if (!finalData)
+    			throw Exception(ECSCI_EXC_MEMORY_ALLOCATION_ERROR, "Unable to allocate data item buffer");
+    		if (responseBodyLength)
+    			memcpy(finalData, &decompressed[0], responseBodyLength);
     	}
 
     	if (metaTokens.count("CHA")) {
-    		string localContentHash=CryptoHelper::getHashMD5AsHexString(finalData, responseBodyLength);
+    		if (!contentHashFused)
+    			localContentHash=CryptoHelper::getHashMD5AsHexString(finalData, responseBodyLength);
     		string serverContentHash=(*metaTokens.find("CHA")).second;
 
     		if (localContentHash.compare(serverContentHash)) {
     			cout << "Content hash mismatch: local " << localContentHash << ", remote " << serverContentHash << endl;
                 cout << "Data (total length " << responseBodyLength << ") starts with " << CryptoHelper::getHashMD5AsHexString(finalData, 40) << endl;
 
-                delete[] finalData;
+                free(finalData);
     			return false;
     		}
     	}
@@ -203,39 +248,245 @@ namespace elfcloud {
         byte *requestBody=0;
         unsigned int responseBodyLength=0;
         map<string, string> responseHeaders;
-        client->getServerConnection()->performServerCoreRequest(mapRequestHeaders, requestBody, 0,
-                responseHeaders, &bufferToReceive, &responseBodyLength, ELFCLOUD_INTERFACE_FETCH, passthroughDI);
+
+        if (fetchDataItemStriped(passthroughDI, mapRequestHeaders, responseHeaders))
+            return isFetchResultOK(responseHeaders);
+
+        // A connection lost mid-transfer is retried with exponential backoff, continuing from the bytes already
+        // written out. The retry count starts over whenever an attempt made progress. Other failures (hash
+        // mismatch, target file not writable, truncated compressed content, missing key) would only repeat.
+        unsigned int maxRetries=5;
+        if (client->getConf("http.fetch.retries").compare("not found")) {
+            maxRetries=strtoul(client->getConf("http.fetch.retries").c_str(), 0, 10);
+        }
+
+        passthroughFetchState fetchState;
+        unsigned int failures=0;
+
+        while (true) {
+            uint64_t offsetBefore=fetchState.offset;
+
+            try {
+                client->getServerConnection()->performServerCoreRequest(mapRequestHeaders, requestBody, 0,
+                        responseHeaders, &bufferToReceive, &responseBodyLength, ELFCLOUD_INTERFACE_FETCH, passthroughDI, &fetchState);
+                break;
+            } catch (Exception &e) {
+                if (fetchState.offset>offsetBefore)
+                    failures=0;
+
+                if (failures>=maxRetries || ECSCI_EXC_NETWORK_CONNECTION_FAILED!=e.getCode())
+                    throw;
+
+                unsigned int delaySeconds=1<<(failures<6 ? failures : 6);
+                failures++;
+
+                stringstream ss;
+                ss << "Container/fetchDataItem(): Fetch of " << pInOutDataItem->getDataItemName() << " failed at byte "
+                   << fetchState.offset << " (" << e.getMsg() << "), retrying in " << delaySeconds << " s";
+                Client::log(ss.str(), 1);
+                std::this_thread::sleep_for(std::chrono::seconds(delaySeconds));
+            }
+        }
 
         if (bufferToReceive) {
             free(bufferToReceive);
         }
 
-        std::map<string, string>::iterator it=responseHeaders.find("X-ELFCLOUD-RESULT");
-        fetchSuccessful=false;
-        if (it!=responseHeaders.end()) {
-            string res((*it).second);
-            if (!res.compare("OK"))
-                fetchSuccessful=true;
-        }
+        fetchSuccessful=isFetchResultOK(responseHeaders);
 
         return fetchSuccessful;
     }
 
+    bool Container::isFetchResultOK(map<string, string>& pInResponseHeaders) {
+        std::map<string, string>::iterator it=pInResponseHeaders.find("X-ELFCLOUD-RESULT");
+        return it!=pInResponseHeaders.end() && !(*it).second.compare("OK");
+    }
+
+    // Large uncompressed data items are fetched in ranges over several connections when http.fetch.stripes is
+    // set. Returns false when the item is fetched as a single stream instead.
+    bool Container::fetchDataItemStriped(shared_ptr<DataItemFilePassthrough> pInDataItem,
+            const map<string, string>& pInRequestHeaders, map<string, string>& pOutResponseHeaders) {
+
+        unsigned int maxStripes=1;
+        if (client->getConf("http.fetch.stripes").compare("not found")) {
+            maxStripes=strtoul(client->getConf("http.fetch.stripes").c_str(), 0, 10);
+        }
+        if (maxStripes<2)
+            return false;
+
+        uint64_t minStripeSize=64*1024*1024;
+        if (client->getConf("http.fetch.stripe.min.bytes").compare("not found")) {
+            minStripeSize=strtoull(client->getConf("http.fetch.stripe.min.bytes").c_str(), 0, 10);
+            if (minStripeSize<1024*1024)
+                minStripeSize=1024*1024;
+        }
+
+        // Size, compression and hash come from the caller's listing, the fetch response headers arrive too late to
+        // plan the ranges. Without them the item is fetched as a single stream.
+        uint64_t storedSize=0;
+        string storedMD5;
+        bool compressed=false;
+        if (!pInDataItem->getListedContent(storedSize, storedMD5, compressed) || compressed || storedMD5.empty())
+            return false;
+
+        uint64_t stripes=storedSize/minStripeSize;
+        if (stripes<2)
+            return false;
+        if (stripes>maxStripes)
+            stripes=maxStripes;
+
+        return client->getServerConnection()->performStripedFetchRequest(pInRequestHeaders, pInDataItem,
+                storedSize, (unsigned int) stripes, storedMD5, pOutResponseHeaders);
+    }
+
     // Store data item with key known by the data item, or default to default key
     bool Container::storeDataItem(shared_ptr<elfcloud::DataItem> pInDataItem) {
         try {
 			KeyHint *keyHint=pInDataItem->getKeyHint();
-            return storeDataItem(pInDataItem, client->getKeyRing()->getCipherKey(*keyHint));
+            return storeDataItem(pInDataItem, client->getKeyRing()->getSharedCipherKey(*keyHint).get());
 		} catch (elfcloud::Exception &e) {
-            return storeDataItem(pInDataItem, client->getKeyRing()->getDefaultCipherKey());
+            return storeDataItem(pInDataItem, client->getKeyRing()->getSharedDefaultCipherKey().get());
         }
     }
 
     // Store with default content key
     bool Container::storeDataItemWithDefaultKey(shared_ptr<elfcloud::DataItem> pInDataItem) {
-        return storeDataItem(pInDataItem, client->getKeyRing()->getDefaultCipherKey());
+        return storeDataItem(pInDataItem, client->getKeyRing()->getSharedDefaultCipherKey().get());
+    }
+
+// Progress of a segmented passthrough upload. Kept in "<source file>.upload" while the upload is in progress
+// so that an interrupted upload can continue its APPEND chain, also after a restart.
+struct PassthroughUploadState {
+    uint64_t containerId;
+    string name;
+    uint64_t fileSize;
+    uint64_t fileModified;
+    string keyHash;
+    uint64_t committedBytes;
+    unsigned int committedSegments;
+    ECCipherMode cipherMode;
+    // CFB8 feedback register at committedBytes, or the initial counter block of CTR content
+    byte feedbackRegister[CryptoHelper::feedbackRegisterSize];
+};
+
+static bool loadUploadState(const string& pInPath, PassthroughUploadState& pOutState) {
+    std::ifstream stateStream(pInPath.c_str());
+    if (stateStream.fail())
+        return false;
+
+    string version, nameHex, registerHex;
+    unsigned int cipherMode=0;
+    stateStream >> version >> pOutState.containerId >> nameHex >> pOutState.fileSize >> pOutState.fileModified
+                >> pOutState.keyHash >> pOutState.committedBytes >> pOutState.committedSegments >> cipherMode >> registerHex;
+
+    // v1 files predate CTR content and are not resumed
+    if (stateStream.fail() || version.compare("v2") || registerHex.size()!=2*CryptoHelper::feedbackRegisterSize
+            || (ECSCI_CIPHERMODE_CFB8!=cipherMode && ECSCI_CIPHERMODE_CTR!=cipherMode))
+        return false;
+    pOutState.cipherMode=(ECCipherMode) cipherMode;
+
+    std::vector<byte> nameBuffer(nameHex.size()/2+1);
+    unsigned int nameLength=0;
+    CryptoHelper::HexStringToByteArray(nameHex, &nameBuffer[0], &nameLength);
+    pOutState.name.assign((const char*) &nameBuffer[0], nameLength);
+
+    unsigned int registerLength=0;
+    CryptoHelper::HexStringToByteArray(registerHex, pOutState.feedbackRegister, &registerLength);
+    return registerLength==CryptoHelper::feedbackRegisterSize;
+}
+
+static void saveUploadState(const string& pInPath, const PassthroughUploadState& pInState) {
+    // Write to a temporary file first, a crash must not leave a truncated state behind
+    string tmpPath=pInPath+".tmp";
+    std::ofstream stateStream(tmpPath.c_str(), std::fstream::out|std::fstream::trunc);
+    stateStream << "v2" << endl
+                << pInState.containerId << endl
+                << CryptoHelper::byteArrayToHexString((const byte*) pInState.name.data(), pInState.name.size()) << endl
+                << pInState.fileSize << endl
+                << pInState.fileModified << endl
+                << pInState.keyHash << endl
+                << pInState.committedBytes << endl
+                << pInState.committedSegments << endl
+                << (unsigned int) pInState.cipherMode << endl
+                << CryptoHelper::byteArrayToHexString(pInState.feedbackRegister, CryptoHelper::feedbackRegisterSize) << endl;
+    stateStream.close();
+
+    if (stateStream.fail() || rename(tmpPath.c_str(), pInPath.c_str())!=0)
+        Client::log("Container/storeDataItem(): Unable to save upload progress", 1);
+}
+
+// Compression of stored content, enabled with data.compression=zlib
+bool Container::isCompressionEnabled() {
+    return !client->getConf("data.compression").compare("zlib");
+}
+
+// Cipher mode of newly written content, data.cipher.mode=CTR writes CTR content that can be encrypted and decrypted
+// in parallel and from any offset. CFB8 is the default, as older clients can read only CFB8 content. For CTR the
+// data item gets a new random initial counter block, a counter block is never reused for other content.
+ECCipherMode Container::getNewCipherMode(shared_ptr<elfcloud::DataItem> pInDataItem) {
+    if (client->getConf("data.cipher.mode").compare("CTR")) {
+        pInDataItem->setCipherMode(ECSCI_CIPHERMODE_CFB8);
+        return ECSCI_CIPHERMODE_CFB8;
+    }
+
+    byte iv[CipherEngine::ivSize];
+    CryptoHelper::generateCipherIV(iv);
+    pInDataItem->setCipherMode(ECSCI_CIPHERMODE_CTR, iv);
+    return ECSCI_CIPHERMODE_CTR;
+}
+
+int Container::getCompressionLevel() {
+    // Fast compression by default, text content compresses well already at level 1
+    int level=1;
+    if (client->getConf("data.compression.level").compare("not found")) {
+        level=atoi(client->getConf("data.compression.level").c_str());
+        if (level<1 || level>9)
+            level=1;
+    }
+    return level;
+}
+
+// Size of the named data item as stored on the server, used to find out whether a segment whose response was lost
+// got committed. Returns false when the data item does not exist.
+bool Container::getStoredDataItemSize(const std::string& pInName, uint64_t& pOutSize) {
+    shared_ptr<DataItem> stored=findStoredDataItem(pInName);
+    if (!stored.get())
+        return false;
+
+    pOutSize=stored->getDataLength();
+    return true;
+}
+
+// Listing entry of the named data item, empty when the data item does not exist. Only the one data item is
+// listed, and the Client cache is left as it is.
+shared_ptr<DataItem> Container::findStoredDataItem(const std::string& pInName) {
+    shared_ptr<DataItem> found;
+
+    try {
+        ServerConnection *serverConn=client->getServerConnection();
+        Json::Value req = createRequestListDataItems(pInName);
+
+        serverConn->performServerJSONRequestStreaming(req, [&](JsonStreamReader& pInReader) {
+            if (pInReader.isNull()) {
+                pInReader.skipValue();
+                return;
+            }
+            pInReader.beginArray();
+            while (pInReader.nextElement()) {
+                shared_ptr<DataItem> dataItem(new DataItem(client));
+                dataItem->initWithReader(pInReader);
+                // The name filter is a hint to the server, the answer is matched here as well
+                if (!found.get() && !dataItem->getDataItemName().compare(pInName))
+                    found=dataItem;
+            }
+        });
+    } catch (Exception &ex) {
+        throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Data item lookup failed");
     }
 
+    return found;
+}
+
 bool Container::storeDataItemPassthrough(shared_ptr<elfcloud::DataItem> pInDataItem, const elfcloud::Key *pInContentKey) {
 	map<string, string> mapRequestHeaders;
 
@@ -253,79 +504,207 @@ bool Container::storeDataItemPassthrough(shared_ptr<elfcloud::DataItem> pInDataI
     if (inputStream.fail())
         return false;
 
-    // Defaulting in 20MB segments
-    unsigned int segmentSize=20*1024*1024;
+    struct stat fileStat;
+    if (stat(passthroughDI->getFilePath().c_str(), &fileStat)!=0)
+        return false;
+
+    // Segment size is fixed (20MB by default) or adapts to the link, see SegmentSizer
+    SegmentSizer *segmentSizer=client->getSegmentSizer();
 
-    unsigned int tmpSegmentSize=strtoul(client->getConf("http.segment.size.bytes").c_str(), 0, 10);
-    if (tmpSegmentSize>10240) {
-        segmentSize=tmpSegmentSize;
+    // Failed segments are retried with exponential backoff starting from one second
+    unsigned int maxRetries=5;
+    if (client->getConf("http.segment.retries").compare("not found")) {
+        maxRetries=strtoul(client->getConf("http.segment.retries").c_str(), 0, 10);
     }
 
-    byte* bufferToRead=new byte[segmentSize];
-    byte* bufferToStore=new byte[segmentSize];
+    PassthroughUploadState state;
+    state.containerId=getContainerId();
+    state.name=pInDataItem->getDataItemName();
+    state.fileSize=fileStat.st_size;
+    state.fileModified=fileStat.st_mtime;
+    state.keyHash=pInContentKey->getHint().getKeyHash();
+    state.committedBytes=0;
+    state.committedSegments=0;
+    state.cipherMode=getNewCipherMode(pInDataItem);
+    if (ECSCI_CIPHERMODE_CTR==state.cipherMode)
+        pInDataItem->getCipherIV(state.feedbackRegister);
+    else
+        CryptoHelper::getInitialFeedbackRegister(pInContentKey, state.feedbackRegister);
+
+    string statePath=passthroughDI->getFilePath()+".upload";
+
+    // Compressed uploads cannot be resumed, the compressor state is not kept in the progress file
+    shared_ptr<CompressionHelper> compressor;
+    if (isCompressionEnabled()) {
+        compressor.reset(new CompressionHelper());
+        compressor->compressStreamBegin(getCompressionLevel());
+        pInDataItem->setCompression(CompressionHelper::getMetaValue(), fileStat.st_size);
+    } else {
+        pInDataItem->setCompression("", 0);
+    }
 
-    bool result=false;
+    // Continue an earlier upload of the same file content, if the server still has exactly the committed part
+    {
+        PassthroughUploadState saved;
+        uint64_t storedSize=0;
+        if (loadUploadState(statePath, saved)
+                && saved.containerId==state.containerId && !saved.name.compare(state.name)
+                && saved.fileSize==state.fileSize && saved.fileModified==state.fileModified
+                && !saved.keyHash.compare(state.keyHash) && saved.committedSegments>0
+                && getStoredDataItemSize(state.name, storedSize) && storedSize==saved.committedBytes) {
+            state=saved;
+            inputStream.seekg(state.committedBytes);
+
+            // The interrupted upload was not compressed, and its content continues in the cipher mode it was started in
+            compressor.reset();
+            pInDataItem->setCompression("", 0);
+            pInDataItem->setCipherMode(state.cipherMode, state.feedbackRegister);
+
+            stringstream ss;
+            ss << "Container/storeDataItem(): Resuming upload of " << state.name << " at byte " << state.committedBytes;
+            Client::log(ss.str(), 3);
+        }
+    }
+
+    std::vector<byte> bufferToRead;
+    std::vector<byte> bufferToStore;
+    std::vector<byte> compressed;
 
-    int segmentCount=1;
+    bool result=false;
 
     try {
         CryptoHelper cH;
-        cH.encryptDataStreamBegin(pInContentKey);
+        if (ECSCI_CIPHERMODE_CTR==state.cipherMode)
+            cH.encryptDataStreamBegin(pInContentKey, state.feedbackRegister, state.cipherMode, state.committedBytes);
+        else
+            cH.encryptDataStreamBegin(pInContentKey, state.committedSegments ? state.feedbackRegister : 0);
 
-        while (!inputStream.eof()) {
-            inputStream.read((char*) bufferToRead, segmentSize);
+        while (true) {
+            unsigned int segmentSize=segmentSizer->getSegmentSize();
+            bufferToRead.resize(segmentSize);
+            bufferToStore.resize(segmentSize);
+
+            inputStream.read((char*) &bufferToRead[0], segmentSize);
 
             unsigned int bytesRead=inputStream.gcount();
 
-            if (false==cH.encryptDataStreamContinue(bufferToRead, bufferToStore, bytesRead)) {
+            // Segment payload, the plain segment or its compressed form. Compressed data is encrypted in place.
+            const byte *plainPayload=&bufferToRead[0];
+            byte *payload=&bufferToStore[0];
+            unsigned int payloadLength=bytesRead;
+
+            if (compressor.get()) {
+                compressed.clear();
+                compressor->compressStreamContinue(&bufferToRead[0], bytesRead, inputStream.eof(), compressed);
+
+                if (0==state.committedSegments && bytesRead>0 && compressed.size()>=bytesRead/20*19) {
+                    // Content does not compress, store it as is
+                    Client::log("Container/storeDataItem(): Content not compressible, storing uncompressed", 5);
+                    compressor.reset();
+                    pInDataItem->setCompression("", 0);
+                } else {
+                    payloadLength=compressed.size();
+                    payload=compressed.empty() ? 0 : &compressed[0];
+                    plainPayload=payload;
+                }
+            }
+
+            // An empty file is stored as an empty data item, otherwise there is nothing left to send
+            if (0==payloadLength && state.committedSegments>0)
+                break;
+
+            string payloadHash;
+            if (false==cH.encryptDataStreamContinue(plainPayload, payload, payloadLength, &payloadHash)) {
                 Client::log("Container/storeDataItem(): Encryption failed with the given key", 1);
+                remove(statePath.c_str());
                 throw Exception();
             }
 
-            if (1==segmentCount) {
-                mapRequestHeaders.erase("X-ELFCLOUD-STORE-MODE");
-                mapRequestHeaders.insert(make_pair<string, string>("X-ELFCLOUD-STORE-MODE", "REPLACE"));
-            } else {
-                mapRequestHeaders.erase("X-ELFCLOUD-STORE-MODE");
-                mapRequestHeaders.insert(make_pair<string, string>("X-ELFCLOUD-STORE-MODE", "APPEND"));
-            }
+            mapRequestHeaders.erase("X-ELFCLOUD-STORE-MODE");
+            mapRequestHeaders.insert(make_pair<string, string>("X-ELFCLOUD-STORE-MODE", state.committedSegments ? "APPEND" : "REPLACE"));
 
             mapRequestHeaders.erase("X-ELFCLOUD-META");
             mapRequestHeaders.insert(make_pair<string, string>("X-ELFCLOUD-META", pInDataItem->getMetaDatav1String()));
             mapRequestHeaders.erase("X-ELFCLOUD-HASH");
-            mapRequestHeaders.insert(make_pair<string, string>("X-ELFCLOUD-HASH", CryptoHelper::getHashMD5AsHexString(bufferToStore, bytesRead)));
-
-            byte *responseBody=0;
-            unsigned int responseBodyLength=0;
-            map<string, string> responseHeaders;
-            client->getServerConnection()->performServerCoreRequest(mapRequestHeaders, bufferToStore, bytesRead,
-                    responseHeaders, &responseBody, &responseBodyLength, ELFCLOUD_INTERFACE_STORE);
-
-            if (responseBody) {
-        		delete[] responseBody;
-        		responseBody=0;
-        	}
-
-            std::map<string, string>::iterator it=responseHeaders.find("X-ELFCLOUD-RESULT");
-            if (it!=responseHeaders.end()) {
-                string res((*it).second);
-                stringstream ss;
-                ss << "ELFCLOUD SERVER STORE RESULT: " << res;
-                Client::log(ss.str(), 5);
-                if (res.compare("OK"))
-                    throw Exception();
-                else
-                    segmentCount++;
+            mapRequestHeaders.insert(make_pair(string("X-ELFCLOUD-HASH"), payloadHash));
+
+            for (unsigned int attempt=0; ; attempt++) {
+                try {
+                    byte *responseBody=0;
+                    unsigned int responseBodyLength=0;
+                    map<string, string> responseHeaders;
+                    requestTiming timing;
+                    client->getServerConnection()->performServerCoreRequest(mapRequestHeaders, payload, payloadLength,
+                            responseHeaders, &responseBody, &responseBodyLength, ELFCLOUD_INTERFACE_STORE, 0, 0, &timing);
+
+                    if (responseBody) {
+                        free(responseBody);
+                        responseBody=0;
+                    }
+
+                    std::map<string, string>::iterator it=responseHeaders.find("X-ELFCLOUD-RESULT");
+                    if (it==responseHeaders.end())
+                        throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "No store result from server");
+
+                    string res((*it).second);
+                    stringstream ss;
+                    ss << "ELFCLOUD SERVER STORE RESULT: " << res;
+                    Client::log(ss.str(), 5);
+                    if (res.compare("OK"))
+                        throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Store rejected by server");
+
+                    segmentSizer->recordSegment(payloadLength, timing.totalSeconds, timing.rttSeconds);
+                    break;
+                } catch (Exception &e) {
+                    if (ECSCI_EXC_REQUEST_CANCELLED==e.getCode())
+                        throw;
+
+                    segmentSizer->recordFailure();
+                    if (attempt>=maxRetries)
+                        throw;
+
+                    unsigned int delaySeconds=1<<(attempt<6 ? attempt : 6);
+                    stringstream ss;
+                    ss << "Container/storeDataItem(): Segment " << state.committedSegments+1 << " failed (" << e.getMsg()
+                       << "), retrying in " << delaySeconds << " s";
+                    Client::log(ss.str(), 1);
+                    std::this_thread::sleep_for(std::chrono::seconds(delaySeconds));
+
+                    // REPLACE is safe to repeat. An APPEND may have been committed even though the response was lost,
+                    // the stored size tells whether it must be sent again.
+                    if (state.committedSegments>0) {
+                        uint64_t storedSize=0;
+                        if (getStoredDataItemSize(state.name, storedSize)) {
+                            if (storedSize==state.committedBytes+payloadLength)
+                                break;
+                            if (storedSize!=state.committedBytes) {
+                                // Server side content no longer matches our progress, start over on the next attempt
+                                remove(statePath.c_str());
+                                throw;
+                            }
+                        }
+                    }
+                }
             }
+
+            state.committedBytes+=payloadLength;
+            state.committedSegments++;
+            if (ECSCI_CIPHERMODE_CFB8==state.cipherMode)
+                CryptoHelper::updateFeedbackRegister(state.feedbackRegister, payload, payloadLength);
+
+            if (inputStream.eof())
+                break;
+
+            if (!compressor.get())
+                saveUploadState(statePath, state);
         }
 
+        remove(statePath.c_str());
         result=true;
 
     } catch (...) {
     }
 
-    delete[] bufferToStore;
-    delete[] bufferToRead;
     inputStream.close();
     return result;
 }
@@ -341,7 +720,7 @@ bool Container::storeDataItem(shared_ptr<elfcloud::DataItem> pInDataItem, const
         pInDataItem->setKeyHint(&tmp);
     } else {
         // Will throw if the key is not found, we don't need to store the key here
-        client->getKeyRing()->getCipherKey(*pInDataItem->getKeyHint());
+        client->getKeyRing()->getSharedCipherKey(*pInDataItem->getKeyHint());
     }
 
 	{
@@ -366,16 +745,46 @@ bool Container::storeDataItem(shared_ptr<elfcloud::DataItem> pInDataItem, const
 
 	bool localBufferAllocated=false;
 	byte* bufferToStore=pInDataItem->getDataPtr();
+	unsigned int storeLength=pInDataItem->getDataLength();
+
+    // Compress before encryption when enabled and worthwhile, the data item itself keeps the plain content
+    std::vector<byte> compressed;
+    pInDataItem->setCompression("", 0);
+    if (isCompressionEnabled() && storeLength>0) {
+        CompressionHelper compressor;
+        compressor.compressStreamBegin(getCompressionLevel());
+        compressor.compressStreamContinue(pInDataItem->getDataPtr(), storeLength, true, compressed);
+
+        if (compressed.size()<storeLength/20*19) {
+            pInDataItem->setCompression(CompressionHelper::getMetaValue(), storeLength);
+            storeLength=compressed.size();
+        } else {
+            compressed.clear();
+        }
+    }
 
-    bufferToStore=new byte[pInDataItem->getDataLength()];
+    bufferToStore=new byte[storeLength];
     localBufferAllocated=true;
 
-    if (false==CryptoHelper::encryptData(pInContentKey, pInDataItem->getDataPtr(), bufferToStore, pInDataItem->getDataLength())) {
+    // The request hash and, for uncompressed content without one, the content hash (CHA) come from the encryption pass
+    string requestHash;
+    string contentHash;
+    bool hashContent=compressed.empty() && pInDataItem->getContentHash().empty();
+
+    ECCipherMode cipherMode=getNewCipherMode(pInDataItem);
+    byte iv[CipherEngine::ivSize];
+    pInDataItem->getCipherIV(iv);
+
+    if (false==CryptoHelper::encryptData(pInContentKey, compressed.empty() ? pInDataItem->getDataPtr() : &compressed[0], bufferToStore, storeLength,
+            hashContent ? &contentHash : 0, &requestHash, cipherMode, iv)) {
         delete[] bufferToStore;
 		Client::log("Container/storeDataItem(): Encryption failed with the given key", 1);
         throw Exception(ECSCI_EXC_ENCRYPTION_ERROR, "Encryption failed with the given key");
     }
 
+    if (hashContent)
+        pInDataItem->setContentHash(contentHash);
+
 	/***
 		switch (pInStoreMode) {
 			case ELFCLOUD_STORE_MODE_NEW: {
@@ -408,13 +817,12 @@ bool Container::storeDataItem(shared_ptr<elfcloud::DataItem> pInDataItem, const
 	mapRequestHeaders.insert(make_pair<string, string>("X-ELFCLOUD-META", pInDataItem->getMetaDatav1String()));
 
 	// STORE REQUEST HASH
-	mapRequestHeaders.insert(make_pair<string, string>("X-ELFCLOUD-HASH",
-			CryptoHelper::getHashMD5AsHexString(bufferToStore, pInDataItem->getDataLength())));
+	mapRequestHeaders.insert(make_pair(string("X-ELFCLOUD-HASH"), requestHash));
 
 	byte *responseBody=0;
 	unsigned int responseBodyLength=0;
 	map<string, string> responseHeaders;
-	client->getServerConnection()->performServerCoreRequest(mapRequestHeaders, bufferToStore, pInDataItem->getDataLength(),
+	client->getServerConnection()->performServerCoreRequest(mapRequestHeaders, bufferToStore, storeLength,
 			responseHeaders, &responseBody, &responseBodyLength, ELFCLOUD_INTERFACE_STORE);
 
 	// Release encrypted data buffer if it exists
@@ -423,9 +831,9 @@ bool Container::storeDataItem(shared_ptr<elfcloud::DataItem> pInDataItem, const
 	}
 
 	if (responseBody) {
-		// performServerCoreRequest provides server's http response buffer (merged from chunks) to upstream caller,
+		// performServerCoreRequest provides server's http response buffer to upstream caller,
 		// release responsibility is with us.
-		delete[] responseBody;
+		free(responseBody);
 		responseBody=0;
 	}
 
@@ -493,6 +901,15 @@ Json::Value Container::createRequestListDataItems(){
 	return list_dataitems;
 }
 
+// list_dataitems limited to the named data item, the response holds one entry instead of the whole container
+Json::Value Container::createRequestListDataItems(const std::string& pInName) {
+	Json::Value list_dataitems=createRequestListDataItems();
+	list_dataitems["params"]["names"] = Json::Value(Json::arrayValue);
+	list_dataitems["params"]["names"].append(Json::Value(pInName));
+
+	return list_dataitems;
+}
+
 Json::Value Container::createRequestListContents() {
 	Json::Value req(Json::objectValue);
 	req["method"] = Json::Value("list_contents");
@@ -502,7 +919,7 @@ Json::Value Container::createRequestListContents() {
 	return req;
 }
 
-std::map<std::string, std::list<shared_ptr<elfcloud::Object>>*> *Container::listContents() {
+std::map<std::string, std::list<shared_ptr<elfcloud::Object>>*> *Container::listContents(bool pInCache) {
 
 	std::list<shared_ptr<Cluster>> *listClusters = new std::list<shared_ptr<Cluster>>();
 	std::list<shared_ptr<DataItem>> *listDataitems = new std::list<shared_ptr<DataItem>>();
@@ -514,38 +931,52 @@ std::map<std::string, std::list<shared_ptr<elfcloud::Object>>*> *Container::list
 	try {
 		ServerConnection *serverConn = client->getServerConnection();
 
-		// Create and perform list_contents request
+		// Create and perform list_contents request, objects are decoded straight from the response
 		Json::Value req = createRequestListContents();
-		Json::Value pInRespDict = serverConn->performServerJSONRequest(req);
-
-		// Valid result always contains these two dictionary member arrays, even when empty
-		if (!pInRespDict.isMember("clusters")) throw Exception();
-		if (!pInRespDict.isMember("dataitems")) throw Exception();
-
-		Json::Value clusters = pInRespDict.get("clusters", Json::Value::null);
-
-		Json::Value::iterator iterClusters = clusters.begin();
-		while (iterClusters != clusters.end()) {
-			shared_ptr<Cluster> cluster(new Cluster(client));
-			Json::Value aCluster = *iterClusters;
-			std::dynamic_pointer_cast<Container>(cluster)->initWithDictionary(aCluster);
-            cluster=std::dynamic_pointer_cast<Cluster>(client->setCacheContainer(cluster));
-			listClusters->push_back(cluster);
-			iterClusters++;
-		}
-
-		Json::Value dataitems = pInRespDict.get("dataitems", Json::Value::null);
-
-		Json::Value::iterator iterDataitems = dataitems.begin();
-		while (iterDataitems != dataitems.end()) {
-			shared_ptr<DataItem> dataitem(new DataItem(client));
-			Json::Value aDataitem = *iterDataitems;
-			dataitem->initWithDictionaryDataItems(aDataitem);
-            // cast is not needed dataitem=std::dynamic_pointer_cast<DataItem>(client->setCacheDataItem(dataitem));
-            dataitem=client->setCacheDataItem(dataitem);
-			listDataitems->push_back(dataitem);
-			iterDataitems++;
-		}
+		serverConn->performServerJSONRequestStreaming(req, [&](JsonStreamReader& pInReader) {
+			// Valid result always contains these two dictionary member arrays, even when empty
+			bool clustersFound=false, dataitemsFound=false;
+
+			string key;
+			pInReader.beginObject();
+			while (pInReader.nextMember(key)) {
+				if (!key.compare("clusters")) {
+					clustersFound=true;
+					if (pInReader.isNull()) {
+						pInReader.skipValue();
+						continue;
+					}
+					pInReader.beginArray();
+					while (pInReader.nextElement()) {
+						shared_ptr<Cluster> cluster(new Cluster(client));
+						std::dynamic_pointer_cast<Container>(cluster)->initWithReader(pInReader);
+						if (pInCache) {
+							cluster=std::dynamic_pointer_cast<Cluster>(client->setCacheContainer(cluster));
+						}
+						listClusters->push_back(cluster);
+					}
+				} else if (!key.compare("dataitems")) {
+					dataitemsFound=true;
+					if (pInReader.isNull()) {
+						pInReader.skipValue();
+						continue;
+					}
+					pInReader.beginArray();
+					while (pInReader.nextElement()) {
+						shared_ptr<DataItem> dataitem(new DataItem(client));
+						dataitem->initWithReader(pInReader);
+						if (pInCache) {
+							dataitem=client->setCacheDataItem(dataitem);
+						}
+						listDataitems->push_back(dataitem);
+					}
+				} else {
+					pInReader.skipValue();
+				}
+			}
+
+			if (!clustersFound || !dataitemsFound) throw Exception();
+		});
 
 	}
 	catch (Exception &ex) {
@@ -562,25 +993,23 @@ std::list<std::shared_ptr<Cluster>>* Container::listClusters() {
     try {
         ServerConnection *serverConn=client->getServerConnection();
 
-        // Create list_vaults request
+        // Create list_clusters request
         Json::Value req = createRequestListClusters();
 
-        // Call server
-        Json::Value resp = serverConn->performServerJSONRequest(req);
-
-        // Process response array
-        Json::Value clusters = resp;
-
-        Json::Value::iterator iterClusters = clusters.begin();
-
-        while (iterClusters!=clusters.end()) {
-            shared_ptr<Cluster> cluster(new Cluster(client));
-            Json::Value aCluster = *iterClusters;
-            std::dynamic_pointer_cast<Container>(cluster)->initWithDictionary(aCluster);
-            cluster=std::dynamic_pointer_cast<Cluster>(client->setCacheContainer(cluster));
-            response->push_back(cluster);
-            iterClusters++;
-        }
+        // Call server, clusters are decoded straight from the response array
+        serverConn->performServerJSONRequestStreaming(req, [&](JsonStreamReader& pInReader) {
+            if (pInReader.isNull()) {
+                pInReader.skipValue();
+                return;
+            }
+            pInReader.beginArray();
+            while (pInReader.nextElement()) {
+                shared_ptr<Cluster> cluster(new Cluster(client));
+                std::dynamic_pointer_cast<Container>(cluster)->initWithReader(pInReader);
+                cluster=std::dynamic_pointer_cast<Cluster>(client->setCacheContainer(cluster));
+                response->push_back(cluster);
+            }
+        });
     } catch (Exception &ex) {
         throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Cluster listing failed");
     }
@@ -595,25 +1024,23 @@ std::list<shared_ptr<DataItem>>* Container::listDataItems() {
     try {
         ServerConnection *serverConn=client->getServerConnection();
 
-        // Create list_vaults request
+        // Create list_dataitems request
         Json::Value req = createRequestListDataItems();
 
-        // Call server
-        Json::Value resp = serverConn->performServerJSONRequest(req);
-
-        // Process response array
-        Json::Value dataItems = resp;
-
-        Json::Value::iterator iterDataItems = dataItems.begin();
-
-        while (iterDataItems!=dataItems.end()) {
-            shared_ptr<DataItem> dataItem(new DataItem(client));
-            Json::Value aDataItem = *iterDataItems;
-            dataItem->initWithDictionaryDataItems(aDataItem);
-            dataItem=std::dynamic_pointer_cast<DataItem>(client->setCacheDataItem(dataItem));
-            response->push_back(dataItem);
-            iterDataItems++;
-        }
+        // Call server, data items are decoded straight from the response array
+        serverConn->performServerJSONRequestStreaming(req, [&](JsonStreamReader& pInReader) {
+            if (pInReader.isNull()) {
+                pInReader.skipValue();
+                return;
+            }
+            pInReader.beginArray();
+            while (pInReader.nextElement()) {
+                shared_ptr<DataItem> dataItem(new DataItem(client));
+                dataItem->initWithReader(pInReader);
+                dataItem=client->setCacheDataItem(dataItem);
+                response->push_back(dataItem);
+            }
+        });
     } catch (Exception &ex) {
         throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Data item listing failed");
     }
@@ -713,68 +1140,124 @@ void Container::renameDataItem(shared_ptr<elfcloud::DataItem> pInDataItem, const
 }
 
 // static
+void Container::initWithReader(JsonStreamReader& pInReader) {
+	throw Exception(ECSCI_EXC_INIT_OR_PARAM_FAILURE, "Container type cannot be read from a response stream");
+}
+
 Json::Value Container::createRequestGetContainerById(const uint64_t pInContainerId) {
+	return createRequestGetContainerById(vector<uint64_t>(1, pInContainerId));
+}
+
+Json::Value Container::createRequestGetContainerById(const vector<uint64_t>& pInContainerIds) {
 
 	Json::Value request(Json::objectValue);
 	request["method"] = Json::Value("get_container_by_id");
 	request["params"] = Json::Value(Json::objectValue);
 
 	request["params"]["container_ids"] = Json::Value(Json::arrayValue);
-	request["params"]["container_ids"].append(Json::Value((Json::Value::UInt64) pInContainerId));
+	for (unsigned int i=0; i<pInContainerIds.size(); i++)
+		request["params"]["container_ids"].append(Json::Value((Json::Value::UInt64) pInContainerIds[i]));
 
 	return request;
 }
 
 // static
-DllExport shared_ptr<Container> Container::getContainerById(Client *pInClient,
-                                                            uint64_t pInContainerId) {
-
-    shared_ptr<Container> cached=pInClient->getCacheContainer(pInContainerId);
-
-    if (cached) {
-        if (cached->getContainerType().compare("vault")==0) {
-            return std::dynamic_pointer_cast<Vault>(cached);
-        } else if (cached->getContainerType().compare("cluster")==0) {
-            return std::dynamic_pointer_cast<Cluster>(cached);
-        }
-        throw Exception();
-    }
-
-	ServerConnection *serverConn = pInClient->getServerConnection();
-
-	Json::Value req = Container::createRequestGetContainerById(pInContainerId);
-	Json::Value resp = serverConn->performServerJSONRequest(req);
-
-	if (resp.size() != 1) {
-		// Queried with single ID, response array must contain only one dictionary
-		throw Exception();
-	}
+shared_ptr<Container> Container::createContainerFromDictionary(Client *pInClient, Json::Value& pInDict) {
 
-	Json::Value::iterator iter = resp.begin(); // iterate response main level array
-	Json::Value aItem = *iter;
-	if (!aItem.isObject()) {
+	if (!pInDict.isObject()) {
 		// Response seems invalid, dictionary objects expected in array
 		throw Exception();
 	}
 
-	if (!aItem.isMember("type")) throw Exception();
-	std::string cType = ((aItem.get("type", Json::Value::null).asString()));
+	if (!pInDict.isMember("type")) throw Exception();
+	std::string cType = ((pInDict.get("type", Json::Value::null).asString()));
 
 	if (!cType.compare("vault")) {
 		shared_ptr<Vault> v(new Vault(pInClient));
-		std::dynamic_pointer_cast<Container>(v)->initWithDictionary(aItem);
-        v=std::dynamic_pointer_cast<Vault>(pInClient->setCacheContainer(v));
-		return v;
+		std::dynamic_pointer_cast<Container>(v)->initWithDictionary(pInDict);
+		return pInClient->setCacheContainer(v);
 	}
 	else if (!cType.compare("cluster")) {
 		shared_ptr<Cluster> c(new Cluster(pInClient));
-		std::dynamic_pointer_cast<Container>(c)->initWithDictionary(aItem);
-        c=std::dynamic_pointer_cast<Cluster>(pInClient->setCacheContainer(c));
-		return c;
+		std::dynamic_pointer_cast<Container>(c)->initWithDictionary(pInDict);
+		return pInClient->setCacheContainer(c);
 	}
 
 	// Unrecognized container type, cannot parse
 	throw Exception();
 }
 
+// static
+DllExport shared_ptr<Container> Container::getContainerById(Client *pInClient,
+                                                            uint64_t pInContainerId) {
+
+    shared_ptr<Container> container=getContainersById(pInClient, vector<uint64_t>(1, pInContainerId))[0];
+
+    if (!container) {
+		// Queried with single ID, response array must contain it
+		throw Exception();
+    }
+
+    if (container->getContainerType().compare("vault")==0) {
+        return std::dynamic_pointer_cast<Vault>(container);
+    } else if (container->getContainerType().compare("cluster")==0) {
+        return std::dynamic_pointer_cast<Cluster>(container);
+    }
+    throw Exception();
+}
+
+// static
+DllExport vector<shared_ptr<Container>> Container::getContainersById(Client *pInClient,
+                                                                     const vector<uint64_t>& pInContainerIds) {
+
+    vector<shared_ptr<Container>> result(pInContainerIds.size());
+
+    // Serve what we can from the cache, collect the rest for server lookup
+    vector<uint64_t> missingIds;
+    std::map<uint64_t, vector<unsigned int>> missingPositions;
+    for (unsigned int i=0; i<pInContainerIds.size(); i++) {
+        result[i]=pInClient->getCacheContainer(pInContainerIds[i]);
+        if (!result[i]) {
+            if (!missingPositions.count(pInContainerIds[i]))
+                missingIds.push_back(pInContainerIds[i]);
+            missingPositions[pInContainerIds[i]].push_back(i);
+        }
+    }
+
+	ServerConnection *serverConn = pInClient->getServerConnection();
+
+    for (unsigned int batchStart=0; batchStart<missingIds.size(); batchStart+=getContainersByIdBatchSize) {
+        unsigned int batchEnd=batchStart+getContainersByIdBatchSize;
+        if (batchEnd>missingIds.size())
+            batchEnd=missingIds.size();
+
+        vector<uint64_t> batch(missingIds.begin()+batchStart, missingIds.begin()+batchEnd);
+
+        Json::Value req = Container::createRequestGetContainerById(batch);
+        Json::Value resp = serverConn->performServerJSONRequest(req);
+
+        if (!resp.isArray()) throw Exception();
+
+        for (Json::Value::iterator iter = resp.begin(); iter != resp.end(); iter++) {
+            Json::Value aItem = *iter;
+            shared_ptr<Container> container=createContainerFromDictionary(pInClient, aItem);
+
+            std::map<uint64_t, vector<unsigned int>>::iterator pos=missingPositions.find(container->getContainerId());
+            if (pos==missingPositions.end())
+                continue;
+
+            for (unsigned int i=0; i<(*pos).second.size(); i++)
+                result[(*pos).second[i]]=container;
+        }
+
+        if (Client::isLogged(5)) {
+            stringstream ss;
+            ss << "getContainersById(): resolved " << resp.size() << " of " << batch.size() << " containers in one request";
+            Client::log(ss.str(), 5);
+        }
+    }
+
+    return result;
+}
+
 }
@@ -26,6 +26,7 @@
 #define ELFCLOUD_CONTAINER_H_
 
 #include "Object.h"
+#include "Types.h"
 #include <stdint.h>
 
 #ifdef ELFCLOUD_LIB
@@ -35,6 +36,7 @@
 
 #include <list>
 #include <map>
+#include <vector>
 
 using namespace std;
 
@@ -42,8 +44,10 @@ namespace elfcloud {
 
 class Client;
 class DataItem;
+class DataItemFilePassthrough;
 class Cluster;
 class Key;
+class JsonStreamReader;
 
 class Container: public Object, public Cacheable {
 
@@ -52,6 +56,7 @@ private:
 	Json::Value createRequestAddCluster();
 	Json::Value createRequestListClusters();
 	Json::Value createRequestListDataItems();
+	Json::Value createRequestListDataItems(const std::string& pInName);
 	Json::Value createRequestAddCluster(Cluster* pInCluster);
 	Json::Value createRequestUpdateDataItem(DataItem& pInDataItem);
 	Json::Value createRequestRemoveDataItem(DataItem& pInDataItem);
@@ -59,10 +64,23 @@ private:
     Json::Value createRequestRenameDataItem(const DataItem& pInDataItem, const std::string& pInNewName);
     Json::Value createRequestRelocateDataItem(const DataItem& pInDataItem, const Container& pInNewContainer, const std::string pInNewName);
     static Json::Value createRequestGetContainerById(const uint64_t pInContainerId);
+    static Json::Value createRequestGetContainerById(const vector<uint64_t>& pInContainerIds);
+    static shared_ptr<Container> createContainerFromDictionary(Client *pInClient, Json::Value& pInDict);
 
     virtual void initWithDictionary(Json::Value&) = 0;
+    // Streaming counterpart of initWithDictionary(), implemented by container types that appear in listings
+    virtual void initWithReader(JsonStreamReader&);
     bool storeDataItemPassthrough(shared_ptr<elfcloud::DataItem> pInDataItem, const elfcloud::Key *pInContentKey);
     bool fetchDataItemPassthrough(shared_ptr<elfcloud::DataItem> pInDataItem);
+    bool fetchDataItemStriped(shared_ptr<DataItemFilePassthrough> pInDataItem,
+            const std::map<std::string, std::string>& pInRequestHeaders,
+            std::map<std::string, std::string>& pOutResponseHeaders);
+    bool isFetchResultOK(std::map<std::string, std::string>& pInResponseHeaders);
+    bool getStoredDataItemSize(const std::string& pInName, uint64_t& pOutSize);
+    shared_ptr<DataItem> findStoredDataItem(const std::string& pInName);
+    bool isCompressionEnabled();
+    int getCompressionLevel();
+    ECCipherMode getNewCipherMode(shared_ptr<elfcloud::DataItem> pInDataItem);
 #endif
 
 protected:
@@ -93,7 +111,9 @@ public:
 
     std::list<std::shared_ptr<Cluster>>* listClusters();
     std::list<std::shared_ptr<DataItem>>* listDataItems();
-	std::map<std::string, std::list<shared_ptr<elfcloud::Object>>*> *listContents();
+	// Listed objects go through the Client caches. Without pInCache they are returned as decoded and the
+	// caches are not touched, for listing on a thread of its own into objects nobody else holds yet.
+	std::map<std::string, std::list<shared_ptr<elfcloud::Object>>*> *listContents(bool pInCache=true);
 
     bool addClusterToServer(elfcloud::Cluster *pInCluster);
     bool addClusterToServer(shared_ptr<Cluster> pInCluster);
@@ -105,6 +125,12 @@ public:
     // Return from cache, get from server if not found.
 	DllExport static shared_ptr<Container> getContainerById(Client *pInClient, uint64_t pInContainerId);
 
+    // Same as getContainerById() for several containers. Containers missing from the cache are fetched
+    // with one get_container_by_id request per getContainersByIdBatchSize IDs. The result follows the order
+    // of pInContainerIds, IDs not returned by the server have a null pointer.
+	DllExport static vector<shared_ptr<Container>> getContainersById(Client *pInClient, const vector<uint64_t>& pInContainerIds);
+	static const unsigned int getContainersByIdBatchSize=100;
+
 	//bool storeDataItem(elfcloudDataItem& pInDataItem, ...StoreMode.., ..PatchOffset.., ...CryptMode...);
 };
 
@@ -32,6 +32,11 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <memory>
 #include "KeyImpl.h"
 
 #include "ext_cryptopp.h"
@@ -41,6 +46,121 @@ using namespace CryptoPP;
 
 namespace elfcloud {
 
+    std::atomic<unsigned int> CryptoHelper::decryptionThreads(0);
+
+    void CryptoHelper::setDecryptionThreads(const unsigned int pInThreads) {
+        decryptionThreads=pInThreads;
+    }
+
+    unsigned int CryptoHelper::getDecryptionThreads() {
+        unsigned int threads=decryptionThreads;
+        if (!threads)
+            threads=std::thread::hardware_concurrency();
+        return threads ? threads : 1;
+    }
+
+    // Runs the cipher over the data fusedBlockSize bytes at a time, each block of input is hashed right before
+    // and its output right after the cipher so that the data is read from memory once
+    static void processFused(CipherEngine &pInOutEngine, const byte *pInData, byte *pOutData, const size_t pInDataSize,
+            Weak::MD5 *pInOutInputHash, Weak::MD5 *pInOutOutputHash) {
+
+        for (size_t done=0; done<pInDataSize; ) {
+            size_t block=pInDataSize-done<CryptoHelper::fusedBlockSize ? pInDataSize-done : CryptoHelper::fusedBlockSize;
+            if (pInOutInputHash)
+                pInOutInputHash->Update(pInData+done, block);
+            pInOutEngine.process(pInData+done, pOutData+done, block);
+            if (pInOutOutputHash)
+                pInOutOutputHash->Update(pOutData+done, block);
+            done+=block;
+        }
+    }
+
+    static string finalHexDigest(Weak::MD5 &pInHash) {
+        byte digest[Weak::MD5::DIGESTSIZE];
+        pInHash.Final(digest);
+        return CryptoHelper::byteArrayToHexString(digest, Weak::MD5::DIGESTSIZE);
+    }
+
+    // Encrypts or decrypts data at the stream position given by pInIV and pInOffset (see CipherEngine::create()),
+    // in place when pInData and pOutData are the same. Large buffers are split into chunks that are processed on
+    // separate threads where the mode allows it: CFB8 decryption starts each chunk from the ciphertext before it
+    // and CTR seeks to the chunk in both directions. The hashes then take a pass of their own as MD5 cannot be split.
+    static bool processParallel(const PreparedCipher &pInPrepared, const ECCipherMode pInMode, const bool pInEncrypt,
+            const byte *pInIV, const uint64_t pInOffset, const byte *pInData, byte *pOutData, const size_t pInDataSize,
+            Weak::MD5 *pInOutInputHash=0, Weak::MD5 *pInOutOutputHash=0) {
+
+        size_t chunks=pInDataSize/CryptoHelper::parallelDecryptionMinChunkSize;
+        if (chunks>CryptoHelper::getDecryptionThreads())
+            chunks=CryptoHelper::getDecryptionThreads();
+        if (ECSCI_CIPHERMODE_CFB8==pInMode && pInEncrypt)
+            chunks=1;
+
+        if (chunks<2) {
+            try {
+                std::unique_ptr<CipherEngine> engine(CipherEngine::create(pInPrepared, pInMode, pInEncrypt, pInIV, pInOffset));
+                processFused(*engine, pInData, pOutData, pInDataSize, pInOutInputHash, pInOutOutputHash);
+                return true;
+            } catch (...) {
+                return false;
+            }
+        }
+
+        if (pInOutInputHash)
+            pInOutInputHash->Update(pInData, pInDataSize);
+
+        std::vector<size_t> begins(chunks+1);
+        for (size_t i=0; i<=chunks; i++)
+            begins[i]=pInDataSize*i/chunks;
+
+        // CFB8 chunk seeds are copied before any chunk is decrypted, the output may overwrite the input
+        const unsigned int registerSize=CryptoHelper::feedbackRegisterSize;
+        std::vector<byte> seeds;
+        if (ECSCI_CIPHERMODE_CFB8==pInMode) {
+            seeds.resize(chunks*registerSize);
+            memcpy(&seeds[0], pInIV, registerSize);
+            for (size_t i=1; i<chunks; i++)
+                memcpy(&seeds[i*registerSize], pInData+begins[i]-registerSize, registerSize);
+        }
+
+        std::vector<char> failed(chunks, 0);
+        auto processChunk=[&](const size_t i) {
+            try {
+                std::unique_ptr<CipherEngine> engine(seeds.empty()
+                        ? CipherEngine::create(pInPrepared, pInMode, pInEncrypt, pInIV, pInOffset+begins[i])
+                        : CipherEngine::create(pInPrepared, pInMode, pInEncrypt, &seeds[i*registerSize]));
+                engine->process(pInData+begins[i], pOutData+begins[i], begins[i+1]-begins[i]);
+            } catch (...) {
+                failed[i]=1;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t i=1; i<chunks; i++) {
+            try {
+                workers.push_back(std::thread(processChunk, i));
+            } catch (std::system_error&) {
+                // Out of threads, the chunk is done on this thread instead
+                processChunk(i);
+            }
+        }
+        processChunk(0);
+        for (size_t i=0; i<workers.size(); i++)
+            workers[i].join();
+
+        for (size_t i=0; i<chunks; i++)
+            if (failed[i])
+                return false;
+
+        if (pInOutOutputHash)
+            pInOutOutputHash->Update(pOutData, pInDataSize);
+        return true;
+    }
+
+    // Prepared cipher of the key, empty for keys that are not AES/CFB8 keys
+    static std::shared_ptr<const PreparedCipher> getPreparedCipher(const elfcloud::Key *pInKey) {
+        return ((const KeyImpl*) pInKey)->getPreparedCipher();
+    }
+
     CryptoHelper::CryptoHelper() {
         streamEncryption=0;
         streamDecryption=0;
@@ -49,20 +169,14 @@ namespace elfcloud {
     }
 
     CryptoHelper::~CryptoHelper() {
-        if (streamEncryption) {
-            delete ((CFB_Mode<AES>::Encryption*) streamEncryption);
-            streamEncryption=0;
-        }
-        if (streamDecryption) {
-            delete ((CFB_Mode<AES>::Decryption*) streamDecryption);
-            streamDecryption=0;
-        }
-        if (streamMD5HashEncrypted) {
-            delete streamMD5HashEncrypted;
-            streamMD5HashEncrypted=0;
-            delete streamMD5HashDecrypted;
-            streamMD5HashDecrypted=0;
-        }
+        delete streamEncryption;
+        streamEncryption=0;
+        delete streamDecryption;
+        streamDecryption=0;
+        delete streamMD5HashEncrypted;
+        streamMD5HashEncrypted=0;
+        delete streamMD5HashDecrypted;
+        streamMD5HashDecrypted=0;
     }
 
     // static
@@ -107,29 +221,61 @@ namespace elfcloud {
 
     // static
     enum ECEncryptionAlgorithm CryptoHelper::getEncryptionAlgorithm(const string &pInEncryptionAlgorithmName) {
-    	if (!pInEncryptionAlgorithmName.compare("AES128")) return elfcloud::ECSCI_ENCALG_AES128;
-    	if (!pInEncryptionAlgorithmName.compare("AES192")) return ECSCI_ENCALG_AES192;
-    	if (!pInEncryptionAlgorithmName.compare("AES256")) return ECSCI_ENCALG_AES256;
+    	// The cipher mode suffix of an ENC meta value does not change the algorithm
+    	string algorithm=pInEncryptionAlgorithmName.substr(0, pInEncryptionAlgorithmName.find('-'));
+    	if (!algorithm.compare("AES128")) return elfcloud::ECSCI_ENCALG_AES128;
+    	if (!algorithm.compare("AES192")) return ECSCI_ENCALG_AES192;
+    	if (!algorithm.compare("AES256")) return ECSCI_ENCALG_AES256;
     	throw new Exception(ECSCI_EXC_INIT_OR_PARAM_FAILURE, "Unknown encryption algorithm name given");
     }
 
+    // static
+    string CryptoHelper::getEncryptionName(enum ECEncryptionAlgorithm pInEncAlg, enum ECCipherMode pInMode) {
+    	string name=getEncryptionAlgorithmName(pInEncAlg);
+    	if (ECSCI_CIPHERMODE_CTR==pInMode)
+    		name.append("-CTR");
+    	return name;
+    }
+
+    // static
+    enum ECCipherMode CryptoHelper::getCipherMode(const string &pInEncryptionName) {
+    	size_t separator=pInEncryptionName.find('-');
+    	if (separator==string::npos) return ECSCI_CIPHERMODE_CFB8;
+    	if (!pInEncryptionName.compare(separator+1, string::npos, "CTR")) return ECSCI_CIPHERMODE_CTR;
+    	throw Exception(ECSCI_EXC_ENCRYPTION_ERROR, "Unknown cipher mode "+pInEncryptionName.substr(separator+1));
+    }
+
+    // static
+    void CryptoHelper::generateCipherIV(byte *pOutIV) {
+    	AutoSeededRandomPool rng;
+    	rng.GenerateBlock(pOutIV, CipherEngine::ivSize);
+    }
+
     SecByteBlock* CryptoHelper::copyByteBufferToSecByteBlock(const byte* pInData, const unsigned int pInDataLength) {
     	SecByteBlock *sBB = new SecByteBlock(pInDataLength);
     	memcpy(sBB->m_ptr, pInData, pInDataLength);
     	return sBB;
     }
 
-    bool CryptoHelper::encryptDataStreamBegin(const elfcloud::Key *pInKey) {
-        if (streamEncryption) {
-            delete ((CFB_Mode<AES>::Encryption*) streamEncryption);
-            streamEncryption=0;
-        }
+    bool CryptoHelper::beginStream(CipherEngine *&pOutEngine, streamPosition &pOutPosition, const bool pInEncrypt,
+            const elfcloud::Key *pInKey, const byte *pInFeedbackRegister, const ECCipherMode pInMode, const uint64_t pInOffset) {
+
+        delete pOutEngine;
+        pOutEngine=0;
 
         if (NULL!=pInKey) {
-            ECEncryptionAlgorithm alg=pInKey->getHint().getCipherType();
-            if ((ECSCI_ENCALG_AES128==alg || ECSCI_ENCALG_AES192==alg || ECSCI_ENCALG_AES256==alg) && pInKey->getCipherMode()=="CFB8") {
+            std::shared_ptr<const PreparedCipher> prepared=getPreparedCipher(pInKey);
+            if (prepared) {
+                // CTR content has no default, the initial counter block is given by the data item
+                if (ECSCI_CIPHERMODE_CTR==pInMode && !pInFeedbackRegister)
+                    return false;
                 try {
-                    streamEncryption=new CFB_Mode<AES>::Encryption(((KeyImpl*) pInKey)->getKeySecBlock().m_ptr, ((KeyImpl*) pInKey)->getKeySecBlock().size(), ((KeyImpl*) pInKey)->getIVSecBlock().m_ptr, 1);
+                    const byte *iv=pInFeedbackRegister ? pInFeedbackRegister : prepared->iv.m_ptr;
+                    pOutEngine=CipherEngine::create(*prepared, pInMode, pInEncrypt, iv, pInOffset);
+                    pOutPosition.cipher=prepared;
+                    pOutPosition.mode=pInMode;
+                    memcpy(pOutPosition.iv, iv, CipherEngine::ivSize);
+                    pOutPosition.offset=pInOffset;
                     return true;
                 } catch (...) {
                 }
@@ -140,26 +286,76 @@ namespace elfcloud {
         return false;
     }
 
-    bool CryptoHelper::encryptDataStreamContinue(const byte *pInData, byte *pOutData, const unsigned int pInDataSize) {
+    bool CryptoHelper::continueStream(CipherEngine *&pInOutEngine, streamPosition &pInOutPosition, const bool pInEncrypt,
+            const byte *pInData, byte *pOutData, const unsigned int pInDataSize, Weak::MD5 *pInOutInputHash, Weak::MD5 *pInOutOutputHash) {
+
         try {
-            ((CFB_Mode<AES>::Encryption*) streamEncryption)->ProcessData(pOutData, pInData, pInDataSize); 
+            const bool cfb8=ECSCI_CIPHERMODE_CFB8==pInOutPosition.mode;
+
+            // CFB8 decryption position after this chunk, taken before an in-place decryption overwrites the ciphertext
+            byte nextRegister[feedbackRegisterSize];
+            if (cfb8 && !pInEncrypt) {
+                memcpy(nextRegister, pInOutPosition.iv, feedbackRegisterSize);
+                updateFeedbackRegister(nextRegister, pInData, pInDataSize);
+            }
+
+            if ((!cfb8 || !pInEncrypt) && pInDataSize>=2*parallelDecryptionMinChunkSize && getDecryptionThreads()>1) {
+                if (!processParallel(*pInOutPosition.cipher, pInOutPosition.mode, pInEncrypt, pInOutPosition.iv, cfb8 ? 0 : pInOutPosition.offset,
+                        pInData, pOutData, pInDataSize, pInOutInputHash, pInOutOutputHash))
+                    return false;
+                // The sequential engine continues from the new position
+                delete pInOutEngine;
+                pInOutEngine=0;
+                pInOutEngine=CipherEngine::create(*pInOutPosition.cipher, pInOutPosition.mode, pInEncrypt,
+                        cfb8 ? nextRegister : pInOutPosition.iv, cfb8 ? 0 : pInOutPosition.offset+pInDataSize);
+            } else {
+                processFused(*pInOutEngine, pInData, pOutData, pInDataSize, pInOutInputHash, pInOutOutputHash);
+            }
+
+            if (cfb8 && !pInEncrypt)
+                memcpy(pInOutPosition.iv, nextRegister, feedbackRegisterSize);
+            pInOutPosition.offset+=pInDataSize;
             return true;
         } catch (...) {
             return false;
         }
     }
 
-    bool CryptoHelper::encryptData(const elfcloud::Key *pInKey, const byte *pInData, byte *pOutData, const unsigned int pInDataSize)
+    bool CryptoHelper::encryptDataStreamBegin(const elfcloud::Key *pInKey, const byte *pInFeedbackRegister,
+            const ECCipherMode pInMode, const uint64_t pInOffset) {
+        return beginStream(streamEncryption, streamEncryptionPosition, true, pInKey, pInFeedbackRegister, pInMode, pInOffset);
+    }
+
+    bool CryptoHelper::encryptDataStreamContinue(const byte *pInData, byte *pOutData, const unsigned int pInDataSize, std::string *pOutCiphertextHash) {
+        if (!streamEncryption)
+            return false;
+
+        Weak::MD5 ciphertextHash;
+        if (!continueStream(streamEncryption, streamEncryptionPosition, true, pInData, pOutData, pInDataSize,
+                0, pOutCiphertextHash ? &ciphertextHash : 0))
+            return false;
+        if (pOutCiphertextHash)
+            pOutCiphertextHash->assign(finalHexDigest(ciphertextHash));
+        return true;
+    }
+
+    bool CryptoHelper::encryptData(const elfcloud::Key *pInKey, const byte *pInData, byte *pOutData, const unsigned int pInDataSize,
+            std::string *pOutPlaintextHash, std::string *pOutCiphertextHash, const ECCipherMode pInMode, const byte *pInIV)
     {
         if (NULL!=pInKey) {
-            ECEncryptionAlgorithm alg=pInKey->getHint().getCipherType();
-            if ((ECSCI_ENCALG_AES128==alg || ECSCI_ENCALG_AES192==alg || ECSCI_ENCALG_AES256==alg) && pInKey->getCipherMode()=="CFB8") {
-                try {
-                    CFB_Mode<AES>::Encryption cfbEncryption(((KeyImpl*) pInKey)->getKeySecBlock().m_ptr, ((KeyImpl*) pInKey)->getKeySecBlock().size(), ((KeyImpl*) pInKey)->getIVSecBlock().m_ptr, 1);
-                    cfbEncryption.ProcessData(pOutData, pInData, pInDataSize);
-                    return true;
-                } catch (...) {
-                }
+            std::shared_ptr<const PreparedCipher> prepared=getPreparedCipher(pInKey);
+            if (prepared) {
+                if (ECSCI_CIPHERMODE_CTR==pInMode && !pInIV)
+                    return false;
+                Weak::MD5 plaintextHash, ciphertextHash;
+                if (!processParallel(*prepared, pInMode, true, ECSCI_CIPHERMODE_CTR==pInMode ? pInIV : prepared->iv.m_ptr, 0,
+                        pInData, pOutData, pInDataSize, pOutPlaintextHash ? &plaintextHash : 0, pOutCiphertextHash ? &ciphertextHash : 0))
+                    return false;
+                if (pOutPlaintextHash)
+                    pOutPlaintextHash->assign(finalHexDigest(plaintextHash));
+                if (pOutCiphertextHash)
+                    pOutCiphertextHash->assign(finalHexDigest(ciphertextHash));
+                return true;
             } else {
                 throw Exception(ECSCI_EXC_ENCRYPTION_ERROR, "Unknown cipher type or mode");
             }
@@ -173,46 +369,148 @@ namespace elfcloud {
         return encryptData(pInKey, pInOutData, pInOutData, pInOutDataSize);
     }
 
-    bool CryptoHelper::decryptDataStreamBegin(const elfcloud::Key *pInKey) {
-        if (streamDecryption) {
-            delete ((CFB_Mode<AES>::Decryption*) streamDecryption);
-            streamDecryption=0;
+    // CFB8 encryption of up to batchLanes items, sorted by size from the largest down so that finished lanes
+    // drop off the end. Each step encrypts the feedback registers of the running lanes with one block cipher call
+    // and shifts the new ciphertext byte of each lane into its register.
+    static void encryptCFB8Lanes(AES::Encryption &pInOutCipher, const byte *pInIV, const CryptoHelper::BatchItem **pInItems,
+            const size_t pInLanes) {
+
+        const unsigned int blockSize=CipherEngine::ivSize;
+        byte registers[CryptoHelper::batchLanes*CipherEngine::ivSize];
+        byte keystream[CryptoHelper::batchLanes*CipherEngine::ivSize];
+
+        for (size_t lane=0; lane<pInLanes; lane++)
+            memcpy(registers+lane*blockSize, pInIV, blockSize);
+
+        size_t lanes=pInLanes;
+        for (size_t pos=0; ; pos++) {
+            while (lanes>0 && pInItems[lanes-1]->dataSize<=pos)
+                lanes--;
+            if (!lanes)
+                break;
+
+            pInOutCipher.AdvancedProcessBlocks(registers, NULL, keystream, lanes*blockSize, BlockTransformation::BT_AllowParallel);
+
+            for (size_t lane=0; lane<lanes; lane++) {
+                byte *reg=registers+lane*blockSize;
+                byte c=pInItems[lane]->data[pos]^keystream[lane*blockSize];
+                pInItems[lane]->outData[pos]=c;
+                memmove(reg, reg+1, blockSize-1);
+                reg[blockSize-1]=c;
+            }
         }
+    }
 
-        if (streamMD5HashEncrypted) {
-            delete streamMD5HashEncrypted;
-            delete streamMD5HashDecrypted;
-            streamMD5HashEncrypted=0;
-            streamMD5HashDecrypted=0;
+    bool CryptoHelper::encryptDataBatch(const elfcloud::Key *pInKey, const BatchItem *pInItems, const size_t pInItemCount,
+            const ECCipherMode pInMode)
+    {
+        if (NULL==pInKey)
+            return false;
+
+        std::shared_ptr<const PreparedCipher> prepared=getPreparedCipher(pInKey);
+        if (!prepared)
+            throw Exception(ECSCI_EXC_ENCRYPTION_ERROR, "Unknown cipher type or mode");
+        if (!pInItemCount)
+            return true;
+
+        // Items of similar size share a lane group so that lanes do not idle while the longest one finishes
+        std::vector<const BatchItem*> items(pInItemCount);
+        size_t totalSize=0;
+        for (size_t i=0; i<pInItemCount; i++) {
+            items[i]=&pInItems[i];
+            totalSize+=pInItems[i].dataSize;
         }
+        std::stable_sort(items.begin(), items.end(), [](const BatchItem *a, const BatchItem *b) {
+            return a->dataSize>b->dataSize;
+        });
 
-        streamMD5HashEncrypted=new Weak::MD5();
-        streamMD5HashDecrypted=new Weak::MD5();
+        const size_t groups=(pInItemCount+batchLanes-1)/batchLanes;
+        std::atomic<size_t> nextGroup(0);
+        std::atomic<bool> failed(false);
+
+        auto processGroups=[&]() {
+            AES::Encryption cipher(prepared->cipher);
+            Weak::MD5 hash;
+
+            for (size_t group=nextGroup++; group<groups; group=nextGroup++) {
+                const BatchItem **lane=&items[group*batchLanes];
+                const size_t lanes=std::min((size_t) batchLanes, pInItemCount-group*batchLanes);
 
-        if (NULL!=pInKey) {
-            ECEncryptionAlgorithm alg=pInKey->getHint().getCipherType();
-            if ((ECSCI_ENCALG_AES128==alg || ECSCI_ENCALG_AES192==alg || ECSCI_ENCALG_AES256==alg) && pInKey->getCipherMode()=="CFB8") {
                 try {
-                    streamDecryption=new CFB_Mode<AES>::Decryption(((KeyImpl*) pInKey)->getKeySecBlock().m_ptr, ((KeyImpl*) pInKey)->getKeySecBlock().size(), ((KeyImpl*) pInKey)->getIVSecBlock().m_ptr, 1);
-                    return true;
+                    for (size_t i=0; i<lanes; i++) {
+                        if (lane[i]->plaintextHash) {
+                            hash.Update(lane[i]->data, lane[i]->dataSize);
+                            lane[i]->plaintextHash->assign(finalHexDigest(hash));
+                        }
+                    }
+
+                    if (ECSCI_CIPHERMODE_CFB8==pInMode) {
+                        encryptCFB8Lanes(cipher, prepared->iv.m_ptr, lane, lanes);
+                    } else {
+                        // CTR keystream is already computed several blocks at a time within an item
+                        for (size_t i=0; i<lanes; i++) {
+                            if (!lane[i]->iv) {
+                                failed=true;
+                                continue;
+                            }
+                            std::unique_ptr<CipherEngine> engine(CipherEngine::create(*prepared, pInMode, true, lane[i]->iv));
+                            engine->process(lane[i]->data, lane[i]->outData, lane[i]->dataSize);
+                        }
+                    }
+
+                    for (size_t i=0; i<lanes; i++) {
+                        if (lane[i]->ciphertextHash) {
+                            hash.Update(lane[i]->outData, lane[i]->dataSize);
+                            lane[i]->ciphertextHash->assign(finalHexDigest(hash));
+                        }
+                    }
                 } catch (...) {
+                    failed=true;
                 }
-            } else {
-                throw Exception(ECSCI_EXC_ENCRYPTION_ERROR, "Unknown cipher type or mode");
+            }
+        };
+
+        // Threads only pay off once there is a parallel decryption chunk worth of data for each
+        size_t threads=std::min((size_t) getDecryptionThreads(), groups);
+        threads=std::min(threads, totalSize/parallelDecryptionMinChunkSize+1);
+
+        std::vector<std::thread> workers;
+        for (size_t i=1; i<threads; i++) {
+            try {
+                workers.push_back(std::thread(processGroups));
+            } catch (std::system_error&) {
+                // Out of threads, the running ones take the remaining groups
+                break;
             }
         }
-        return false;
+        processGroups();
+        for (size_t i=0; i<workers.size(); i++)
+            workers[i].join();
+
+        return !failed;
+    }
+
+    bool CryptoHelper::decryptDataStreamBegin(const elfcloud::Key *pInKey, const byte *pInFeedbackRegister, const unsigned int pInStreamHashes,
+            const ECCipherMode pInMode, const uint64_t pInOffset) {
+        delete streamMD5HashEncrypted;
+        delete streamMD5HashDecrypted;
+        streamMD5HashEncrypted=0;
+        streamMD5HashDecrypted=0;
+
+        if (pInStreamHashes & streamHashEncrypted)
+            streamMD5HashEncrypted=new Weak::MD5();
+        if (pInStreamHashes & streamHashDecrypted)
+            streamMD5HashDecrypted=new Weak::MD5();
+
+        return beginStream(streamDecryption, streamDecryptionPosition, false, pInKey, pInFeedbackRegister, pInMode, pInOffset);
     }
 
     bool CryptoHelper::decryptDataStreamContinue(const byte *pInData, byte *pOutData, const unsigned int pInDataSize) {
-        try {
-            streamMD5HashEncrypted->Update(pInData, pInDataSize);
-            ((CFB_Mode<AES>::Decryption*) streamDecryption)->ProcessData(pOutData, pInData, pInDataSize); 
-            streamMD5HashDecrypted->Update(pOutData, pInDataSize);
-            return true;
-        } catch (...) {
+        if (!streamDecryption)
             return false;
-        }
+
+        return continueStream(streamDecryption, streamDecryptionPosition, false, pInData, pOutData, pInDataSize,
+                streamMD5HashEncrypted, streamMD5HashDecrypted);
     }
 
     std::string CryptoHelper::getHashEncryptedDataStream() {
@@ -235,16 +533,22 @@ namespace elfcloud {
         return byteArrayToHexString(digest, Weak::MD5::DIGESTSIZE);
     }
 
-    bool CryptoHelper::decryptData(const Key *pInKey, const byte *pInData, byte *pOutData, const unsigned int pInDataSize) {
+    bool CryptoHelper::decryptData(const Key *pInKey, const byte *pInData, byte *pOutData, const unsigned int pInDataSize,
+            std::string *pOutCiphertextHash, std::string *pOutPlaintextHash, const ECCipherMode pInMode, const byte *pInIV) {
         if (NULL!=pInKey) {
-            ECEncryptionAlgorithm alg=pInKey->getHint().getCipherType();
-            if ((ECSCI_ENCALG_AES128==alg || ECSCI_ENCALG_AES192==alg || ECSCI_ENCALG_AES256==alg) && pInKey->getCipherMode()=="CFB8") {
-            	try {
-            		CFB_Mode<AES>::Decryption cfbDecryption(((KeyImpl*) pInKey)->getKeySecBlock().m_ptr, ((KeyImpl*) pInKey)->getKeySecBlock().size(), ((KeyImpl*) pInKey)->getIVSecBlock().m_ptr, 1);
-            		cfbDecryption.ProcessData(pOutData, pInData, pInDataSize);
-            		return true;
-            	} catch (...) {
-            	}
+            std::shared_ptr<const PreparedCipher> prepared=getPreparedCipher(pInKey);
+            if (prepared) {
+                if (ECSCI_CIPHERMODE_CTR==pInMode && !pInIV)
+                    return false;
+                Weak::MD5 ciphertextHash, plaintextHash;
+                if (!processParallel(*prepared, pInMode, false, ECSCI_CIPHERMODE_CTR==pInMode ? pInIV : prepared->iv.m_ptr, 0,
+                        pInData, pOutData, pInDataSize, pOutCiphertextHash ? &ciphertextHash : 0, pOutPlaintextHash ? &plaintextHash : 0))
+                    return false;
+                if (pOutCiphertextHash)
+                    pOutCiphertextHash->assign(finalHexDigest(ciphertextHash));
+                if (pOutPlaintextHash)
+                    pOutPlaintextHash->assign(finalHexDigest(plaintextHash));
+                return true;
             } else {
                 throw Exception(ECSCI_EXC_ENCRYPTION_ERROR, "Unknown cipher type or mode");
             }
@@ -253,8 +557,25 @@ namespace elfcloud {
         return false;
     }
 
-    bool CryptoHelper::decryptDataInPlace(const Key *pInKey, byte *pInOutData, const unsigned int pInOutDataSize) {
-        return decryptData(pInKey, pInOutData, pInOutData, pInOutDataSize);
+    bool CryptoHelper::decryptDataInPlace(const Key *pInKey, byte *pInOutData, const unsigned int pInOutDataSize,
+            std::string *pOutCiphertextHash, std::string *pOutPlaintextHash, const ECCipherMode pInMode, const byte *pInIV) {
+        return decryptData(pInKey, pInOutData, pInOutData, pInOutDataSize, pOutCiphertextHash, pOutPlaintextHash, pInMode, pInIV);
+    }
+
+    void CryptoHelper::getInitialFeedbackRegister(const elfcloud::Key *pInKey, byte *pOutRegister) {
+        SecByteBlock iv=((KeyImpl*) pInKey)->getIVSecBlock();
+        if (iv.size()!=feedbackRegisterSize)
+            throw Exception(ECSCI_EXC_ENCRYPTION_ERROR, "Unexpected IV length for CFB8 stream");
+        memcpy(pOutRegister, iv.m_ptr, feedbackRegisterSize);
+    }
+
+    void CryptoHelper::updateFeedbackRegister(byte *pInOutRegister, const byte *pInCiphertext, const unsigned int pInLength) {
+        if (pInLength>=feedbackRegisterSize) {
+            memcpy(pInOutRegister, pInCiphertext+pInLength-feedbackRegisterSize, feedbackRegisterSize);
+        } else {
+            memmove(pInOutRegister, pInOutRegister+pInLength, feedbackRegisterSize-pInLength);
+            memcpy(pInOutRegister+feedbackRegisterSize-pInLength, pInCiphertext, pInLength);
+        }
     }
 
     bool CryptoHelper::getHashMD5AsByteArray(byte *pInData, unsigned int pInDataSize, byte *pOutHash) {
@@ -26,8 +26,12 @@
 #define ELFCLOUD_CRYPTOHELPER_H_
 
 #include "Object.h"
+#include "CipherEngine.h"
 
 #include <string>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
 
 //#ifdef ELFCLOUD_LIB
 #include "ext_cryptopp.h"
@@ -41,8 +45,8 @@ class Key;
 
 class CryptoHelper: public elfcloud::Object {
 private:
-    void *streamEncryption;
-    void *streamDecryption;
+    CipherEngine *streamEncryption;
+    CipherEngine *streamDecryption;
     CryptoPP::Weak::MD5 *streamMD5HashEncrypted;
     CryptoPP::Weak::MD5 *streamMD5HashDecrypted;
 
@@ -56,24 +60,94 @@ public:
     static std::string getEncryptionAlgorithmName(elfcloud::ECEncryptionAlgorithm pInEncMode);
     static enum ECEncryptionAlgorithm getEncryptionAlgorithm(const std::string &pInEncryptionModeName);
 
+    // The ENC meta value names the algorithm and the cipher mode of the content: "AES256" is CFB8 content,
+    // "AES256-CTR" CTR content. Only new data items are written in CTR mode (data.cipher.mode).
+    static std::string getEncryptionName(elfcloud::ECEncryptionAlgorithm pInEncAlg, elfcloud::ECCipherMode pInMode);
+    static enum ECCipherMode getCipherMode(const std::string &pInEncryptionName);
+    // Random initial counter block (CipherEngine::ivSize bytes) for a new CTR data item
+    static void generateCipherIV(byte *pOutIV);
+
+    // The optional hash arguments receive MD5 hex digests of the plaintext and ciphertext, computed in the same
+    // pass as the cipher fusedBlockSize bytes at a time while each block is in cache. 0 skips the hash.
+    static const unsigned int fusedBlockSize=64*1024;
+
+    // CFB8 content starts from the key IV, CTR content from the initial counter block of the data item given in pInIV
+
     // ENCRYPT
 
-    static bool encryptData(const elfcloud::Key *pInKey, const byte *pInData, byte *pOutData, const unsigned int pInDataSize);
+    static bool encryptData(const elfcloud::Key *pInKey, const byte *pInData, byte *pOutData, const unsigned int pInDataSize,
+            std::string *pOutPlaintextHash=0, std::string *pOutCiphertextHash=0,
+            const elfcloud::ECCipherMode pInMode=ECSCI_CIPHERMODE_CFB8, const byte *pInIV=0);
     static bool encryptDataInPlace(const elfcloud::Key *pInKey, byte *pInOutData, const unsigned int pInOutDataSize);
 
-    bool encryptDataStreamBegin(const elfcloud::Key *pInKey);
-    bool encryptDataStreamContinue(const byte *pInData, byte *pOutData, const unsigned int pInDataSize);
+    // When pInFeedbackRegister is given the stream continues from an earlier position instead of the start,
+    // the register holds the CFB8 state at that position (see updateFeedbackRegister()). CTR streams take the
+    // initial counter block of the data item in pInFeedbackRegister and start at pInOffset.
+    bool encryptDataStreamBegin(const elfcloud::Key *pInKey, const byte *pInFeedbackRegister=0,
+            const elfcloud::ECCipherMode pInMode=ECSCI_CIPHERMODE_CFB8, const uint64_t pInOffset=0);
+    // pOutCiphertextHash receives the hash of this chunk's ciphertext
+    bool encryptDataStreamContinue(const byte *pInData, byte *pOutData, const unsigned int pInDataSize, std::string *pOutCiphertextHash=0);
 
     // DECRYPT
 
-    static bool decryptData(const elfcloud::Key *pInKey, const byte *pInData, byte *pOutData, const unsigned int pInDataSize);
-    static bool decryptDataInPlace(const elfcloud::Key *pInKey, byte *pInOutData, const unsigned int pInOutDataSize);
-
-    bool decryptDataStreamBegin(const elfcloud::Key *pInKey);
+    static bool decryptData(const elfcloud::Key *pInKey, const byte *pInData, byte *pOutData, const unsigned int pInDataSize,
+            std::string *pOutCiphertextHash=0, std::string *pOutPlaintextHash=0,
+            const elfcloud::ECCipherMode pInMode=ECSCI_CIPHERMODE_CFB8, const byte *pInIV=0);
+    static bool decryptDataInPlace(const elfcloud::Key *pInKey, byte *pInOutData, const unsigned int pInOutDataSize,
+            std::string *pOutCiphertextHash=0, std::string *pOutPlaintextHash=0,
+            const elfcloud::ECCipherMode pInMode=ECSCI_CIPHERMODE_CFB8, const byte *pInIV=0);
+
+    // Stream hashes returned by getHashEncryptedDataStream() and getHashDecryptedDataStream(), only the
+    // ones selected with pInStreamHashes are calculated
+    static const unsigned int streamHashEncrypted=1;
+    static const unsigned int streamHashDecrypted=2;
+
+    bool decryptDataStreamBegin(const elfcloud::Key *pInKey, const byte *pInFeedbackRegister=0,
+            const unsigned int pInStreamHashes=streamHashEncrypted|streamHashDecrypted,
+            const elfcloud::ECCipherMode pInMode=ECSCI_CIPHERMODE_CFB8, const uint64_t pInOffset=0);
     bool decryptDataStreamContinue(const byte *pInData, byte *pOutData, const unsigned int pInDataSize);
+    bool hasDecryptionStream() const { return streamDecryption!=0; }
     std::string getHashEncryptedDataStream();
     std::string getHashDecryptedDataStream();
 
+    // PARALLEL DECRYPTION
+    // CFB8 decryption of a byte depends only on the 16 ciphertext bytes before it, so decryptData() and
+    // decryptDataStreamContinue() split buffers of at least two parallelDecryptionMinChunkSize chunks over
+    // several threads, each chunk seeded from the ciphertext preceding it. CTR content is split the same way
+    // on encryption as well, each chunk seeking to its offset. 0 threads uses one per core.
+
+    static const unsigned int parallelDecryptionMinChunkSize=256*1024;
+    static void setDecryptionThreads(const unsigned int pInThreads);
+    static unsigned int getDecryptionThreads();
+
+    // BATCH ENCRYPTION
+    // Encrypts many small independent items with one key, e.g. the data items of a bulk upload. A CFB8 item
+    // takes one block cipher call per byte, so batchLanes items of similar size are run side by side and the
+    // feedback registers of all lanes are encrypted with one call, which AES-NI pipelines as independent blocks.
+    // Lane groups are spread over the decryption threads. Crypto++ has no multi-buffer MD5, each item is hashed
+    // on the thread of its lane group before and after the cipher. Returns false if any item failed.
+
+    struct BatchItem {
+        const byte *data;
+        byte *outData;                  // may be data
+        unsigned int dataSize;
+        const byte *iv;                 // CTR initial counter block of the item, unused for CFB8
+        std::string *plaintextHash;     // optional MD5 hex digests as in encryptData()
+        std::string *ciphertextHash;
+    };
+
+    static const unsigned int batchLanes=8;
+    static bool encryptDataBatch(const elfcloud::Key *pInKey, const BatchItem *pInItems, const size_t pInItemCount,
+            const elfcloud::ECCipherMode pInMode=ECSCI_CIPHERMODE_CFB8);
+
+    // CFB8 STREAM POSITION
+    // The CFB8 state at any position of a stream is the last 16 ciphertext bytes before it (the key IV
+    // shifted out by the first bytes). The register is started from the key IV and fed with the ciphertext.
+
+    static const unsigned int feedbackRegisterSize=16;
+    static void getInitialFeedbackRegister(const elfcloud::Key *pInKey, byte *pOutRegister);
+    static void updateFeedbackRegister(byte *pInOutRegister, const byte *pInCiphertext, const unsigned int pInLength);
+
     // HASH
 
     static bool getHashMD5AsByteArray(byte *pInData, unsigned int pInDataSize, byte *pOutHash);
@@ -90,6 +164,27 @@ public:
     static CryptoPP::SecByteBlock* copyByteBufferToSecByteBlock(const byte* pInData, const unsigned int pInDataLength);
     static CryptoPP::SecByteBlock *readFile(std::string pInFilename, const unsigned int extraBuffer=0);
     static void writeFile(std::string pInFilename, CryptoPP::SecByteBlock *pInData);
+
+private:
+    // Cipher and current position of a stream, for processing stream chunks in parallel. iv is the CFB8 feedback
+    // register at the position or the CTR initial counter block.
+    struct streamPosition {
+        std::shared_ptr<const PreparedCipher> cipher;
+        ECCipherMode mode;
+        byte iv[CipherEngine::ivSize];
+        uint64_t offset;
+    };
+
+    streamPosition streamEncryptionPosition;
+    streamPosition streamDecryptionPosition;
+
+    static bool beginStream(CipherEngine *&pOutEngine, streamPosition &pOutPosition, const bool pInEncrypt,
+            const elfcloud::Key *pInKey, const byte *pInFeedbackRegister, const ECCipherMode pInMode, const uint64_t pInOffset);
+    static bool continueStream(CipherEngine *&pInOutEngine, streamPosition &pInOutPosition, const bool pInEncrypt,
+            const byte *pInData, byte *pOutData, const unsigned int pInDataSize,
+            CryptoPP::Weak::MD5 *pInOutInputHash, CryptoPP::Weak::MD5 *pInOutOutputHash);
+
+    static std::atomic<unsigned int> decryptionThreads;
 };
 
 }
@@ -24,6 +24,7 @@
 
 #include "DataItem.h"
 #include "CryptoHelper.h"
+#include "JsonStreamReader.h"
 
 #include <iostream>
 #include <fstream>
@@ -55,13 +56,19 @@ namespace elfcloud {
     }
 
     void DataItem::assign(std::shared_ptr<Object> pInObject) {
-        // Convert base class pointer to specific type shared_ptr and copy all values.
-        // assign() is used when updating existing cached object copy with new object data, through updates
-        // the other pointer holders can receive immediate updates (considering concurrency) without any need
-        // for updating their pointers or objects.
+        // Convert base class pointer to specific type shared_ptr and copy all values. The two objects share
+        // nothing owned afterwards, either one can be changed or destroyed without affecting the other.
         shared_ptr<DataItem> d=std::dynamic_pointer_cast<DataItem>(pInObject);
-        ownsBuffer=d->ownsBuffer;
-        dataPtr=d->dataPtr; // logic!
+        if (d.get()==this) {
+            return;
+        }
+
+        if (dataPtr && ownsBuffer) {
+            free(dataPtr);
+        }
+        // A buffer owned by d stays with d, a borrowed one can be shared
+        ownsBuffer=false;
+        dataPtr=d->ownsBuffer ? 0 : d->dataPtr;
         dataLength=d->dataLength;
         dataItemName=d->dataItemName;
         description.assign(d->description);
@@ -73,7 +80,13 @@ namespace elfcloud {
         lastModified.assign(d->lastModified);
         dataItemMD5.assign(d->dataItemMD5);
 
-        keyHint=d->keyHint; // check the logic here, if d is deleted, should we clone the hint
+        if (keyHint) {
+            delete keyHint;
+            keyHint=0;
+        }
+        if (d->keyHint) {
+            keyHint=new KeyHint(*d->keyHint);
+        }
 
         contentHash.assign(d->contentHash);
         metaHeaderKVPairs=d->metaHeaderKVPairs;
@@ -279,6 +292,51 @@ namespace elfcloud {
     	return;
     }
 
+    void DataItem::initWithReader(JsonStreamReader& pInReader) {
+
+    	if (!pInReader.isObject()) throw Exception();
+
+    	// Members may arrive in any order, values are collected first so that the name can be set before
+    	// the ID as in initWithDictionaryDataItems()
+    	uint64_t parent_id=0, dataitem_id=0, size=0;
+    	string name, modified_date, md5sum, last_accessed_date, meta;
+    	unsigned int found=0;
+
+    	string key;
+    	pInReader.beginObject();
+    	while (pInReader.nextMember(key)) {
+    		if (!key.compare("parent_id")) { parent_id=pInReader.readUInt64(); found|=0x01; }
+    		else if (!key.compare("name")) { name=pInReader.readString(); found|=0x02; }
+    		else if (!key.compare("dataitem_id")) { dataitem_id=pInReader.readUInt64(); found|=0x04; }
+    		else if (!key.compare("modified_date")) { modified_date=pInReader.readString(); found|=0x08; }
+    		else if (!key.compare("md5sum")) { md5sum=pInReader.readString(); found|=0x10; }
+    		else if (!key.compare("last_accessed_date")) { last_accessed_date=pInReader.readString(); found|=0x20; }
+    		else if (!key.compare("meta")) { meta=pInReader.readString(); found|=0x40; }
+    		else if (!key.compare("size")) { size=pInReader.readUInt64(); found|=0x80; }
+    		else pInReader.skipValue();
+    	}
+
+    	if (found!=0xFF) throw Exception();
+
+    	setParentId(parent_id);
+    	setDataItemName(name);
+    	setId(dataitem_id);
+    	setLastModified(modified_date);
+    	setMD5Sum(md5sum);
+    	setLastAccessed(last_accessed_date);
+
+    	try {
+    		parseMetaDataString(meta);
+    	} catch (Exception &ex) {
+            stringstream ss;
+            ss << "Discarding data item meta data, parsing failed for string " << meta << endl;
+            Client::log(ss.str(), 1);
+    		metaHeaderKVPairs.clear();
+    	}
+
+    	setDataLength(size);
+    }
+
     void DataItem::parseMetaDataString(string &pInMetaString, const bool pInStrict) {
         unsigned int metaBufSize=40960;
 
@@ -388,6 +446,18 @@ namespace elfcloud {
     			throw Exception();
     	}
 
+    	if (metaHeaderKVPairs.count("ENC")) {
+    		// Throws for an unknown cipher mode
+    		if (ECSCI_CIPHERMODE_CTR==CryptoHelper::getCipherMode((*metaHeaderKVPairs.find("ENC")).second)) {
+    			if (!metaHeaderKVPairs.count("CIV") || (*metaHeaderKVPairs.find("CIV")).second.size()!=2*CipherEngine::ivSize) {
+    				Client::log("CTR content without initial counter block in meta: "+pInMetaString, 1);
+    				throw Exception();
+    			}
+    		} else {
+    			metaHeaderKVPairs.erase("CIV");
+    		}
+    	}
+
     	if (metaHeaderKVPairs.count("ENC") && metaHeaderKVPairs.count("KHA")) {
             // v1 meta header always uses MD5 KeyHash (KHA)
             KeyHint tHint(ECSCI_HASHALG_MD5, (*metaHeaderKVPairs.find("KHA")).second, CryptoHelper::getEncryptionAlgorithm((*metaHeaderKVPairs.find("ENC")).second));
@@ -420,12 +490,59 @@ namespace elfcloud {
     	}
     }
 
+    uint64_t DataItem::getContentLength() {
+        std::map<std::string, std::string>::iterator it=metaHeaderKVPairs.find("CSZ");
+        if (!metaHeaderKVPairs.count("CMP") || it==metaHeaderKVPairs.end())
+            return getDataLength();
+        return strtoull((*it).second.c_str(), 0, 10);
+    }
+
+    string DataItem::getCompression() {
+        std::map<std::string, std::string>::iterator it=metaHeaderKVPairs.find("CMP");
+        return it==metaHeaderKVPairs.end() ? string() : (*it).second;
+    }
+
+    void DataItem::setCompression(const std::string& pInCompression, const uint64_t pInContentLength) {
+        if (pInCompression.empty()) {
+            metaHeaderKVPairs.erase("CMP");
+            metaHeaderKVPairs.erase("CSZ");
+            return;
+        }
+
+        stringstream ss;
+        ss << pInContentLength;
+        metaHeaderKVPairs["CMP"]=pInCompression;
+        metaHeaderKVPairs["CSZ"]=ss.str();
+    }
+
+    ECCipherMode DataItem::getCipherMode() {
+        return metaHeaderKVPairs.count("CIV") ? ECSCI_CIPHERMODE_CTR : ECSCI_CIPHERMODE_CFB8;
+    }
+
+    bool DataItem::getCipherIV(byte *pOutIV) {
+        std::map<std::string, std::string>::iterator it=metaHeaderKVPairs.find("CIV");
+        if (it==metaHeaderKVPairs.end() || (*it).second.size()!=2*CipherEngine::ivSize)
+            return false;
+
+        unsigned int ivLength=0;
+        CryptoHelper::HexStringToByteArray((*it).second, pOutIV, &ivLength);
+        return ivLength==CipherEngine::ivSize;
+    }
+
+    void DataItem::setCipherMode(const ECCipherMode pInMode, const byte *pInIV) {
+        if (ECSCI_CIPHERMODE_CTR!=pInMode || !pInIV) {
+            metaHeaderKVPairs.erase("CIV");
+            return;
+        }
+        metaHeaderKVPairs["CIV"]=CryptoHelper::byteArrayToHexString(pInIV, CipherEngine::ivSize);
+    }
+
     string DataItem::getMetaDatav1String() {
 
         string metaDataString;
     	metaDataString.append("v1:ENC:");
         if (keyHint) {
-            metaDataString.append(keyHint->getCipherTypeString());
+            metaDataString.append(CryptoHelper::getEncryptionName(keyHint->getCipherType(), getCipherMode()));
         } else {
             metaDataString.append("NONE");
         }
@@ -435,6 +552,12 @@ namespace elfcloud {
             metaDataString.append("KHA:");
             metaDataString.append(keyHint->getKeyHash());
             metaDataString.append(":");
+
+            if (metaHeaderKVPairs.count("CIV")) {
+                metaDataString.append("CIV:");
+                metaDataString.append(metaHeaderKVPairs["CIV"]);
+                metaDataString.append(":");
+            }
         }
 
     	if (getDescription().empty()) {
@@ -473,6 +596,14 @@ namespace elfcloud {
             metaDataString.append(":");
         }
 
+        if (metaHeaderKVPairs.count("CMP")) {
+            metaDataString.append("CMP:");
+            metaDataString.append(metaHeaderKVPairs["CMP"]);
+            metaDataString.append(":CSZ:");
+            metaDataString.append(metaHeaderKVPairs["CSZ"]);
+            metaDataString.append(":");
+        }
+
     	// Termination marker, results in two back to back colons = empty key.
     	metaDataString.append(":");
 
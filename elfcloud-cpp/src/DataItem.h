@@ -48,6 +48,7 @@ class KeyHint;
 class CryptoHelper;
 class Container;
 class Client;
+class JsonStreamReader;
 
 class DataItem: public Object, public Cacheable {
 
@@ -121,6 +122,20 @@ public:
 		return dataLength;
 	}
 
+    // Length of the content before compression, same as getDataLength() unless the item is compressed
+    uint64_t getContentLength();
+
+    // Compression of the stored content (CMP and CSZ meta keys), an empty name marks uncompressed content
+    std::string getCompression();
+    void setCompression(const std::string& pInCompression, const uint64_t pInContentLength);
+
+    // Cipher mode of the content. CTR content keeps its initial counter block in the CIV meta key (hex), the
+    // key is present only for CTR content. CFB8 content starts from the key IV.
+    elfcloud::ECCipherMode getCipherMode();
+    // CipherEngine::ivSize bytes, returns false for CFB8 content
+    bool getCipherIV(byte *pOutIV);
+    void setCipherMode(const elfcloud::ECCipherMode pInMode, const byte *pInIV=0);
+
     byte* getDataPtr() {
 		return dataPtr;
 	}
@@ -154,6 +169,8 @@ public:
     bool setDataFromFile(const std::string& pInFilePath);
 
 	void initWithDictionaryDataItems(Json::Value& pInClusterDict);
+	// Same as initWithDictionaryDataItems() but reads the data item object directly from a response stream
+	void initWithReader(JsonStreamReader& pInReader);
 
     void setLastModified(const std::string& pInLastModified) {
 		lastModified = pInLastModified;
@@ -206,13 +223,33 @@ class DataItemFilePassthrough: public DataItem {
 
 private:
 	std::string filePath;
+	// Stored size, md5 and compression as listed by the caller, see setListedContent()
+	bool listedKnown;
+	uint64_t listedSize;
+	std::string listedMD5;
+	bool listedCompressed;
 
 public:
-	DataItemFilePassthrough(Client *pInClient): DataItem(pInClient) {
+	DataItemFilePassthrough(Client *pInClient): DataItem(pInClient), listedKnown(false), listedSize(0), listedCompressed(false) {
 	}
 	std::string getFilePath() { return filePath; }
 	void setFilePath(const string pInFilePath) { filePath.assign(pInFilePath); }
 
+	// Content of the data item as it appeared in a listing the caller already has. A large fetch is split
+	// into ranges only when this is known, nothing is asked from the server to plan the ranges.
+	void setListedContent(const uint64_t pInSize, const std::string& pInMD5, const bool pInCompressed) {
+		listedKnown=true;
+		listedSize=pInSize;
+		listedMD5=pInMD5;
+		listedCompressed=pInCompressed;
+	}
+	bool getListedContent(uint64_t& pOutSize, std::string& pOutMD5, bool& pOutCompressed) {
+		pOutSize=listedSize;
+		pOutMD5=listedMD5;
+		pOutCompressed=listedCompressed;
+		return listedKnown;
+	}
+
 	virtual std::string dataMode() { return "passthrough"; }
 };
 
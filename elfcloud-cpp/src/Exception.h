@@ -45,6 +45,8 @@ typedef enum {
     ECSCI_EXC_MEMORY_ALLOCATION_ERROR,
     ECSCI_EXC_ENCRYPTION_ERROR,
     ECSCI_EXC_CONFIG_FILE_FORMAT_ERROR,
+    ECSCI_EXC_COMPRESSION_ERROR,
+    ECSCI_EXC_REQUEST_CANCELLED,
     ECSCI_EXC_BACKEND_EXCEPTION = 9000
 } ExceptionCode;
 
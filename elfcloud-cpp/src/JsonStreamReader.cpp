@@ -0,0 +1,317 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+#include "JsonStreamReader.h"
+#include "Exception.h"
+
+#include <string.h>
+
+using namespace std;
+
+namespace elfcloud {
+
+JsonStreamReader::JsonStreamReader(const char *pInBegin, const char *pInEnd): end(pInEnd), pos(pInBegin) {
+}
+
+void JsonStreamReader::fail(const char *pInReason) {
+	string msg("Malformed JSON response: ");
+	msg.append(pInReason);
+	throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, msg);
+}
+
+void JsonStreamReader::skipWhitespace() {
+	while (pos<end && (' '==*pos || '\t'==*pos || '\r'==*pos || '\n'==*pos))
+		pos++;
+}
+
+char JsonStreamReader::peek() {
+	skipWhitespace();
+	if (pos>=end)
+		fail("unexpected end of input");
+	return *pos;
+}
+
+void JsonStreamReader::expect(const char pInChar) {
+	if (peek()!=pInChar) {
+		char reason[]="expected ' '";
+		reason[10]=pInChar;
+		fail(reason);
+	}
+	pos++;
+}
+
+void JsonStreamReader::expectLiteral(const char *pInLiteral) {
+	size_t length=strlen(pInLiteral);
+	if ((size_t) (end-pos)<length || strncmp(pos, pInLiteral, length))
+		fail("invalid literal");
+	pos+=length;
+}
+
+bool JsonStreamReader::atEnd() {
+	skipWhitespace();
+	return pos>=end;
+}
+
+void JsonStreamReader::beginObject() {
+	expect('{');
+}
+
+// Commas are not tracked per nesting level, a separator is simply consumed when present.
+bool JsonStreamReader::nextMember(string &pOutKey) {
+	char c=peek();
+	if ('}'==c) {
+		pos++;
+		return false;
+	}
+	if (','==c)
+		pos++;
+
+	pOutKey=readString();
+	expect(':');
+	return true;
+}
+
+void JsonStreamReader::beginArray() {
+	expect('[');
+}
+
+bool JsonStreamReader::nextElement() {
+	char c=peek();
+	if (']'==c) {
+		pos++;
+		return false;
+	}
+	if (','==c)
+		pos++;
+
+	return true;
+}
+
+bool JsonStreamReader::isNull() {
+	return 'n'==peek();
+}
+
+bool JsonStreamReader::isObject() {
+	return '{'==peek();
+}
+
+bool JsonStreamReader::isArray() {
+	return '['==peek();
+}
+
+uint32_t JsonStreamReader::readHex4() {
+	if (end-pos<4)
+		fail("truncated unicode escape");
+
+	uint32_t value=0;
+	for (int i=0; i<4; i++, pos++) {
+		char c=*pos;
+		value<<=4;
+		if (c>='0' && c<='9') value|=c-'0';
+		else if (c>='a' && c<='f') value|=c-'a'+10;
+		else if (c>='A' && c<='F') value|=c-'A'+10;
+		else fail("invalid unicode escape");
+	}
+	return value;
+}
+
+void JsonStreamReader::appendUTF8(string &pOutString, const uint32_t pInCodePoint) {
+	if (pInCodePoint<0x80) {
+		pOutString.push_back((char) pInCodePoint);
+	} else if (pInCodePoint<0x800) {
+		pOutString.push_back((char) (0xC0 | (pInCodePoint>>6)));
+		pOutString.push_back((char) (0x80 | (pInCodePoint & 0x3F)));
+	} else if (pInCodePoint<0x10000) {
+		pOutString.push_back((char) (0xE0 | (pInCodePoint>>12)));
+		pOutString.push_back((char) (0x80 | ((pInCodePoint>>6) & 0x3F)));
+		pOutString.push_back((char) (0x80 | (pInCodePoint & 0x3F)));
+	} else {
+		pOutString.push_back((char) (0xF0 | (pInCodePoint>>18)));
+		pOutString.push_back((char) (0x80 | ((pInCodePoint>>12) & 0x3F)));
+		pOutString.push_back((char) (0x80 | ((pInCodePoint>>6) & 0x3F)));
+		pOutString.push_back((char) (0x80 | (pInCodePoint & 0x3F)));
+	}
+}
+
+string JsonStreamReader::readString() {
+	if (isNull()) {
+		expectLiteral("null");
+		return string();
+	}
+
+	expect('"');
+
+	string result;
+	while (true) {
+		// Copy runs of plain characters in one go
+		const char *runStart=pos;
+		while (pos<end && '"'!=*pos && '\\'!=*pos)
+			pos++;
+		result.append(runStart, pos-runStart);
+
+		if (pos>=end)
+			fail("unterminated string");
+
+		if ('"'==*pos) {
+			pos++;
+			return result;
+		}
+
+		// Escape sequence
+		pos++;
+		if (pos>=end)
+			fail("unterminated string");
+
+		char c=*pos++;
+		switch (c) {
+			case '"': result.push_back('"'); break;
+			case '\\': result.push_back('\\'); break;
+			case '/': result.push_back('/'); break;
+			case 'b': result.push_back('\b'); break;
+			case 'f': result.push_back('\f'); break;
+			case 'n': result.push_back('\n'); break;
+			case 'r': result.push_back('\r'); break;
+			case 't': result.push_back('\t'); break;
+			case 'u': {
+				uint32_t codePoint=readHex4();
+				if (codePoint>=0xD800 && codePoint<=0xDBFF) {
+					// Surrogate pair
+					if (end-pos<2 || '\\'!=pos[0] || 'u'!=pos[1])
+						fail("invalid surrogate pair");
+					pos+=2;
+					uint32_t low=readHex4();
+					if (low<0xDC00 || low>0xDFFF)
+						fail("invalid surrogate pair");
+					codePoint=0x10000+((codePoint-0xD800)<<10)+(low-0xDC00);
+				}
+				appendUTF8(result, codePoint);
+				break;
+			}
+			default:
+				fail("invalid escape sequence");
+		}
+	}
+}
+
+uint64_t JsonStreamReader::readUInt64() {
+	if (isNull()) {
+		expectLiteral("null");
+		return 0;
+	}
+
+	if (*pos<'0' || *pos>'9')
+		fail("unsigned integer expected");
+
+	uint64_t value=0;
+	while (pos<end && *pos>='0' && *pos<='9') {
+		uint64_t digit=*pos-'0';
+		if (value>(UINT64_MAX-digit)/10)
+			fail("integer out of range");
+		value=value*10+digit;
+		pos++;
+	}
+
+	if (pos<end && ('.'==*pos || 'e'==*pos || 'E'==*pos))
+		fail("unsigned integer expected");
+
+	return value;
+}
+
+void JsonStreamReader::skipString() {
+	expect('"');
+	while (pos<end && '"'!=*pos) {
+		if ('\\'==*pos)
+			pos++;
+		pos++;
+	}
+	if (pos>=end)
+		fail("unterminated string");
+	pos++;
+}
+
+void JsonStreamReader::skipNumber() {
+	if ('-'==*pos)
+		pos++;
+	const char *digits=pos;
+	while (pos<end && ((*pos>='0' && *pos<='9') || '.'==*pos || 'e'==*pos || 'E'==*pos || '+'==*pos || '-'==*pos))
+		pos++;
+	if (pos==digits)
+		fail("invalid number");
+}
+
+// Objects and arrays are skipped by tracking the nesting depth only, contents are not validated.
+void JsonStreamReader::skipValue() {
+	char c=peek();
+
+	switch (c) {
+		case '"':
+			skipString();
+			return;
+		case 't':
+			expectLiteral("true");
+			return;
+		case 'f':
+			expectLiteral("false");
+			return;
+		case 'n':
+			expectLiteral("null");
+			return;
+		case '{':
+		case '[': {
+			unsigned int depth=0;
+			while (pos<end) {
+				c=*pos;
+				if ('"'==c) {
+					skipString();
+					continue;
+				}
+				pos++;
+				if ('{'==c || '['==c) {
+					depth++;
+				} else if ('}'==c || ']'==c) {
+					if (0==--depth)
+						return;
+				}
+			}
+			fail("unterminated object or array");
+		}
+		default:
+			skipNumber();
+	}
+}
+
+Json::Value JsonStreamReader::readValue() {
+	skipWhitespace();
+	const char *valueStart=pos;
+	skipValue();
+
+	Json::Value value;
+	Json::Reader reader(Json::Features::all());
+	if (!reader.parse(valueStart, pos, value, false))
+		fail(reader.getFormattedErrorMessages().c_str());
+
+	return value;
+}
+
+}
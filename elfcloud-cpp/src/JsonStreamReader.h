@@ -0,0 +1,98 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+#ifndef ELFCLOUD_JSONSTREAMREADER_H_
+#define ELFCLOUD_JSONSTREAMREADER_H_
+
+#include "Object.h"
+
+#include <json/json.h>
+#include <json/value.h>
+
+#include <string>
+#include <stdint.h>
+
+namespace elfcloud {
+
+// Pull style JSON reader working directly on a server response buffer. Used for large listing responses
+// where building a Json::Value DOM of the whole response would be too expensive: the caller walks the
+// document with beginObject()/nextMember() and beginArray()/nextElement() and reads scalar values into
+// its own records. Malformed input throws Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED).
+//
+// Typical object loop:
+//    reader.beginObject();
+//    while (reader.nextMember(key)) {
+//        if (!key.compare("id")) id=reader.readUInt64();
+//        else reader.skipValue();
+//    }
+class JsonStreamReader: public Object {
+public:
+	JsonStreamReader(const char *pInBegin, const char *pInEnd);
+
+	void beginObject();
+	// Moves to the next member of the current object, returns false at the end of the object
+	bool nextMember(std::string &pOutKey);
+
+	void beginArray();
+	// Moves to the next element of the current array, returns false at the end of the array
+	bool nextElement();
+
+	bool isNull();
+	bool isObject();
+	bool isArray();
+
+	// null is returned as an empty string / zero, as with Json::Value::asString() and asUInt64()
+	std::string readString();
+	uint64_t readUInt64();
+
+	void skipValue();
+
+	// Parses the next value into a Json::Value, for small parts of a document that are easier to handle as a DOM
+	Json::Value readValue();
+
+	// Reader position, can be used to return to a value with seek() after it has been skipped
+	const char *tell() const { return pos; }
+	void seek(const char *pInPos) { pos=pInPos; }
+
+	// Skips trailing whitespace, returns true when the whole input has been consumed
+	bool atEnd();
+
+private:
+	const char *end;
+	const char *pos;
+
+	void skipWhitespace();
+	char peek();
+	void expect(const char pInChar);
+	void expectLiteral(const char *pInLiteral);
+	void skipString();
+	void skipNumber();
+	void appendUTF8(std::string &pOutString, const uint32_t pInCodePoint);
+	uint32_t readHex4();
+	void fail(const char *pInReason);
+};
+
+}
+
+#endif /* ELFCLOUD_JSONSTREAMREADER_H_ */
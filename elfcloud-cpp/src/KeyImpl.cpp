@@ -71,6 +71,16 @@ namespace elfcloud {
 
         hint.setKeyHash(generateKeyHashString(hint.getKeyHashAlgorithm()));
 
+        // The AES key schedule is expanded once here, cipher streams start from copies of it
+        if ((ECSCI_ENCALG_AES128==pInCipherType || ECSCI_ENCALG_AES192==pInCipherType || ECSCI_ENCALG_AES256==pInCipherType)
+                && !mode.compare("CFB8") && iv.size()==CryptoHelper::feedbackRegisterSize) {
+            try {
+                preparedCipher.reset(new PreparedCipher(key, iv));
+            } catch (...) {
+                // Invalid key length, the key cannot be used for encryption
+            }
+        }
+
         initialized=true;
     }
 
@@ -32,12 +32,15 @@
 #include "API.h"
 
 #include <string>
+#include <memory>
 
 #include "ext_cryptopp.h"
 using namespace CryptoPP;
 
 namespace elfcloud {
 
+struct PreparedCipher;
+
 class KeyImpl: public Key {
 public:
     KeyImpl();
@@ -82,6 +85,13 @@ public:
     CryptoPP::SecByteBlock getKeySecBlock() const;
     CryptoPP::SecByteBlock getIVSecBlock() const;
 
+    // Cipher prepared when the key is created and shared by the copies of the key, empty unless the key is an
+    // AES key in CFB8 mode
+    std::shared_ptr<const PreparedCipher> getPreparedCipher() const { return preparedCipher; }
+
+private:
+    std::shared_ptr<const PreparedCipher> preparedCipher;
+
 };
 
 } // ns elfcloud
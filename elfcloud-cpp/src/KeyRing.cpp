@@ -33,14 +33,6 @@ namespace elfcloud {
     }
 
     KeyRing::~KeyRing() {
-        keymap_t::iterator iter=cipherKeys.begin();
-
-        while (iter!=cipherKeys.end()) {
-            delete iter->second;
-            cipherKeys.erase(iter);
-            iter=cipherKeys.begin();
-        }
-
     }
 
     // Ring takes ownership of the key if added
@@ -52,7 +44,7 @@ namespace elfcloud {
             throw IllegalParameterException(ECSCI_EXC_DUPLICATE_UNIQUE_IDENTIFIER, "Key hint matches existing key");
         }
 
-        cipherKeys[pInKey->getHint()]=pInKey;
+        cipherKeys[pInKey->getHint()]=std::shared_ptr<elfcloud::Key>(pInKey);
 
 		// TEMP TEMP tto tonttu
 		if (cipherKeys.size()==1) {
@@ -110,7 +102,7 @@ namespace elfcloud {
 
         std::list<elfcloud::Key *> keyList;
         while (iter!=cipherKeys.end()) {
-            keyList.push_back(Key::CopyKey(iter->second));
+            keyList.push_back(Key::CopyKey(iter->second.get()));
 			iter++;
         }
 
@@ -118,6 +110,10 @@ namespace elfcloud {
     }
 
     elfcloud::Key *KeyRing::getCipherKey(elfcloud::KeyHint pInKeyHint) {
+        return Key::CopyKey(getSharedCipherKey(pInKeyHint).get());
+    }
+
+    std::shared_ptr<const elfcloud::Key> KeyRing::getSharedCipherKey(elfcloud::KeyHint pInKeyHint) {
         if (pInKeyHint.getKeyHash().size()==0) {
             throw Exception(ECSCI_EXC_KEYMGMT_KEY_NOT_FOUND, "Key hash is empty, key ring not searched");
         }
@@ -128,7 +124,7 @@ namespace elfcloud {
             throw Exception(ECSCI_EXC_KEYMGMT_KEY_NOT_FOUND, "Key hint does not match any keys in the key ring");
         }
 
-        return Key::CopyKey(iter->second);
+        return iter->second;
     }
 
     elfcloud::Key *KeyRing::getDefaultCipherKey() {
@@ -141,4 +137,14 @@ namespace elfcloud {
         }
     }
 
+    std::shared_ptr<const elfcloud::Key> KeyRing::getSharedDefaultCipherKey() {
+        try {
+            return getSharedCipherKey(defaultKeyHint);
+        }
+        catch (Exception &e) {
+			Client::log("DataItem/getSharedDefaultCipherKey(): Default key has not been set or cannot be found");
+            throw Exception(ECSCI_EXC_KEYMGMT_DEFAULT_KEY_NOT_SET, "Default key has not been set or cannot be found");
+        }
+    }
+
 } // ns elfcloud
@@ -27,6 +27,7 @@
 
 #include <map>
 #include <list>
+#include <memory>
 
 #include "KeyHint.h"
 
@@ -35,7 +36,9 @@ namespace elfcloud {
 class Key;
 
 // KeyRing owns pointers to the keys. Copies are given out, free'd by recipient. In adding keys ring assumes key ownership.
-typedef std::map<elfcloud::KeyHint, elfcloud::Key*> keymap_t;
+// Shared references can be taken without copying with getSharedCipherKey(), the key stays valid for as long as the
+// reference is held even if it is deleted from the ring.
+typedef std::map<elfcloud::KeyHint, std::shared_ptr<elfcloud::Key> > keymap_t;
 
     class KeyRing: public elfcloud::Object {
     private:
@@ -59,6 +62,10 @@ typedef std::map<elfcloud::KeyHint, elfcloud::Key*> keymap_t;
 
         elfcloud::Key *getCipherKey(elfcloud::KeyHint pInKeyHint);
         elfcloud::Key *getDefaultCipherKey();
+
+        // Same lookups without a copy of the key and its prepared cipher
+        std::shared_ptr<const elfcloud::Key> getSharedCipherKey(elfcloud::KeyHint pInKeyHint);
+        std::shared_ptr<const elfcloud::Key> getSharedDefaultCipherKey();
     };
 
 } // ns elfcloud
@@ -0,0 +1,226 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+
+#ifndef ELFCLOUD_METADATACACHE_H_
+#define ELFCLOUD_METADATACACHE_H_
+
+#include "Object.h"
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <list>
+#include <unordered_map>
+#include <chrono>
+#include <stdint.h>
+
+namespace elfcloud {
+
+typedef struct MetadataCacheStats {
+	uint64_t entries;
+	uint64_t hits;
+	uint64_t misses;
+	// Lookups of entries older than the TTL, counted in misses as well
+	uint64_t expired;
+	uint64_t inserts;
+	uint64_t updates;
+	uint64_t evictions;
+} MetadataCacheStats;
+
+// Cache of server objects (containers, data items) by id, shared by all users of a Client. Entries are kept
+// in shardCount shards by id, each with its own lock and LRU list, so that lookups from several threads
+// seldom wait for each other.
+//
+// Cached objects are never modified by the cache: set() of an id already cached replaces the entry with the
+// new object (copy-on-write), so an object handed out by get() can be read without any lock while another
+// thread stores a newer copy. Holders of the old object keep seeing the old contents until they look the id
+// up again. Eviction is plain LRU over all entries, an evicted object stays valid for anyone still holding
+// it, the capacity bounds the objects owned by the cache only.
+//
+// An entry older than the TTL is a miss for get() but is kept, the caller fetches the object again and set()
+// refreshes the existing entry.
+template <class T> class MetadataCache: public Object {
+public:
+	static const size_t defaultCapacity=100000;
+
+	// 0 TTL never expires entries
+	MetadataCache(const size_t pInCapacity=defaultCapacity, const unsigned int pInTTLSeconds=0):
+		capacity(pInCapacity), ttlSeconds(pInTTLSeconds) {}
+
+	// Effective for the next insert, 0 is unbounded
+	void setCapacity(const size_t pInCapacity) {
+		capacity=pInCapacity;
+	}
+
+	void setTTL(const unsigned int pInTTLSeconds) {
+		ttlSeconds=pInTTLSeconds;
+	}
+
+	// Empty pointer on a miss, a miss does not create an entry
+	std::shared_ptr<T> get(const uint64_t pInId) {
+		shard &s=getShard(pInId);
+		std::lock_guard<std::mutex> lock(s.mutex);
+
+		typename entryMap::iterator i=s.entries.find(pInId);
+		if (i==s.entries.end()) {
+			s.stats.misses++;
+			return std::shared_ptr<T>();
+		}
+		if (isExpired(i->second)) {
+			s.stats.misses++;
+			s.stats.expired++;
+			return std::shared_ptr<T>();
+		}
+
+		s.lru.splice(s.lru.begin(), s.lru, i->second.lru);
+		s.stats.hits++;
+		return i->second.object;
+	}
+
+	// Returns the object now cached for the id (pInObject), pOutUpdated tells whether it replaced an entry
+	std::shared_ptr<T> set(const uint64_t pInId, std::shared_ptr<T> pInObject, bool &pOutUpdated) {
+		shard &s=getShard(pInId);
+		std::lock_guard<std::mutex> lock(s.mutex);
+
+		typename entryMap::iterator i=s.entries.find(pInId);
+		if (i!=s.entries.end()) {
+			i->second.object=pInObject;
+			i->second.refreshed=std::chrono::steady_clock::now();
+			s.lru.splice(s.lru.begin(), s.lru, i->second.lru);
+			s.stats.updates++;
+			pOutUpdated=true;
+			return pInObject;
+		}
+
+		s.lru.push_front(pInId);
+		entry &e=s.entries[pInId];
+		e.object=pInObject;
+		e.refreshed=std::chrono::steady_clock::now();
+		e.lru=s.lru.begin();
+		s.stats.inserts++;
+		pOutUpdated=false;
+
+		evict(s);
+		return pInObject;
+	}
+
+	void erase(const uint64_t pInId) {
+		shard &s=getShard(pInId);
+		std::lock_guard<std::mutex> lock(s.mutex);
+
+		typename entryMap::iterator i=s.entries.find(pInId);
+		if (i!=s.entries.end()) {
+			s.lru.erase(i->second.lru);
+			s.entries.erase(i);
+		}
+	}
+
+	void clear() {
+		for (unsigned int i=0; i<shardCount; i++) {
+			std::lock_guard<std::mutex> lock(shards[i].mutex);
+			shards[i].entries.clear();
+			shards[i].lru.clear();
+		}
+	}
+
+	size_t size() {
+		size_t total=0;
+		for (unsigned int i=0; i<shardCount; i++) {
+			std::lock_guard<std::mutex> lock(shards[i].mutex);
+			total+=shards[i].entries.size();
+		}
+		return total;
+	}
+
+	// Totals over all shards since the cache was created
+	MetadataCacheStats getStats() {
+		MetadataCacheStats total={0, 0, 0, 0, 0, 0, 0};
+		for (unsigned int i=0; i<shardCount; i++) {
+			std::lock_guard<std::mutex> lock(shards[i].mutex);
+			total.entries+=shards[i].entries.size();
+			total.hits+=shards[i].stats.hits;
+			total.misses+=shards[i].stats.misses;
+			total.expired+=shards[i].stats.expired;
+			total.inserts+=shards[i].stats.inserts;
+			total.updates+=shards[i].stats.updates;
+			total.evictions+=shards[i].stats.evictions;
+		}
+		return total;
+	}
+
+private:
+	static const unsigned int shardCount=16;
+
+	typedef struct entry {
+		std::shared_ptr<T> object;
+		std::chrono::steady_clock::time_point refreshed;
+		std::list<uint64_t>::iterator lru;
+	} entry;
+
+	typedef std::unordered_map<uint64_t, entry> entryMap;
+
+	typedef struct shard {
+		std::mutex mutex;
+		entryMap entries;
+		// Most recently used first
+		std::list<uint64_t> lru;
+		MetadataCacheStats stats;
+
+		shard() {
+			stats=MetadataCacheStats();
+		}
+	} shard;
+
+	shard shards[shardCount];
+	std::atomic<size_t> capacity;
+	std::atomic<unsigned int> ttlSeconds;
+
+	shard &getShard(const uint64_t pInId) {
+		// Ids are sequential on the server, the low bits spread them evenly
+		return shards[pInId%shardCount];
+	}
+
+	bool isExpired(const entry &pInEntry) {
+		unsigned int ttl=ttlSeconds;
+		return ttl && std::chrono::steady_clock::now()-pInEntry.refreshed>std::chrono::seconds(ttl);
+	}
+
+	void evict(shard &pInOutShard) {
+		size_t limit=capacity;
+		if (!limit)
+			return;
+		limit=(limit+shardCount-1)/shardCount;
+
+		while (pInOutShard.entries.size()>limit) {
+			pInOutShard.entries.erase(pInOutShard.lru.back());
+			pInOutShard.lru.pop_back();
+			pInOutShard.stats.evictions++;
+		}
+	}
+};
+
+}
+
+#endif /* ELFCLOUD_METADATACACHE_H_ */
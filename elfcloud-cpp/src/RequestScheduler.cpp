@@ -0,0 +1,210 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+
+#include "RequestScheduler.h"
+#include "Client.h"
+#include "CancelToken.h"
+#include "Exception.h"
+
+#include <chrono>
+#include <sstream>
+
+using namespace std;
+
+namespace elfcloud {
+
+static const char *priorityNames[ELFCLOUD_PRIORITY_CLASSES]={ "foreground", "metadata", "prefetch", "background" };
+
+// Priority tag of the calling thread, -1 when no Scope is active
+static __thread int currentPriority=-1;
+
+RequestScheduler::RequestScheduler(): slots(1), running(0) {
+	for (unsigned int i=0; i<ELFCLOUD_PRIORITY_CLASSES; i++) {
+		classes[i].limit=0;
+		classes[i].running=0;
+		classes[i].nextTicket=0;
+		classes[i].servingTicket=0;
+		classes[i].admitted=0;
+		classes[i].totalWaitMicroseconds=0;
+		classes[i].maxWaitMicroseconds=0;
+	}
+}
+
+void RequestScheduler::setSlots(const unsigned int pInSlots) {
+	{
+		lock_guard<mutex> lock(schedulerMutex);
+		slots=pInSlots ? pInSlots : 1;
+	}
+	admissionChanged.notify_all();
+}
+
+void RequestScheduler::setClassLimit(const RequestPriority pInPriority, const unsigned int pInLimit) {
+	{
+		lock_guard<mutex> lock(schedulerMutex);
+		classes[pInPriority].limit=pInLimit;
+	}
+	admissionChanged.notify_all();
+}
+
+RequestSchedulerStats RequestScheduler::getStats(const RequestPriority pInPriority) {
+	lock_guard<mutex> lock(schedulerMutex);
+	const requestClass &c=classes[pInPriority];
+
+	RequestSchedulerStats stats;
+	stats.queued=(unsigned int) (c.nextTicket-c.servingTicket-c.abandonedTickets.size());
+	stats.running=c.running;
+	stats.admitted=c.admitted;
+	stats.totalWaitMicroseconds=c.totalWaitMicroseconds;
+	stats.maxWaitMicroseconds=c.maxWaitMicroseconds;
+	return stats;
+}
+
+const char *RequestScheduler::getPriorityName(const RequestPriority pInPriority) {
+	return priorityNames[pInPriority];
+}
+
+bool RequestScheduler::getPriorityByName(const string &pInName, RequestPriority &pOutPriority) {
+	for (unsigned int i=0; i<ELFCLOUD_PRIORITY_CLASSES; i++) {
+		if (!pInName.compare(priorityNames[i])) {
+			pOutPriority=(RequestPriority) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+RequestPriority RequestScheduler::getCurrentPriority(const RequestPriority pInDefault) {
+	return currentPriority<0 ? pInDefault : (RequestPriority) currentPriority;
+}
+
+bool RequestScheduler::canRun(const RequestPriority pInPriority) {
+	const requestClass &c=classes[pInPriority];
+	return running<slots && (!c.limit || c.running<c.limit);
+}
+
+// The oldest request of a class is admitted when a slot is free for it and no higher priority class
+// has a request waiting that could use the slot instead.
+bool RequestScheduler::isAdmissible(const RequestPriority pInPriority, const uint64_t pInTicket) {
+	if (pInTicket!=classes[pInPriority].servingTicket || !canRun(pInPriority))
+		return false;
+
+	for (unsigned int i=0; i<(unsigned int) pInPriority; i++) {
+		if (classes[i].nextTicket!=classes[i].servingTicket && canRun((RequestPriority) i))
+			return false;
+	}
+	return true;
+}
+
+void RequestScheduler::skipAbandoned(requestClass &pInOutClass) {
+	while (pInOutClass.abandonedTickets.erase(pInOutClass.servingTicket))
+		pInOutClass.servingTicket++;
+}
+
+void RequestScheduler::admit(const RequestPriority pInPriority) {
+	chrono::steady_clock::time_point queuedAt=chrono::steady_clock::now();
+	CancelToken *cancelToken=CancelToken::getCurrent();
+
+	unique_lock<mutex> lock(schedulerMutex);
+	requestClass &c=classes[pInPriority];
+	uint64_t ticket=c.nextTicket++;
+
+	while (!isAdmissible(pInPriority, ticket)) {
+		if (!cancelToken) {
+			admissionChanged.wait(lock);
+			continue;
+		}
+
+		admissionChanged.wait_for(lock, chrono::milliseconds(CancelToken::checkIntervalMilliseconds));
+
+		// The check function may take its time, other requests are not held up meanwhile
+		lock.unlock();
+		bool cancelled=cancelToken->isCancelled();
+		lock.lock();
+
+		if (cancelled && !isAdmissible(pInPriority, ticket)) {
+			if (ticket==c.servingTicket) {
+				c.servingTicket++;
+				skipAbandoned(c);
+			} else {
+				c.abandonedTickets.insert(ticket);
+			}
+			lock.unlock();
+
+			// The requests queued behind this one may be admissible now
+			admissionChanged.notify_all();
+			throw Exception(ECSCI_EXC_REQUEST_CANCELLED, "Request cancelled");
+		}
+	}
+
+	c.servingTicket++;
+	skipAbandoned(c);
+	c.running++;
+	running++;
+
+	uint64_t waited=chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now()-queuedAt).count();
+	c.admitted++;
+	c.totalWaitMicroseconds+=waited;
+	if (waited>c.maxWaitMicroseconds)
+		c.maxWaitMicroseconds=waited;
+
+	lock.unlock();
+
+	// The next request of this class may be admissible as well
+	admissionChanged.notify_all();
+
+	if (waited>0 && Client::isLogged(5)) {
+		stringstream ss;
+		ss << "RequestScheduler: " << priorityNames[pInPriority] << " request admitted after " << waited << " us";
+		Client::log(ss.str(), 5);
+	}
+}
+
+void RequestScheduler::release(const RequestPriority pInPriority) {
+	{
+		lock_guard<mutex> lock(schedulerMutex);
+		classes[pInPriority].running--;
+		running--;
+	}
+	admissionChanged.notify_all();
+}
+
+RequestScheduler::Scope::Scope(const RequestPriority pInPriority): previous(currentPriority) {
+	currentPriority=pInPriority;
+}
+
+RequestScheduler::Scope::~Scope() {
+	currentPriority=previous;
+}
+
+RequestScheduler::Admission::Admission(RequestScheduler &pInScheduler, const RequestPriority pInPriority):
+		scheduler(pInScheduler), priority(pInPriority) {
+	scheduler.admit(priority);
+}
+
+RequestScheduler::Admission::~Admission() {
+	scheduler.release(priority);
+}
+
+}
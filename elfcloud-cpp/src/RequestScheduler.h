@@ -0,0 +1,136 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+
+#ifndef ELFCLOUD_REQUESTSCHEDULER_H_
+#define ELFCLOUD_REQUESTSCHEDULER_H_
+
+#include "Object.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <set>
+#include <stdint.h>
+
+namespace elfcloud {
+
+// Request priority classes, highest priority first
+typedef enum RequestPriority {
+	ELFCLOUD_PRIORITY_FOREGROUND_FETCH = 0,
+	ELFCLOUD_PRIORITY_METADATA,
+	ELFCLOUD_PRIORITY_PREFETCH,
+	ELFCLOUD_PRIORITY_BACKGROUND_STORE,
+	ELFCLOUD_PRIORITY_CLASSES
+} RequestPriority;
+
+typedef struct RequestSchedulerStats {
+	unsigned int queued;
+	unsigned int running;
+	uint64_t admitted;
+	uint64_t totalWaitMicroseconds;
+	uint64_t maxWaitMicroseconds;
+} RequestSchedulerStats;
+
+// Admission control for server requests of one Client. A request waits in the queue of its priority class
+// until a request slot is free and the class is below its own concurrency limit. Free slots are handed out
+// to the highest priority class that can use one, in arrival order within a class, so an interactive read
+// never waits behind queued prefetch or background store requests.
+//
+// Requests are classified by their interface type (JSON = metadata, fetch = foreground fetch, store =
+// background store) unless the calling thread has tagged them with a Scope:
+//    RequestScheduler::Scope scope(ELFCLOUD_PRIORITY_PREFETCH);
+//    cluster->fetchDataItem(dataItem);
+//
+// A queued request gives up its place when the CancelToken of the calling thread is cancelled, the Admission
+// constructor then throws Exception(ECSCI_EXC_REQUEST_CANCELLED).
+class RequestScheduler: public Object {
+public:
+	RequestScheduler();
+
+	// Total number of requests running at the same time
+	void setSlots(const unsigned int pInSlots);
+	// Concurrency limit of one class, 0 means limited only by the slot count
+	void setClassLimit(const RequestPriority pInPriority, const unsigned int pInLimit);
+
+	RequestSchedulerStats getStats(const RequestPriority pInPriority);
+
+	static const char *getPriorityName(const RequestPriority pInPriority);
+	// Parses a class name as returned by getPriorityName(), returns false for unknown names
+	static bool getPriorityByName(const std::string &pInName, RequestPriority &pOutPriority);
+
+	// Priority of requests made by the calling thread, pInDefault when no Scope is active
+	static RequestPriority getCurrentPriority(const RequestPriority pInDefault);
+
+	// Tags requests made by the calling thread while in scope, scopes can be nested
+	class Scope {
+	public:
+		Scope(const RequestPriority pInPriority);
+		~Scope();
+	private:
+		int previous;
+	};
+
+	// Holds a request slot while in scope, the constructor blocks until the request is admitted or cancelled
+	class Admission {
+	public:
+		Admission(RequestScheduler &pInScheduler, const RequestPriority pInPriority);
+		~Admission();
+	private:
+		RequestScheduler &scheduler;
+		RequestPriority priority;
+	};
+
+private:
+	typedef struct requestClass {
+		unsigned int limit;
+		unsigned int running;
+		// Arrival order within the class, nextTicket is handed to the next request queued and
+		// servingTicket is the oldest one still waiting
+		uint64_t nextTicket;
+		uint64_t servingTicket;
+		// Tickets of cancelled requests still queued behind servingTicket, skipped when it reaches them
+		std::set<uint64_t> abandonedTickets;
+		uint64_t admitted;
+		uint64_t totalWaitMicroseconds;
+		uint64_t maxWaitMicroseconds;
+	} requestClass;
+
+	requestClass classes[ELFCLOUD_PRIORITY_CLASSES];
+	unsigned int slots;
+	unsigned int running;
+
+	std::mutex schedulerMutex;
+	std::condition_variable admissionChanged;
+
+	bool canRun(const RequestPriority pInPriority);
+	bool isAdmissible(const RequestPriority pInPriority, const uint64_t pInTicket);
+	void skipAbandoned(requestClass &pInOutClass);
+	void admit(const RequestPriority pInPriority);
+	void release(const RequestPriority pInPriority);
+};
+
+}
+
+#endif /* ELFCLOUD_REQUESTSCHEDULER_H_ */
@@ -0,0 +1,146 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+#include "SegmentSizer.h"
+#include "Client.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace elfcloud {
+
+SegmentSizer::SegmentSizer(): adaptive(false), fixedSize(defaultSize), minSize(defaultMinSize), maxSize(defaultMaxSize),
+		currentSize(defaultSize), throughput(0), rtt(0), segments(0), failures(0), smallestSize(0), largestSize(0) {
+}
+
+void SegmentSizer::setFixedSize(const unsigned int pInSize) {
+	lock_guard<mutex> lock(sizerMutex);
+	fixedSize=pInSize;
+	currentSize=clampSize(pInSize);
+}
+
+void SegmentSizer::setAdaptive(const bool pInAdaptive) {
+	lock_guard<mutex> lock(sizerMutex);
+	adaptive=pInAdaptive;
+}
+
+void SegmentSizer::setBounds(const unsigned int pInMinSize, const unsigned int pInMaxSize) {
+	lock_guard<mutex> lock(sizerMutex);
+	if (pInMinSize)
+		minSize=pInMinSize<sizeGranularity ? sizeGranularity : pInMinSize;
+	if (pInMaxSize)
+		maxSize=pInMaxSize;
+	if (maxSize<minSize)
+		maxSize=minSize;
+	currentSize=clampSize(currentSize);
+}
+
+unsigned int SegmentSizer::getSegmentSize() {
+	lock_guard<mutex> lock(sizerMutex);
+	unsigned int size=adaptive ? currentSize : fixedSize;
+	noteSize(size);
+	return size;
+}
+
+unsigned int SegmentSizer::clampSize(const double pInSize) {
+	double size=pInSize;
+	if (size<minSize)
+		size=minSize;
+	if (size>maxSize)
+		size=maxSize;
+
+	unsigned int rounded=((unsigned int) size)/sizeGranularity*sizeGranularity;
+	return rounded<minSize ? minSize : rounded;
+}
+
+void SegmentSizer::noteSize(const unsigned int pInSize) {
+	if (!smallestSize || pInSize<smallestSize)
+		smallestSize=pInSize;
+	if (pInSize>largestSize)
+		largestSize=pInSize;
+}
+
+void SegmentSizer::recordSegment(const unsigned int pInBytes, const double pInSeconds, const double pInRttSeconds) {
+	lock_guard<mutex> lock(sizerMutex);
+
+	segments++;
+
+	// Exponentially weighted averages, an RTT is only measured when the request opened a new connection
+	if (pInSeconds>0 && pInBytes>0) {
+		double sample=pInBytes/pInSeconds;
+		throughput=throughput>0 ? (throughput+sample)/2 : sample;
+	}
+	if (pInRttSeconds>0)
+		rtt=rtt>0 ? (rtt*3+pInRttSeconds)/4 : pInRttSeconds;
+
+	// The final, short segment of a file says little about the link
+	if (!adaptive || throughput<=0 || pInBytes<currentSize/2)
+		return;
+
+	double targetSeconds=(rtt>0 ? rtt : 0.1)*targetRttMultiple;
+	if (targetSeconds<targetMinSeconds)
+		targetSeconds=targetMinSeconds;
+	if (targetSeconds>targetMaxSeconds)
+		targetSeconds=targetMaxSeconds;
+
+	double wanted=throughput*targetSeconds;
+	if (wanted>2.0*currentSize)
+		wanted=2.0*currentSize;
+	if (wanted<currentSize/2.0)
+		wanted=currentSize/2.0;
+
+	unsigned int previous=currentSize;
+	currentSize=clampSize(wanted);
+
+	if (currentSize!=previous && Client::isLogged(5)) {
+		stringstream ss;
+		ss << "SegmentSizer: Segment size " << previous << " -> " << currentSize << " bytes (" << (uint64_t) throughput
+		   << " B/s, RTT " << (uint64_t) (rtt*1000) << " ms)";
+		Client::log(ss.str(), 5);
+	}
+}
+
+void SegmentSizer::recordFailure() {
+	lock_guard<mutex> lock(sizerMutex);
+	failures++;
+	if (adaptive)
+		currentSize=clampSize(currentSize/2.0);
+}
+
+SegmentSizerStats SegmentSizer::getStats() {
+	lock_guard<mutex> lock(sizerMutex);
+
+	SegmentSizerStats stats;
+	stats.segments=segments;
+	stats.failures=failures;
+	stats.currentSize=adaptive ? currentSize : fixedSize;
+	stats.smallestSize=smallestSize;
+	stats.largestSize=largestSize;
+	stats.throughputBps=(uint64_t) throughput;
+	stats.rttMicroseconds=(uint64_t) (rtt*1000000);
+	return stats;
+}
+
+}
@@ -0,0 +1,105 @@
+/***
+ * elfcloud.fi C++ Client
+ * ===========================================================================
+ * $Id$
+ *
+ * LICENSE
+ * ===========================================================================
+ * Copyright 2010-2013 elfCLOUD /
+ * elfcloud.fi - SCIS Secure Cloud Infrastructure Services
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ ***/
+
+
+#ifndef ELFCLOUD_SEGMENTSIZER_H_
+#define ELFCLOUD_SEGMENTSIZER_H_
+
+#include "Object.h"
+
+#include <mutex>
+#include <stdint.h>
+
+namespace elfcloud {
+
+typedef struct SegmentSizerStats {
+	uint64_t segments;
+	uint64_t failures;
+	unsigned int currentSize;
+	unsigned int smallestSize;
+	unsigned int largestSize;
+	// Smoothed upload throughput and connection round trip time, 0 when not measured yet
+	uint64_t throughputBps;
+	uint64_t rttMicroseconds;
+} SegmentSizerStats;
+
+// Segment size of segmented passthrough stores. By default a fixed size is used (http.segment.size.bytes).
+// In adaptive mode (http.segment.size.bytes=auto) the size follows the measured upload throughput and round
+// trip time: a segment is made large enough that the per request overhead (about one RTT plus the server
+// commit) stays small, but small enough that a failed segment costs at most targetMaxSeconds of transfer.
+// Sizes change at most by a factor of two per segment and stay within the configured bounds, failures halve it.
+class SegmentSizer: public Object {
+public:
+	SegmentSizer();
+
+	void setFixedSize(const unsigned int pInSize);
+	void setAdaptive(const bool pInAdaptive);
+	// Bounds of the adaptive size, 0 keeps the current bound
+	void setBounds(const unsigned int pInMinSize, const unsigned int pInMaxSize);
+
+	// Size of the next segment to send, the sizes handed out are reported in the stats
+	unsigned int getSegmentSize();
+
+	// Result of a committed segment: payload bytes, request duration and the connection RTT when the request
+	// had to connect (0 when an existing connection was used)
+	void recordSegment(const unsigned int pInBytes, const double pInSeconds, const double pInRttSeconds);
+	void recordFailure();
+
+	SegmentSizerStats getStats();
+
+	static const unsigned int defaultSize=20*1024*1024;
+	static const unsigned int defaultMinSize=1024*1024;
+	static const unsigned int defaultMaxSize=128*1024*1024;
+
+private:
+	// Segment transfer time aimed at, in units of RTT and absolute bounds in seconds
+	static const unsigned int targetRttMultiple=50;
+	static const unsigned int targetMinSeconds=2;
+	static const unsigned int targetMaxSeconds=30;
+	// Sizes are kept in multiples of this
+	static const unsigned int sizeGranularity=64*1024;
+
+	bool adaptive;
+	unsigned int fixedSize;
+	unsigned int minSize;
+	unsigned int maxSize;
+	unsigned int currentSize;
+
+	double throughput;
+	double rtt;
+
+	uint64_t segments;
+	uint64_t failures;
+	unsigned int smallestSize;
+	unsigned int largestSize;
+
+	std::mutex sizerMutex;
+
+	unsigned int clampSize(const double pInSize);
+	void noteSize(const unsigned int pInSize);
+};
+
+}
+
+#endif /* ELFCLOUD_SEGMENTSIZER_H_ */
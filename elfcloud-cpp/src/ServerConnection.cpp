@@ -32,6 +32,11 @@
 #include "CryptoHelper.h"
 #include "Key.h"
 #include "KeyHint.h"
+#include "JsonStreamReader.h"
+#include "BandwidthScheduler.h"
+#include "RequestScheduler.h"
+#include "CompressionHelper.h"
+#include "CancelToken.h"
 
 #include <curl/curl.h>
 #include <string>
@@ -40,21 +45,162 @@
 #include <iostream>
 #include <iomanip>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdlib>
+#include <climits>
+#include <sys/stat.h>
+#include <thread>
+#include <memory>
+#include <chrono>
+
 using namespace std;
 using namespace CryptoPP;
 
 namespace elfcloud {
 
-ServerConnection::ServerConnection(Client *pInelfcloudClient): speedLimitSend(0), speedLimitReceive(0) {
+// Progress callback state of one transfer
+typedef struct transferProgress {
+	BandwidthScheduler::Transfer *bandwidthTransfer;
+	CancelToken *cancelToken;
+} transferProgress;
+
+// One byte range of a striped passthrough fetch
+typedef struct fetchStripe {
+	uint64_t begin;
+	uint64_t length;
+	// Bytes of the range written to the target file so far
+	uint64_t received;
+	int fd;
+	CancelToken *cancelToken;
+	// Request class of the fetch, every range takes a request slot of its own
+	RequestPriority priority;
+
+	// HTTP status and header lines of the latest response
+	long status;
+	std::string headers;
+
+	// Set when the server answered the range request with the whole data item
+	bool rangeIgnored;
+	bool failed;
+	ExceptionCode errorCode;
+	std::string errorMessage;
+
+	// The 16 ciphertext bytes before the range, the CFB8 decryption of the range starts from them.
+	// For CTR content the initial counter block of the data item, the range is decrypted from its offset.
+	ECCipherMode cipherMode;
+	byte feedbackRegister[CryptoHelper::feedbackRegisterSize];
+
+	fetchStripe() {
+		begin=0;
+		length=0;
+		received=0;
+		fd=-1;
+		cancelToken=0;
+		priority=ELFCLOUD_PRIORITY_FOREGROUND_FETCH;
+		status=0;
+		rangeIgnored=false;
+		failed=false;
+		errorCode=ECSCI_EXC_UNDEFINED;
+		cipherMode=ECSCI_CIPHERMODE_CFB8;
+		memset(feedbackRegister, 0, sizeof(feedbackRegister));
+	}
+
+	void fail(const ExceptionCode pInCode, const std::string& pInMessage) {
+		failed=true;
+		errorCode=pInCode;
+		errorMessage=pInMessage;
+	}
+} fetchStripe;
+
+static bool readFully(const int pInFd, byte *pOutData, const size_t pInLength, const uint64_t pInOffset) {
+	size_t done=0;
+	while (done<pInLength) {
+		ssize_t ret=pread(pInFd, pOutData+done, pInLength-done, (off_t) (pInOffset+done));
+		if (ret<0 && EINTR==errno)
+			continue;
+		if (ret<=0)
+			return false;
+		done+=ret;
+	}
+	return true;
+}
+
+static bool writeFully(const int pInFd, const byte *pInData, const size_t pInLength, const uint64_t pInOffset) {
+	size_t done=0;
+	while (done<pInLength) {
+		ssize_t ret=pwrite(pInFd, pInData+done, pInLength-done, (off_t) (pInOffset+done));
+		if (ret<0) {
+			if (EINTR==errno)
+				continue;
+			return false;
+		}
+		done+=ret;
+	}
+	return true;
+}
+
+static size_t writeStripeHeader(void *ptr, size_t size, size_t nmemb, void *userData) {
+	fetchStripe *stripe=(fetchStripe*) userData;
+	const size_t length=size*nmemb;
+
+	// Each status line starts a new response, e.g. after "100 Continue"
+	if (length>12 && strncmp("HTTP/", (const char*) ptr, 5)==0) {
+		const char *status=(const char*) memchr(ptr, ' ', length);
+		stripe->status=status ? strtol(status+1, NULL, 10) : 0;
+		stripe->headers.clear();
+	}
+
+	stripe->headers.append((const char*) ptr, length);
+	return length;
+}
+
+// Ciphertext of the range goes to its place in the target file as is, it is decrypted once the whole item is in
+static size_t writeStripeData(void *ptr, size_t size, size_t nmemb, void *userData) {
+	fetchStripe *stripe=(fetchStripe*) userData;
+	const size_t length=size*nmemb;
+
+	if (206!=stripe->status || stripe->received+length>stripe->length)
+		return 0;
+
+	if (!writeFully(stripe->fd, (const byte*) ptr, length, stripe->begin+stripe->received))
+		return 0;
+
+	stripe->received+=length;
+	return length;
+}
+
+ServerConnection::ServerConnection(Client *pInelfcloudClient) {
 	authenticated = false;
+	sessionRestoreAttempted = false;
+	jsonRequestHeaders = curl_slist_append(NULL, "Content-type: application/json; charset=utf-8");
+	// Large request bodies would otherwise wait for a "100 Continue" answer, an extra round trip
+	jsonRequestHeaders = curl_slist_append(jsonRequestHeaders, "Expect:");
+	profile.reset(new connectionProfile());
     curl_global_init(CURL_GLOBAL_DEFAULT);
+    share = curl_share_init();
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, ServerConnection::lockShare);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, ServerConnection::unlockShare);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
     curl = curl_easy_init();
+    // Kept over curl_easy_reset()
+    curl_easy_setopt(curl, CURLOPT_SHARE, share);
 	client=pInelfcloudClient;
 	res=CURLE_OK;
 }
 
 ServerConnection::~ServerConnection() {
+     for (unsigned int i=0; i<bufferPool.size(); i++)
+         free(bufferPool[i].first);
+     curl_slist_free_all(jsonRequestHeaders);
+     for (unsigned int i=0; i<handlePool.size(); i++)
+         curl_easy_cleanup(handlePool[i]);
      curl_easy_cleanup(curl);
+     curl_share_cleanup(share);
      curl_global_cleanup();
 }
 
@@ -73,18 +219,238 @@ string ServerConnection::getAddress() {
 	return address;
 }
 
-void ServerConnection::ensureAuthenticatedState() {
+bool ServerConnection::ensureAuthenticatedState() {
+
+	std::lock_guard<std::recursive_mutex> lock(authMutex);
 
 	if (!authenticated) {
+		// A persisted session is tried once, the server answers with error 101 if it is no longer valid
+		if (!sessionRestoreAttempted) {
+			sessionRestoreAttempted = true;
+			if (restoreSession()) {
+				authenticated = true;
+				return true;
+			}
+		}
+
 		Json::Value jsonAuth = createRequestAuth();
 		Json::Value jsonAuthResp = performServerJSONRequest(jsonAuth, true);
 
 		if (!jsonAuthResp.isNull()) {
 			authenticated = true;
+			saveSession();
 		} else {
 			throw Exception(ECSCI_EXC_INIT_OR_PARAM_FAILURE, "Authentication not accepted by server");
 		}
 	}
+	return false;
+}
+
+void ServerConnection::warmup() {
+
+	{
+		std::lock_guard<std::recursive_mutex> lock(authMutex);
+
+		// A request has been made already, the connection is warm
+		if (authenticated)
+			return;
+
+		// The authentication request opens the connection that later requests reuse
+		if (!ensureAuthenticatedState())
+			return;
+	}
+
+	// The session was restored without contacting the server. Connect-only transfer: libcurl does not reuse
+	// the connection itself for requests, but the resolved address and the TLS session are cached in the
+	// handle, so the first real request skips the DNS lookup and gets an abbreviated handshake.
+	RequestScheduler::Admission admission(*client->getRequestScheduler(), ELFCLOUD_PRIORITY_METADATA);
+	std::lock_guard<std::mutex> lock(connectionMutex);
+
+	curl_easy_reset(curl);
+	curl_easy_setopt(curl, CURLOPT_URL, address.c_str());
+	curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 1L);
+	applyConnectionOptions(curl, *getConnectionProfile());
+
+	res = curl_easy_perform(curl);
+
+	stringstream ss;
+	ss << "ServerConnection/warmup(): Connection warmup result " << res;
+	Client::log(ss.str(), 3);
+
+	curl_easy_reset(curl);
+}
+
+string ServerConnection::getSessionIdentity() {
+	return "# elfcloud session v1 " + getAuthUsername() + " " + address;
+}
+
+bool ServerConnection::restoreSession() {
+
+	string path = client->getConf("http.session.file");
+	if (!path.compare("not found"))
+		return false;
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_uid != getuid() || (fileStat.st_mode & 077)) {
+		close(fd);
+		Client::log("ServerConnection/restoreSession(): Session file is not private to the user, ignored", 1);
+		return false;
+	}
+
+	string contents;
+	char buf[4096];
+	ssize_t got;
+	while ((got = read(fd, buf, sizeof(buf))) > 0)
+		contents.append(buf, got);
+	close(fd);
+
+	std::istringstream lines(contents);
+	string line;
+	if (!std::getline(lines, line) || line.compare(getSessionIdentity()))
+		return false;
+
+	std::lock_guard<std::mutex> lock(connectionMutex);
+
+	unsigned int cookies = 0;
+	while (std::getline(lines, line)) {
+		if (line.empty())
+			continue;
+		// One cookie per line in the Netscape format returned by CURLINFO_COOKIELIST
+		curl_easy_setopt(curl, CURLOPT_COOKIELIST, line.c_str());
+		cookies++;
+	}
+
+	stringstream ss;
+	ss << "ServerConnection/restoreSession(): Restored " << cookies << " session cookies";
+	Client::log(ss.str(), 3);
+
+	return cookies > 0;
+}
+
+void ServerConnection::saveSession() {
+
+	string path = client->getConf("http.session.file");
+	if (!path.compare("not found"))
+		return;
+
+	struct curl_slist *cookies = NULL;
+	{
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		if (curl_easy_getinfo(curl, CURLINFO_COOKIELIST, &cookies) != CURLE_OK)
+			return;
+	}
+
+	string contents = getSessionIdentity() + "\n";
+	for (struct curl_slist *c = cookies; c; c = c->next) {
+		contents.append(c->data);
+		contents.append("\n");
+	}
+	curl_slist_free_all(cookies);
+
+	// Written to a private temporary file and renamed in place so that the file is never readable by others
+	string tmpPath = path + ".tmp";
+	int fd = open(tmpPath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	if (fd < 0) {
+		Client::log("ServerConnection/saveSession(): Unable to write session file", 1);
+		return;
+	}
+
+	bool ok = fchmod(fd, 0600) == 0;
+	size_t written = 0;
+	while (ok && written < contents.size()) {
+		ssize_t ret = write(fd, contents.data() + written, contents.size() - written);
+		if (ret < 0) {
+			if (EINTR == errno)
+				continue;
+			ok = false;
+			break;
+		}
+		written += ret;
+	}
+
+	if (close(fd) != 0)
+		ok = false;
+
+	if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+		unlink(tmpPath.c_str());
+		Client::log("ServerConnection/saveSession(): Unable to write session file", 1);
+	}
+}
+
+void ServerConnection::updateConnectionProfile() {
+
+	std::shared_ptr<connectionProfile> updated(new connectionProfile());
+	updated->jsonOutput = !client->getConf("http.json.output").compare("1");
+	updated->dataApiHeaderOutput = !client->getConf("http.data-api.header.output").compare("1");
+
+	if (client->getConf("http.proxy").compare("not found")) {
+		updated->proxy = client->getConf("http.proxy");
+		if (client->getConf("http.proxy.credentials").compare("not found"))
+			updated->proxyCredentials = client->getConf("http.proxy.credentials");
+	}
+
+	std::lock_guard<std::mutex> lock(profileMutex);
+	profile = updated;
+}
+
+std::shared_ptr<const connectionProfile> ServerConnection::getConnectionProfile() {
+	std::lock_guard<std::mutex> lock(profileMutex);
+	return profile;
+}
+
+void ServerConnection::applyConnectionOptions(CURL *pInHandle, const connectionProfile &pInProfile) {
+
+#ifdef WINDOWS
+	curl_easy_setopt(pInHandle, CURLOPT_CAINFO, "curl-ca-bundle.crt");
+#endif
+
+    if (!pInProfile.proxy.empty()) {
+        curl_easy_setopt(pInHandle, CURLOPT_PROXY, pInProfile.proxy.c_str());
+        if (!pInProfile.proxyCredentials.empty()) {
+            curl_easy_setopt(pInHandle, CURLOPT_PROXYUSERPWD, pInProfile.proxyCredentials.c_str());
+        }
+    }
+}
+
+void ServerConnection::lockShare(CURL *pInHandle, curl_lock_data pInData, curl_lock_access pInAccess, void *pInUserData) {
+	((ServerConnection*) pInUserData)->shareLocks[pInData].lock();
+}
+
+void ServerConnection::unlockShare(CURL *pInHandle, curl_lock_data pInData, void *pInUserData) {
+	((ServerConnection*) pInUserData)->shareLocks[pInData].unlock();
+}
+
+CURL *ServerConnection::acquireHandle() {
+
+	{
+		std::lock_guard<std::mutex> lock(handlePoolMutex);
+		if (!handlePool.empty()) {
+			CURL *handle = handlePool.back();
+			handlePool.pop_back();
+			return handle;
+		}
+	}
+
+	CURL *handle = curl_easy_init();
+	if (handle)
+		curl_easy_setopt(handle, CURLOPT_SHARE, share);
+	return handle;
+}
+
+void ServerConnection::releaseHandle(CURL *pInHandle) {
+
+	if (!pInHandle)
+		return;
+
+	// Options are cleared, the open connection and the share stay with the handle
+	curl_easy_reset(pInHandle);
+
+	std::lock_guard<std::mutex> lock(handlePoolMutex);
+	handlePool.push_back(pInHandle);
 }
 
 Json::Value ServerConnection::createRequestAuth() {
@@ -119,39 +485,48 @@ string ServerConnection::getAuthUsername() {
 // Exception is thrown whenever server returns an error object
 Json::Value ServerConnection::performServerJSONRequest(const Json::Value& pInServerRequest, bool pInAuthRequest) {
 
-	string jsonOutput = pInServerRequest.toStyledString();
+	Json::Value result;
+	performServerJSONRequestStreaming(pInServerRequest,
+			[&result](JsonStreamReader& pInReader) { result=pInReader.readValue(); },
+			pInAuthRequest);
+	return result;
+}
+
+// Exception is thrown whenever server returns an error object. The response envelope is walked without building
+// a DOM, only the error object (when present) is parsed into a Json::Value.
+void ServerConnection::performServerJSONRequestStreaming(const Json::Value& pInServerRequest,
+		const std::function<void (JsonStreamReader&)>& pInResultDecoder,
+		bool pInAuthRequest) {
+
+	Json::FastWriter writer;
+	string jsonOutput = writer.write(pInServerRequest);
 	if (jsonOutput.empty()) {
 		throw IllegalParameterException();
 	}
 
-	Json::Value root;
-	Json::Reader reader(Json::Features::all());
-
 	byte *requestBody=(byte*) jsonOutput.c_str();
 
-    // performServerCoreRequest will allocate response buffer and hand over ownership to us
+    // performRequest will take a response buffer from the pool and hand over ownership to us
 	byte *responseBody=0;
 	unsigned int responseBodyLength=0;
+	unsigned int responseBodyCapacity=0;
 
 	map<string, string> requestHeaders;
 	map<string, string> responseHeaders;
 
+	bool printJson=getConnectionProfile()->jsonOutput;
+
 	int attempts=2;
 	while (attempts>0) {
 
 		if (!pInAuthRequest)
 			ensureAuthenticatedState();
 
-		if (responseBody) {
-            delete[] responseBody;
-			responseBody=NULL;
-		}
-
 		responseBodyLength=0;
 		requestHeaders.clear();
 		responseHeaders.clear();
 
-        if (!client->getConf("http.json.output").compare("1")) {
+        if (printJson) {
 			stringstream ss;
 			ss << "JSON-REQUEST" << endl
 				<< "=============================================" << endl
@@ -159,42 +534,59 @@ Json::Value ServerConnection::performServerJSONRequest(const Json::Value& pInSer
 			Client::log(ss.str());
         }
 
-		performServerCoreRequest(requestHeaders,
+		performRequest(requestHeaders,
 				requestBody,
-				strlen((const char*) requestBody),
+				jsonOutput.size(),
 				responseHeaders,
 				&responseBody,
 				&responseBodyLength,
-				ELFCLOUD_INTERFACE_JSON);
+				&responseBodyCapacity,
+				ELFCLOUD_INTERFACE_JSON,
+				0,
+				0,
+				0);
 
 		attempts--;
 
-		string strBody((const char*) responseBody, responseBodyLength);
-
-        // Response body buffer can be released from the heap, we'll just keep the string copy for JSON parsing and error outputs
-        delete[] responseBody;
-        responseBody=NULL;
-
-		bool parsingSuccessful = reader.parse(strBody, root);
-
-		if (!parsingSuccessful) {
-			stringstream ss;
-			ss << "Failed to parse server JSON response: " << reader.getFormattedErrorMessages() << strBody;
-			Client::log(ss.str());
-            continue;
-		}
-
-        if (!client->getConf("http.json.output").compare("1")) {
+        if (printJson) {
 			stringstream ss;
 			ss << "JSON-RESPONSE" << endl
 				<< "=============================================" << endl
-                << root.toStyledString();
+                << string((const char*) responseBody, responseBodyLength);
 			Client::log(ss.str());
         }
 
-		Json::Value error=root.get("error", Json::Value().null);
+		// Walk the top level object: remember where the result value starts and parse the error object, if any
+		JsonStreamReader reader((const char*) responseBody, (const char*) responseBody+responseBodyLength);
+		const char *resultPos=0;
+		Json::Value error;
+
+		try {
+			string key;
+			reader.beginObject();
+			while (reader.nextMember(key)) {
+				if (!key.compare("result")) {
+					resultPos=reader.tell();
+					reader.skipValue();
+				} else if (!key.compare("error")) {
+					error=reader.readValue();
+				} else {
+					reader.skipValue();
+				}
+			}
+		} catch (Exception &e) {
+			stringstream ss;
+			ss << "Failed to parse server JSON response: " << e.getMsg() << string((const char*) responseBody, responseBodyLength);
+			Client::log(ss.str());
+			recycleBuffer(responseBody, responseBodyCapacity);
+			responseBody=NULL;
+            continue;
+		}
 
 		if (!error.isNull()) {
+			recycleBuffer(responseBody, responseBodyCapacity);
+			responseBody=NULL;
+
 			Json::Value errorId=error.get("code", Json::Value().null);
 			int errorNumber=errorId.asInt();
 
@@ -202,7 +594,10 @@ Json::Value ServerConnection::performServerJSONRequest(const Json::Value& pInSer
                 stringstream ss;
                 ss << "Server error " << errorNumber << ": " << error.get("message", Json::Value("n/a"));
 				Client::log(ss.str());
-				authenticated=false;
+				{
+					std::lock_guard<std::recursive_mutex> lock(authMutex);
+					authenticated=false;
+				}
 				continue;
 			} else {
                 stringstream ss;
@@ -211,20 +606,26 @@ Json::Value ServerConnection::performServerJSONRequest(const Json::Value& pInSer
                 throw elfcloud::Exception(ECSCI_EXC_BACKEND_EXCEPTION, ss.str());
 			}
 		} // if error element is present
-		else {
-			// No error element present
-            Json::Value::Members members=root.getMemberNames();
-            for (unsigned int i=0; i<members.size(); i++)
-                if (!members[i].compare("result")) {
-					stringstream ss;
-					ss << "Returning result from JSON query";
-					Client::log(ss.str(), 9);
-                    return root.get("result", Json::Value::null);
-				}
-            std::cout  << "No error or result element present in the server JSON response: " << strBody << endl;
+
+		if (!resultPos) {
+            std::cout  << "No error or result element present in the server JSON response: " << string((const char*) responseBody, responseBodyLength) << endl;
+			recycleBuffer(responseBody, responseBodyCapacity);
             throw Exception();
 		}
 
+		Client::log("Returning result from JSON query", 9);
+
+		// Response body buffer goes back to the pool also when the decoder throws
+		reader.seek(resultPos);
+		try {
+			pInResultDecoder(reader);
+		} catch (...) {
+			recycleBuffer(responseBody, responseBodyCapacity);
+			throw;
+		}
+		recycleBuffer(responseBody, responseBodyCapacity);
+		return;
+
 	} // while attempts remaining
 
 	throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Unknown error in SCI request processing, ran out of attempts");
@@ -262,8 +663,8 @@ void ServerConnection::setAuthPassword(const string& pInPassword) {
 	password = pInPassword;
 }
 
-// Upon successful return (no throw), pOutResponseBody will have a byte[] buffer pointer left
-// to be freed by the caller. Length of the buffer will be set to pOutResponseBodyLength. Response
+// Upon successful return (no throw), pOutResponseBody will have a malloc'd buffer pointer left
+// to be freed by the caller with free(). Length of the buffer will be set to pOutResponseBodyLength. Response
 // HTTP headers will be populated into the pOutMapResponseHeaders map.
 void ServerConnection::performServerCoreRequest(const map<string, string> &pInMapRequestHeaders,
 		const byte *pInRequestBody,
@@ -272,10 +673,31 @@ void ServerConnection::performServerCoreRequest(const map<string, string> &pInMa
 		byte **pOutResponseBody,
 		unsigned int *pOutResponseBodyLength,
 		const elfcloudInterfaceType pInInterfaceType,
-        shared_ptr<DataItemFilePassthrough> pInDataItem) {
+        shared_ptr<DataItemFilePassthrough> pInDataItem,
+        passthroughFetchState *pInOutFetchState,
+        requestTiming *pOutTiming) {
+
+    unsigned int responseBodyCapacity=0;
+    performRequest(pInMapRequestHeaders, pInRequestBody, pInBodyLength, pOutMapResponseHeaders,
+            pOutResponseBody, pOutResponseBodyLength, &responseBodyCapacity, pInInterfaceType, pInDataItem, pInOutFetchState,
+            pOutTiming);
+}
+
+void ServerConnection::performRequest(const map<string, string> &pInMapRequestHeaders,
+		const byte *pInRequestBody,
+		const unsigned int pInBodyLength,
+		map<string, string> &pOutMapResponseHeaders,
+		byte **pOutResponseBody,
+		unsigned int *pOutResponseBodyLength,
+		unsigned int *pOutResponseBodyCapacity,
+		const elfcloudInterfaceType pInInterfaceType,
+        shared_ptr<DataItemFilePassthrough> pInDataItem,
+        passthroughFetchState *pInOutFetchState,
+        requestTiming *pOutTiming) {
 
     (*pOutResponseBody)=NULL;
     (*pOutResponseBodyLength)=0;
+    (*pOutResponseBodyCapacity)=0;
     pOutMapResponseHeaders.clear();
 
 	if (!curl) {
@@ -283,71 +705,116 @@ void ServerConnection::performServerCoreRequest(const map<string, string> &pInMa
         throw Exception(ECSCI_EXC_INIT_OR_PARAM_FAILURE, "CURL library not initialized");
 	}
 
-	httpBuffer httpHeaderBuffer;
-	httpHeaderBuffer.bufferSize = 10000;
-	httpHeaderBuffer.buffer = new byte[httpHeaderBuffer.bufferSize];
-    httpHeaderBuffer.dataitem=pInDataItem;
+    // Wait for a request slot, interactive requests are admitted ahead of queued prefetch and background store
+    RequestPriority defaultPriority=ELFCLOUD_PRIORITY_METADATA;
+    if (ELFCLOUD_INTERFACE_FETCH==pInInterfaceType)
+        defaultPriority=ELFCLOUD_PRIORITY_FOREGROUND_FETCH;
+    else if (ELFCLOUD_INTERFACE_STORE==pInInterfaceType)
+        defaultPriority=ELFCLOUD_PRIORITY_BACKGROUND_STORE;
+    RequestScheduler::Admission admission(*client->getRequestScheduler(), RequestScheduler::getCurrentPriority(defaultPriority));
+    std::lock_guard<std::mutex> connectionLock(connectionMutex);
+
+    std::shared_ptr<const connectionProfile> currentProfile=getConnectionProfile();
+
+    // The request may have been abandoned while it was queued
+    CancelToken *cancelToken=CancelToken::getCurrent();
+    if (cancelToken && cancelToken->isCancelled()) {
+        if (pInOutFetchState)
+            pInOutFetchState->reset();
+        throw Exception(ECSCI_EXC_REQUEST_CANCELLED, "Request cancelled");
+    }
 
 	httpBuffer httpBodyBuffer;
-	httpBodyBuffer.bufferSize = 5000;
-	httpBodyBuffer.buffer = new byte[httpBodyBuffer.bufferSize];
     httpBodyBuffer.dataitem=pInDataItem;
     httpBodyBuffer.client=client;
+    httpBodyBuffer.cancelToken=cancelToken;
+
+	httpBuffer httpHeaderBuffer;
+    httpHeaderBuffer.dataitem=pInDataItem;
+    httpHeaderBuffer.bodyBuffer=&httpBodyBuffer;
+
+    // Continue an interrupted passthrough fetch from where the previous attempt got to
+    if (pInDataItem.get() && pInOutFetchState && pInOutFetchState->offset>0 && pInOutFetchState->cryptoHelper.get()) {
+        httpBodyBuffer.resumeOffset=pInOutFetchState->offset;
+        httpBodyBuffer.outputOffset=pInOutFetchState->offset;
+        httpBodyBuffer.cryptoHelper=pInOutFetchState->cryptoHelper;
+        httpBodyBuffer.stagedCiphertext=httpBodyBuffer.cryptoHelper->hasDecryptionStream();
+        httpHeaderBuffer.serverResponseHash=pInOutFetchState->serverResponseHash;
+    }
 
+	if (!acquireBuffer(&httpHeaderBuffer, 10000) || !acquireBuffer(&httpBodyBuffer, 5000)) {
+        recycleBuffer(&httpHeaderBuffer);
+        recycleBuffer(&httpBodyBuffer);
+        throw Exception(ECSCI_EXC_MEMORY_ALLOCATION_ERROR, "Unable to allocate response buffers");
+	}
+
+	// JSON requests carry no extra headers and share the per-connection header list, libcurl
+	// generates their Content-Length header from CURLOPT_POSTFIELDSIZE.
 	struct curl_slist *headers=NULL;
 	map<string, string>::const_iterator cit=pInMapRequestHeaders.begin();
 	while (cit!=pInMapRequestHeaders.end()) {
 		string headerRow=(*cit).first;
 		headerRow.append(": ");
 		headerRow.append((*cit).second);
-        if (pInInterfaceType!=ELFCLOUD_INTERFACE_JSON) {
-            if (!client->getConf("http.data-api.header.output").compare("1")) {
-				stringstream ss;
-				ss << "Data Item API request header: " << headerRow;
-				Client::log(ss.str(), 5);
-			}
+        if (pInInterfaceType!=ELFCLOUD_INTERFACE_JSON && currentProfile->dataApiHeaderOutput && Client::isLogged(5)) {
+			stringstream ss;
+			ss << "Data Item API request header: " << headerRow;
+			Client::log(ss.str(), 5);
         }
 		headers = curl_slist_append(headers, headerRow.c_str());
 		cit++;
 	}
 
-	char tmpBuffer[4096];
-	sprintf(tmpBuffer, "Content-Length: %u", pInBodyLength);
-	headers = curl_slist_append(headers, tmpBuffer);
+	if (pInInterfaceType!=ELFCLOUD_INTERFACE_JSON) {
+		char contentLength[32];
+		snprintf(contentLength, sizeof(contentLength), "Content-Length: %u", pInBodyLength);
+		headers = curl_slist_append(headers, contentLength);
+	}
+
+	// No "Expect: 100-continue" for uploads, the server does not reject requests before the body arrives
+	if (headers)
+		headers = curl_slist_append(headers, "Expect:");
 
 	curl_easy_reset(curl);
 
 	switch (pInInterfaceType) {
     	case ELFCLOUD_INTERFACE_JSON: {
-    		headers = curl_slist_append(headers, "Content-type: application/json; charset=utf-8");
+    		if (headers)
+    			headers = curl_slist_append(headers, "Content-type: application/json; charset=utf-8");
     		curl_easy_setopt(curl, CURLOPT_URL, address.c_str());
-			stringstream ss;
-			ss << "Sending JSON request of " << pInBodyLength << " bytes to URL " << address.c_str();
-			Client::log(ss.str(), 3);
+			if (Client::isLogged(3)) {
+				stringstream ss;
+				ss << "Sending JSON request of " << pInBodyLength << " bytes to URL " << address.c_str();
+				Client::log(ss.str(), 3);
+			}
     		break;
     	}
     	case ELFCLOUD_INTERFACE_STORE: {
     		headers = curl_slist_append(headers, "Content-type: application/octet-stream");
     		curl_easy_setopt(curl, CURLOPT_URL, dataItemAPIStoreAddress.c_str());
-			stringstream ss;
-			ss << "Sending STORE request of " << pInBodyLength << " bytes to URL " << dataItemAPIStoreAddress.c_str();
-			Client::log(ss.str(), 3);
+			if (Client::isLogged(3)) {
+				stringstream ss;
+				ss << "Sending STORE request of " << pInBodyLength << " bytes to URL " << dataItemAPIStoreAddress.c_str();
+				Client::log(ss.str(), 3);
+			}
     		break;
     	}
     	case ELFCLOUD_INTERFACE_FETCH: {
     		headers = curl_slist_append(headers, "Content-type: application/octet-stream");
     		curl_easy_setopt(curl, CURLOPT_URL, dataItemAPIFetchAddress.c_str());
 
-			stringstream ss;
-			ss << "Sending FETCH request of " << pInBodyLength << " bytes to URL " << dataItemAPIFetchAddress.c_str();
-			Client::log(ss.str(), 3);
+			if (Client::isLogged(3)) {
+				stringstream ss;
+				ss << "Sending FETCH request of " << pInBodyLength << " bytes to URL " << dataItemAPIFetchAddress.c_str();
+				Client::log(ss.str(), 3);
+			}
 
     		break;
     	}
     	default: {
             curl_slist_free_all(headers);
-            deleteBufferChain(&httpHeaderBuffer);
-            deleteBufferChain(&httpBodyBuffer);
+            recycleBuffer(&httpHeaderBuffer);
+            recycleBuffer(&httpBodyBuffer);
 			Client::log("ServerConnection/performServerCoreRequest(): Bad interface type specified");
     		throw Exception(ECSCI_EXC_INIT_OR_PARAM_FAILURE, "Bad interface type specified");
         }
@@ -356,30 +823,33 @@ void ServerConnection::performServerCoreRequest(const map<string, string> &pInMa
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, pInRequestBody);
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, pInBodyLength);
 	curl_easy_setopt(curl, CURLOPT_COOKIEFILE, "");
-	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ServerConnection::write_data);
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &httpBodyBuffer);
     curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, ServerConnection::write_header);
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, &httpHeaderBuffer);
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-    if (speedLimitReceive>0) {
-        curl_off_t limit=speedLimitReceive;
-        curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE, limit);
-    }
-    if (speedLimitSend>0) {
-        curl_off_t limit=speedLimitSend;
-        curl_easy_setopt(curl, CURLOPT_MAX_SEND_SPEED_LARGE, limit);
-    }
-
-#ifdef WINDOWS
-	curl_easy_setopt(curl, CURLOPT_CAINFO, "curl-ca-bundle.crt");
-#endif
-
-    if (client->getConf("http.proxy").compare("not found")) {
-        curl_easy_setopt(curl, CURLOPT_PROXY, client->getConf("http.proxy").c_str());
-        if (client->getConf("http.proxy.credentials").compare("not found")) {
-            curl_easy_setopt(curl, CURLOPT_PROXYUSERPWD, client->getConf("http.proxy.credentials").c_str());
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers ? headers : jsonRequestHeaders);
+
+    // Speed limits are shared by all transfers of the process and enforced from the progress callback,
+    // which also aborts the transfer when the request is cancelled
+    BandwidthScheduler::Transfer bandwidthTransfer(ELFCLOUD_INTERFACE_FETCH!=pInInterfaceType, ELFCLOUD_INTERFACE_STORE!=pInInterfaceType);
+    transferProgress progress;
+    progress.bandwidthTransfer=&bandwidthTransfer;
+    progress.cancelToken=httpBodyBuffer.cancelToken;
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ServerConnection::xferinfo);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &progress);
+
+    applyConnectionOptions(curl, *currentProfile);
+
+    if (httpBodyBuffer.resumeOffset>0) {
+        char range[32];
+        snprintf(range, sizeof(range), "%llu-", (long long unsigned int) httpBodyBuffer.resumeOffset);
+        curl_easy_setopt(curl, CURLOPT_RANGE, range);
+
+        if (Client::isLogged(3)) {
+            stringstream ss;
+            ss << "ServerConnection/performServerCoreRequest(): Resuming passthrough fetch at byte " << httpBodyBuffer.resumeOffset;
+            Client::log(ss.str(), 3);
         }
     }
 
@@ -391,14 +861,80 @@ void ServerConnection::performServerCoreRequest(const map<string, string> &pInMa
 		Client::log(ss.str(), 1);
         curl_slist_free_all(headers);
 
-        deleteBufferChain(&httpHeaderBuffer);
-        deleteBufferChain(&httpBodyBuffer);
+        bool outputOk=closeOutputFile(&httpBodyBuffer);
+
+        if (CURLE_ABORTED_BY_CALLBACK==res) {
+            if (pInOutFetchState)
+                pInOutFetchState->reset();
+            recycleBuffer(&httpHeaderBuffer);
+            recycleBuffer(&httpBodyBuffer);
+            throw Exception(ECSCI_EXC_REQUEST_CANCELLED, "Request cancelled");
+        }
+
+        // Everything received so far is on disk, remember the position for a ranged retry
+        if (pInOutFetchState) {
+            // The ranged request continues at a ciphertext offset, which for compressed content does not
+            // match the output file position
+            if (outputOk && !httpBodyBuffer.outputFailed && httpBodyBuffer.cryptoHelper.get() && !httpBodyBuffer.compressionHelper.get()) {
+                pInOutFetchState->offset=httpBodyBuffer.outputOffset;
+                pInOutFetchState->cryptoHelper=httpBodyBuffer.cryptoHelper;
+                pInOutFetchState->serverResponseHash=httpHeaderBuffer.serverResponseHash;
+            } else {
+                pInOutFetchState->reset();
+            }
+        }
+
+        recycleBuffer(&httpHeaderBuffer);
+        recycleBuffer(&httpBodyBuffer);
 
-        throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Error performing HTTP operation (libcurl)");
+        // Transport failure, the only kind of failure worth retrying
+        throw Exception(ECSCI_EXC_NETWORK_CONNECTION_FAILED, "Error performing HTTP operation (libcurl)");
     } else {
-        stringstream ss;
-		ss << "ServerConnection/performServerCoreRequest(): CURL OK";
-		Client::log(ss.str(), 9);
+		Client::log("ServerConnection/performServerCoreRequest(): CURL OK", 9);
+    }
+
+    if (pOutTiming) {
+        long newConnections=0;
+        double connectTime=0, nameLookupTime=0;
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &pOutTiming->totalSeconds);
+        curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &newConnections);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connectTime);
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &nameLookupTime);
+        // The TCP handshake takes one round trip
+        pOutTiming->rttSeconds=newConnections>0 && connectTime>nameLookupTime ? connectTime-nameLookupTime : 0;
+    }
+
+    // The transfer completed, a retry after a failure below has to start over
+    if (pInOutFetchState)
+        pInOutFetchState->reset();
+
+    if (pInDataItem.get()) {
+        // Passthrough fetch, write out the remaining staged data and release the target file
+        bool outputOk=closeOutputFile(&httpBodyBuffer);
+
+        if (Client::isLogged(3)) {
+            double totalTime=0, downloadSpeed=0;
+            curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &totalTime);
+            curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD, &downloadSpeed);
+            stringstream ss;
+            ss << "ServerConnection/performServerCoreRequest(): Passthrough fetch wrote " << httpBodyBuffer.outputOffset
+               << " bytes in " << totalTime << " s (" << (uint64_t) downloadSpeed << " B/s)";
+            Client::log(ss.str(), 3);
+        }
+
+        if (!outputOk) {
+            curl_slist_free_all(headers);
+            recycleBuffer(&httpHeaderBuffer);
+            recycleBuffer(&httpBodyBuffer);
+            throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Unable to write passthrough fetch target file");
+        }
+
+        if (httpBodyBuffer.compressionHelper.get() && !httpBodyBuffer.compressionHelper->isStreamFinished()) {
+            curl_slist_free_all(headers);
+            recycleBuffer(&httpHeaderBuffer);
+            recycleBuffer(&httpBodyBuffer);
+            throw Exception(ECSCI_EXC_COMPRESSION_ERROR, "Compressed data item content ended prematurely");
+        }
     }
 
     if (ELFCLOUD_INTERFACE_FETCH==pInInterfaceType && httpBodyBuffer.cryptoHelper.get() && httpHeaderBuffer.serverResponseHash.size()) {
@@ -409,28 +945,15 @@ void ServerConnection::performServerCoreRequest(const map<string, string> &pInMa
             stringstream ss;
             ss << "Passthrough fetch X-ELFCLOUD-HASH mismatch, local: " << calculatedHash << ", remote: " << httpHeaderBuffer.serverResponseHash;
             Client::log(ss.str(), 1);
+            curl_slist_free_all(headers);
+            recycleBuffer(&httpHeaderBuffer);
+            recycleBuffer(&httpBodyBuffer);
             throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Data item hash mismatch during passthrough fetch processing");
         }
     }
 
-    // Merge allocated header and body fragments into single buffers. If there are no "next buffers" in the chains, let's not bother,
-    // there may be some extra space in the buffers but bytesUsed will indicate the length consumed.
-    {
-        if (httpHeaderBuffer.nextBuffer) {
-            httpBuffer httpMergedHeader=mergeBufferChain(httpHeaderBuffer);
-            deleteBufferChain(&httpHeaderBuffer);
-            httpHeaderBuffer=httpMergedHeader;
-        }
-
-        if (httpBodyBuffer.nextBuffer) {
-            httpBuffer httpMergedBody=mergeBufferChain(httpBodyBuffer);
-            deleteBufferChain(&httpBodyBuffer);
-            httpBodyBuffer=httpMergedBody;
-        }
-    }
-
 	if (pInInterfaceType!=ELFCLOUD_INTERFACE_JSON) {
-        if (!client->getConf("http.data-api.header.output").compare("1")) {
+        if (currentProfile->dataApiHeaderOutput && Client::isLogged(6)) {
 			stringstream ss;
             ss << "ServerConnection/performServerCoreRequest(): DATA ITEM API RESPONSE HEADERS" << endl
                  << "=============================================" << endl
@@ -448,21 +971,416 @@ void ServerConnection::performServerCoreRequest(const map<string, string> &pInMa
     (*pOutResponseBody) = httpBodyBuffer.buffer;
     (*pOutResponseBodyLength) = httpBodyBuffer.bytesUsed;
 
-	{
+    (*pOutResponseBodyCapacity) = httpBodyBuffer.bufferSize;
+
+	if (Client::isLogged(5)) {
 		stringstream ss;
 		ss << "ServerConnection/performServerCoreRequest(): Response HTTP body length " << httpBodyBuffer.bytesUsed;
 		Client::log(ss.str(), 5);
 	}
 
-	deleteBufferChain(&httpHeaderBuffer);
+	recycleBuffer(&httpHeaderBuffer);
+}
+
+bool ServerConnection::performStripedFetchRequest(const map<string, string> &pInMapRequestHeaders,
+        shared_ptr<DataItemFilePassthrough> pInDataItem,
+        const uint64_t pInTotalLength,
+        const unsigned int pInStripes,
+        const string& pInExpectedHash,
+        map<string, string> &pOutMapResponseHeaders) {
+
+    pOutMapResponseHeaders.clear();
+
+    // Every range after the first needs the 16 ciphertext bytes before it
+    if (pInStripes<2 || pInTotalLength<(uint64_t) pInStripes*CryptoHelper::feedbackRegisterSize) {
+        throw Exception(ECSCI_EXC_INIT_OR_PARAM_FAILURE, "Bad striped fetch parameters");
+    }
+
+    ensureAuthenticatedState();
+
+    // Worker threads do not inherit the priority tag of the caller
+    RequestPriority priority=RequestScheduler::getCurrentPriority(ELFCLOUD_PRIORITY_FOREGROUND_FETCH);
+
+    // Ranges stop when the caller gives up or when another range has failed for good
+    CancelToken *callerToken=CancelToken::getCurrent();
+    CancelToken fetchToken;
+    fetchToken.setCheck([callerToken]() { return callerToken && callerToken->isCancelled(); });
+
+    if (fetchToken.isCancelled()) {
+        throw Exception(ECSCI_EXC_REQUEST_CANCELLED, "Request cancelled");
+    }
+
+    unsigned int maxRetries=5;
+    if (client->getConf("http.fetch.retries").compare("not found")) {
+        maxRetries=strtoul(client->getConf("http.fetch.retries").c_str(), 0, 10);
+    }
+
+    int fd=open(pInDataItem->getFilePath().c_str(), O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd<0) {
+        throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Unable to open passthrough fetch target file");
+    }
+
+    if (ftruncate(fd, (off_t) pInTotalLength)!=0) {
+        close(fd);
+        throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Unable to size passthrough fetch target file");
+    }
+
+    std::vector<fetchStripe> stripes(pInStripes);
+    for (unsigned int i=0; i<pInStripes; i++) {
+        stripes[i].begin=pInTotalLength*i/pInStripes;
+        stripes[i].length=pInTotalLength*(i+1)/pInStripes-stripes[i].begin;
+        stripes[i].fd=fd;
+        stripes[i].cancelToken=&fetchToken;
+        stripes[i].priority=priority;
+    }
+
+    if (Client::isLogged(3)) {
+        stringstream ss;
+        ss << "ServerConnection/performStripedFetchRequest(): Fetching " << pInTotalLength << " bytes in " << pInStripes << " ranges";
+        Client::log(ss.str(), 3);
+    }
+
+    std::chrono::steady_clock::time_point started=std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned int i=0; i<pInStripes; i++)
+        workers.push_back(std::thread(&ServerConnection::fetchRange, this, &stripes[i], std::cref(pInMapRequestHeaders), maxRetries));
+    for (unsigned int i=0; i<workers.size(); i++)
+        workers[i].join();
+
+    // Ranges aborted because of another failed range report cancellation, the original failure is reported instead
+    const fetchStripe *failedStripe=0;
+    bool rangeIgnored=false;
+    for (unsigned int i=0; i<pInStripes; i++) {
+        rangeIgnored|=stripes[i].rangeIgnored;
+        if (stripes[i].failed && (!failedStripe || ECSCI_EXC_REQUEST_CANCELLED==failedStripe->errorCode))
+            failedStripe=&stripes[i];
+    }
+
+    if (failedStripe) {
+        close(fd);
+        if (callerToken && callerToken->isCancelled())
+            throw Exception(ECSCI_EXC_REQUEST_CANCELLED, "Request cancelled");
+        if (rangeIgnored) {
+            Client::log("ServerConnection/performStripedFetchRequest(): Ranged fetch not supported by server", 3);
+            return false;
+        }
+        throw Exception(failedStripe->errorCode, failedStripe->errorMessage);
+    }
+
+    // Meta data and hash of the first response describe the whole data item
+    std::map<string, string> elfcloudHeaders;
+    httpBuffer headerBuffer;
+    headerBuffer.buffer=(unsigned char*) stripes[0].headers.data();
+    headerBuffer.bytesUsed=stripes[0].headers.size();
+    parseHeader(elfcloudHeaders, pOutMapResponseHeaders, &headerBuffer);
+    headerBuffer.buffer=0;
+
+    std::map<string, string>::iterator it=elfcloudHeaders.find("X-ELFCLOUD-META");
+    if (it!=elfcloudHeaders.end()) {
+        string headerStr((*it).second);
+        pInDataItem->parseMetaDataString(headerStr);
+    }
+
+    std::map<std::string, std::string> metaKV=pInDataItem->getMetaHeaderKVPairs();
+    string enc=metaKV["ENC"];
+    string kha=metaKV["KHA"];
+
+    // Compressed content can only be decompressed as one stream from the beginning
+    if (metaKV["CMP"].size()) {
+        close(fd);
+        Client::log("ServerConnection/performStripedFetchRequest(): Data item is compressed, ranges cannot be decrypted separately", 3);
+        return false;
+    }
+
+    if (!enc.size() || !kha.size()) {
+        close(fd);
+        throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Data item is missing encryption information in the meta header");
+    }
+
+    std::vector<byte> buffer(passthroughWriteBufferSize);
+
+    // End-to-end check over the assembled ciphertext
+    string expectedHash=pInExpectedHash;
+    it=elfcloudHeaders.find("X-ELFCLOUD-HASH");
+    if (it!=elfcloudHeaders.end())
+        expectedHash=(*it).second;
+
+    if (expectedHash.size()) {
+        Weak::MD5 md5;
+        for (uint64_t offset=0; offset<pInTotalLength; ) {
+            size_t chunk=pInTotalLength-offset<buffer.size() ? (size_t) (pInTotalLength-offset) : buffer.size();
+            if (!readFully(fd, &buffer[0], chunk, offset)) {
+                close(fd);
+                throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Unable to read passthrough fetch target file");
+            }
+            md5.Update(&buffer[0], chunk);
+            offset+=chunk;
+
+            if (fetchToken.isCancelled()) {
+                close(fd);
+                throw Exception(ECSCI_EXC_REQUEST_CANCELLED, "Request cancelled");
+            }
+        }
+
+        byte digest[Weak::MD5::DIGESTSIZE];
+        md5.Final(digest);
+        string calculatedHash=CryptoHelper::byteArrayToHexString(digest, Weak::MD5::DIGESTSIZE);
+
+        if (calculatedHash.compare(expectedHash)) {
+            stringstream ss;
+            ss << "Striped fetch X-ELFCLOUD-HASH mismatch, local: " << calculatedHash << ", remote: " << expectedHash;
+            Client::log(ss.str(), 1);
+            close(fd);
+            // The listing the fetch was planned from may be stale, the caller fetches the item as one stream instead
+            return false;
+        }
+    }
+
+    if (enc.compare("NONE")) {
+        KeyHint kHint(ECSCI_HASHALG_MD5, kha, CryptoHelper::getEncryptionAlgorithm(enc));
+        pInDataItem->setKeyHint(&kHint);
+
+        // Shared with the key ring, no copy of the key is made
+        shared_ptr<const elfcloud::Key> key;
+        try {
+            key=client->getKeyRing()->getSharedCipherKey(kHint);
+        } catch (...) {
+            close(fd);
+            stringstream ss;
+            ss << "Decryption key for hash " << kha << " and mode " << enc << " could not be found";
+            throw Exception(ECSCI_EXC_KEYMGMT_KEY_NOT_FOUND, ss.str());
+        }
+
+        // CTR ranges start from the counter block of the data item, CFB8 seeds are read before any range is decrypted in place
+        ECCipherMode mode=pInDataItem->getCipherMode();
+        for (unsigned int i=0; i<pInStripes && ECSCI_CIPHERMODE_CTR==mode; i++) {
+            stripes[i].cipherMode=mode;
+            if (!pInDataItem->getCipherIV(stripes[i].feedbackRegister)) {
+                close(fd);
+                throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Data item is missing the initial counter block in the meta header");
+            }
+        }
+        for (unsigned int i=1; i<pInStripes && ECSCI_CIPHERMODE_CFB8==mode; i++) {
+            if (!readFully(fd, stripes[i].feedbackRegister, CryptoHelper::feedbackRegisterSize, stripes[i].begin-CryptoHelper::feedbackRegisterSize)) {
+                close(fd);
+                throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Unable to read passthrough fetch target file");
+            }
+        }
+
+        workers.clear();
+        for (unsigned int i=0; i<pInStripes; i++)
+            workers.push_back(std::thread(&ServerConnection::decryptRange, &stripes[i], key.get()));
+        for (unsigned int i=0; i<workers.size(); i++)
+            workers[i].join();
+
+        for (unsigned int i=0; i<pInStripes; i++) {
+            if (stripes[i].failed) {
+                close(fd);
+                throw Exception(stripes[i].errorCode, stripes[i].errorMessage);
+            }
+        }
+    }
+
+    if (close(fd)!=0) {
+        throw Exception(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Unable to write passthrough fetch target file");
+    }
+
+    pInDataItem->setDataLength(pInTotalLength);
+
+    if (Client::isLogged(3)) {
+        double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-started).count();
+        stringstream ss;
+        ss << "ServerConnection/performStripedFetchRequest(): Striped fetch wrote " << pInTotalLength << " bytes in " << seconds << " s";
+        Client::log(ss.str(), 3);
+    }
+
+    return true;
+}
+
+void ServerConnection::fetchRange(fetchStripe *pInOutStripe, const map<string, string> &pInMapRequestHeaders, const unsigned int pInMaxRetries) {
+
+    CancelToken::Scope cancelScope(*pInOutStripe->cancelToken);
+
+    // Each range is a request of its own, with a single request slot the ranges are fetched one after another
+    std::unique_ptr<RequestScheduler::Admission> admission;
+    try {
+        admission.reset(new RequestScheduler::Admission(*client->getRequestScheduler(), pInOutStripe->priority));
+    } catch (Exception &e) {
+        pInOutStripe->fail(e.getCode(), e.getMsg());
+        pInOutStripe->cancelToken->cancel();
+        return;
+    }
+
+    CURL *handle=acquireHandle();
+    if (!handle) {
+        pInOutStripe->fail(ECSCI_EXC_INIT_OR_PARAM_FAILURE, "CURL library not initialized");
+        pInOutStripe->cancelToken->cancel();
+        return;
+    }
+
+    std::shared_ptr<const connectionProfile> currentProfile=getConnectionProfile();
+
+    struct curl_slist *headers=NULL;
+    map<string, string>::const_iterator cit=pInMapRequestHeaders.begin();
+    while (cit!=pInMapRequestHeaders.end()) {
+        string headerRow=(*cit).first;
+        headerRow.append(": ");
+        headerRow.append((*cit).second);
+        headers=curl_slist_append(headers, headerRow.c_str());
+        cit++;
+    }
+    headers=curl_slist_append(headers, "Content-Length: 0");
+    headers=curl_slist_append(headers, "Expect:");
+    headers=curl_slist_append(headers, "Content-type: application/octet-stream");
+
+    unsigned int failures=0;
+    while (pInOutStripe->received<pInOutStripe->length) {
+        uint64_t receivedBefore=pInOutStripe->received;
+
+        char range[64];
+        snprintf(range, sizeof(range), "%llu-%llu", (long long unsigned int) (pInOutStripe->begin+pInOutStripe->received),
+                (long long unsigned int) (pInOutStripe->begin+pInOutStripe->length-1));
+
+        curl_easy_reset(handle);
+        curl_easy_setopt(handle, CURLOPT_URL, dataItemAPIFetchAddress.c_str());
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDS, "");
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, 0L);
+        curl_easy_setopt(handle, CURLOPT_COOKIEFILE, "");
+        curl_easy_setopt(handle, CURLOPT_RANGE, range);
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, writeStripeData);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, pInOutStripe);
+        curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, writeStripeHeader);
+        curl_easy_setopt(handle, CURLOPT_HEADERDATA, pInOutStripe);
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
+
+        BandwidthScheduler::Transfer bandwidthTransfer(false, true);
+        transferProgress progress;
+        progress.bandwidthTransfer=&bandwidthTransfer;
+        progress.cancelToken=pInOutStripe->cancelToken;
+        curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, ServerConnection::xferinfo);
+        curl_easy_setopt(handle, CURLOPT_XFERINFODATA, &progress);
+
+        applyConnectionOptions(handle, *currentProfile);
+
+        pInOutStripe->status=0;
+        pInOutStripe->headers.clear();
+        CURLcode result=curl_easy_perform(handle);
+
+        if (CURLE_OK==result && pInOutStripe->received==pInOutStripe->length)
+            break;
+
+        if (CURLE_ABORTED_BY_CALLBACK==result) {
+            pInOutStripe->fail(ECSCI_EXC_REQUEST_CANCELLED, "Request cancelled");
+            break;
+        }
+
+        // A complete answer other than the requested range will not change on retry
+        if (pInOutStripe->status && 206!=pInOutStripe->status) {
+            stringstream ss;
+            ss << "Range request answered with HTTP status " << pInOutStripe->status;
+            pInOutStripe->rangeIgnored=200==pInOutStripe->status;
+            pInOutStripe->fail(ECSCI_EXC_REQUEST_PROCESSING_FAILED, ss.str());
+            pInOutStripe->cancelToken->cancel();
+            break;
+        }
+
+        if (pInOutStripe->received>receivedBefore)
+            failures=0;
+
+        if (failures>=pInMaxRetries) {
+            stringstream ss;
+            ss << "Error performing HTTP operation (libcurl), range " << range << " failed with CURL error code " << result;
+            pInOutStripe->fail(ECSCI_EXC_NETWORK_CONNECTION_FAILED, ss.str());
+            pInOutStripe->cancelToken->cancel();
+            break;
+        }
+
+        unsigned int delaySeconds=1<<(failures<6 ? failures : 6);
+        failures++;
+
+        stringstream ss;
+        ss << "ServerConnection/fetchRange(): Range " << range << " failed at byte " << pInOutStripe->begin+pInOutStripe->received
+           << " (CURL error code " << result << "), retrying in " << delaySeconds << " s";
+        Client::log(ss.str(), 1);
+        std::this_thread::sleep_for(std::chrono::seconds(delaySeconds));
+    }
+
+    curl_slist_free_all(headers);
+    releaseHandle(handle);
+}
+
+void ServerConnection::decryptRange(fetchStripe *pInOutStripe, const Key *pInKey) {
+
+    CryptoHelper cryptoHelper;
+    // The ciphertext hash has been checked over the whole item already
+    bool started;
+    if (ECSCI_CIPHERMODE_CTR==pInOutStripe->cipherMode)
+        started=cryptoHelper.decryptDataStreamBegin(pInKey, pInOutStripe->feedbackRegister, 0, pInOutStripe->cipherMode, pInOutStripe->begin);
+    else
+        started=cryptoHelper.decryptDataStreamBegin(pInKey, pInOutStripe->begin>0 ? pInOutStripe->feedbackRegister : 0, 0);
+    if (!started) {
+        pInOutStripe->fail(ECSCI_EXC_ENCRYPTION_ERROR, "Unsupported cipher, cannot decrypt striped fetch");
+        return;
+    }
+
+    std::vector<byte> buffer(passthroughWriteBufferSize);
+    for (uint64_t done=0; done<pInOutStripe->length; ) {
+        size_t chunk=pInOutStripe->length-done<buffer.size() ? (size_t) (pInOutStripe->length-done) : buffer.size();
+        const uint64_t offset=pInOutStripe->begin+done;
+
+        if (!readFully(pInOutStripe->fd, &buffer[0], chunk, offset)
+                || !cryptoHelper.decryptDataStreamContinue(&buffer[0], &buffer[0], chunk)
+                || !writeFully(pInOutStripe->fd, &buffer[0], chunk, offset)) {
+            pInOutStripe->fail(ECSCI_EXC_REQUEST_PROCESSING_FAILED, "Decryption of striped fetch target file failed");
+            return;
+        }
+        done+=chunk;
+    }
+}
+
+int ServerConnection::xferinfo(void *userData, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    transferProgress *progress=(transferProgress*) userData;
+
+    // Checked on both sides of a bandwidth limit wait, any non-zero return aborts the transfer
+    if (progress->cancelToken && progress->cancelToken->isCancelled())
+        return 1;
+
+    progress->bandwidthTransfer->update((uint64_t) ulnow, (uint64_t) dlnow);
+
+    return progress->cancelToken && progress->cancelToken->isCancelled() ? 1 : 0;
 }
 
 size_t ServerConnection::write_header(void *ptr, size_t size, size_t nmemb, void *userData) {
 
 	httpBuffer* httpBuf = (httpBuffer*) userData;
 
+    // A ranged request answered with the whole data item, start the passthrough output over
+    if (httpBuf->bodyBuffer && httpBuf->bodyBuffer->resumeOffset>0 && size*nmemb>12 && strncmp("HTTP/", (const char*) ptr, 5)==0) {
+        const char *status=(const char*) memchr(ptr, ' ', size*nmemb);
+        if (status && strncmp(status, " 206", 4) && strncmp(status, " 100", 4)) {
+            Client::log("ServerConnection/write_header(): Ranged fetch not supported by server, fetching whole data item", 3);
+            httpBuf->bodyBuffer->resumeOffset=0;
+            httpBuf->bodyBuffer->outputOffset=0;
+            httpBuf->bodyBuffer->cryptoHelper.reset();
+            httpBuf->serverResponseHash.clear();
+        }
+    }
+
     // When dataitem has been defined, parse and populate metaheader http response header immediately when received.
     // This is required for passthrough dataitem fetch processing, when decryption is done already in curl callback function.
+    if (!httpBuf->dataitem.get() && httpBuf->bodyBuffer) {
+        // Reserve the whole response body up front so that write_data() does not need to grow the buffer
+        const size_t contentLengthLen=strlen("Content-Length: ");
+        if (size*nmemb>contentLengthLen && strncasecmp("Content-Length: ", (const char*) ptr, contentLengthLen)==0) {
+            string value((const char*) ptr+contentLengthLen, size*nmemb-contentLengthLen);
+            unsigned long long contentLength=strtoull(value.c_str(), NULL, 10);
+            if (contentLength>0 && contentLength<UINT_MAX)
+                reserveBuffer(httpBuf->bodyBuffer, (size_t) contentLength);
+        }
+    }
+
     if (httpBuf->dataitem.get()) {
         char temp[size*nmemb+1];
         memset(temp, 0, size*nmemb+1);
@@ -477,6 +1395,13 @@ size_t ServerConnection::write_header(void *ptr, size_t size, size_t nmemb, void
 
         const unsigned int xMetaLen=strlen("X-ELFCLOUD-META: ");
         const unsigned int xHashLen=strlen("X-ELFCLOUD-HASH: ");
+        const unsigned int contentLengthLen=strlen("Content-Length: ");
+
+        if (strlen(temp)>contentLengthLen && strncasecmp("Content-Length: ", temp, contentLengthLen)==0) {
+            // Ciphertext and plaintext are of equal length, the size is used to preallocate the target file.
+            // A ranged response carries only the remaining part.
+            httpBuf->dataitem->setDataLength(httpBuf->bodyBuffer->resumeOffset+strtoull(&temp[contentLengthLen], NULL, 10));
+        }
 
         if (strlen(temp)>xMetaLen && strncmp("X-ELFCLOUD-META: ", temp, xMetaLen)==0) {
             // X-ELFCLOUD-META: v1:ENC:AES256:KHA:2cb40902eab770edbe7a2e57506bb467:DSC:::
@@ -484,55 +1409,15 @@ size_t ServerConnection::write_header(void *ptr, size_t size, size_t nmemb, void
             httpBuf->dataitem->parseMetaDataString(headerStr);
         }
 
-        if (strlen(temp)>xHashLen && strncmp("X-ELFCLOUD-HASH: ", temp, xHashLen)==0) {
+        // Hash of the whole data item, a resumed fetch keeps the one received with the first response
+        if (strlen(temp)>xHashLen && strncmp("X-ELFCLOUD-HASH: ", temp, xHashLen)==0 && !httpBuf->serverResponseHash.size()) {
             // X-ELFCLOUD-HASH: ffc0b831c421f9ca6eceb1ae0a73434e
             httpBuf->serverResponseHash.assign(&temp[xHashLen]);
         }
 
     }
 
-	while (httpBuf->nextBuffer!=0) {
-		httpBuf = httpBuf->nextBuffer;
-	}
-
-	size_t freeBufferMemory = 0;
-	freeBufferMemory = httpBuf->bufferSize - httpBuf->bytesUsed;
-
-	if ((size*nmemb) <= freeBufferMemory) {
-		memcpy(&httpBuf->buffer[httpBuf->bytesUsed], ptr, size*nmemb);
-		httpBuf->bytesUsed += size*nmemb;
-	} else {
-		memcpy(&httpBuf->buffer[httpBuf->bytesUsed], ptr, freeBufferMemory);
-		httpBuf->bytesUsed += freeBufferMemory;
-
-		httpBuf->nextBuffer = new httpBuffer;
-		httpBuf->nextBuffer->nextBuffer = NULL;
-
-		httpBuf->nextBuffer->bufferSize = 50000;
-		if ((size*nmemb)>(httpBuf->nextBuffer->bufferSize-5000)) {
-			httpBuf->nextBuffer->bufferSize += (size*nmemb);
-		}
-
-		httpBuf->nextBuffer->bytesUsed = 0;
-		httpBuf->nextBuffer->buffer = new byte[httpBuf->nextBuffer->bufferSize];
-
-        if (0==httpBuf->nextBuffer->buffer) {
-            // Failed to allocate new chained buffer, remove references to new buffer and return only the amount of bytes cleared
-            // that got copied into the original last buffer in the chain.
-            delete httpBuf->nextBuffer;
-            httpBuf->nextBuffer=NULL;
-
-            // Returns to CURL the number of bytes copied to original buffer, the rest cannot be accepted. Original buffer is now full.
-            return freeBufferMemory;
-        }
-
-        // All provided data has been copied. The function will return with "all given bytes copied" status.
-        memcpy(&httpBuf->nextBuffer->buffer[httpBuf->nextBuffer->bytesUsed],
-               (void*) ((unsigned long) ptr+freeBufferMemory), (size*nmemb)-freeBufferMemory);
-		httpBuf->nextBuffer->bytesUsed += ((size*nmemb)-freeBufferMemory);
-	}
-
-	return size*nmemb;
+	return appendToBuffer(httpBuf, ptr, size*nmemb);
 }
 
 size_t ServerConnection::write_data(void *ptr, size_t size, size_t nmemb, void *userData) {
@@ -552,102 +1437,231 @@ size_t ServerConnection::write_data(void *ptr, size_t size, size_t nmemb, void *
 
             if (!enc.size() || !kha.size()) {
                 Client::log("Data item is missing encryption information in the meta header, cannot process passthrough fetch write", 1);
+                httpBuf->outputFailed=true;
                 return 0;
             }
 
-            std::ofstream outputStream(httpBuf->dataitem->getFilePath(), std::fstream::out|std::fstream::binary|std::fstream::trunc);
-            if (outputStream.fail()) {
+            string cmp=metaKV["CMP"];
+            if (cmp.size()) {
+                if (!CompressionHelper::isSupported(cmp)) {
+                    Client::log("Data item compression " + cmp + " is not supported, cannot process passthrough fetch write", 1);
+                    httpBuf->outputFailed=true;
+                    return 0;
+                }
+                httpBuf->compressionHelper.reset(new CompressionHelper());
+                httpBuf->compressionHelper->decompressStreamBegin();
+            }
+
+            if (!openOutputFile(httpBuf, httpBuf->dataitem->getContentLength())) {
                 Client::log("Unable to truncate target file, cannot process passthrough fetch write", 1);
+                httpBuf->outputFailed=true;
                 return 0;
             }
-            outputStream.close();
 
             if (enc.compare("NONE")) {
                 // Resolve DI key and initialize cryptohelper for stream decryption
                 KeyHint kHint(ECSCI_HASHALG_MD5, kha, CryptoHelper::getEncryptionAlgorithm(enc));
                 httpBuf->dataitem->setKeyHint(&kHint);
 
-                // Key pointers returned by KeyRing are copies and must be free'd
-                shared_ptr<elfcloud::Key> key;
+                // Shared with the key ring, no copy of the key is made
+                shared_ptr<const elfcloud::Key> key;
 
                 try {
                     // Throws if the key is not found
-                    key.reset(httpBuf->client->getKeyRing()->getCipherKey(kHint));
-                    httpBuf->cryptoHelper->decryptDataStreamBegin(key.get());
+                    key=httpBuf->client->getKeyRing()->getSharedCipherKey(kHint);
+                    // Only the ciphertext hash is checked against X-ELFCLOUD-HASH
+                    byte iv[CipherEngine::ivSize];
+                    ECCipherMode mode=httpBuf->dataitem->getCipherMode();
+                    if (ECSCI_CIPHERMODE_CTR==mode && httpBuf->dataitem->getCipherIV(iv))
+                        httpBuf->cryptoHelper->decryptDataStreamBegin(key.get(), iv, CryptoHelper::streamHashEncrypted, mode);
+                    else if (ECSCI_CIPHERMODE_CFB8==mode)
+                        httpBuf->cryptoHelper->decryptDataStreamBegin(key.get(), 0, CryptoHelper::streamHashEncrypted);
+                    httpBuf->stagedCiphertext=httpBuf->cryptoHelper->hasDecryptionStream() && !httpBuf->compressionHelper.get();
                 } catch (...) {
                     stringstream ss;
                     ss << "Decryption key for hash " << kha << " and mode " << enc << " could not be found, cannot process passthrough fetch write";
                     Client::log(ss.str(), 1);
+                    httpBuf->outputFailed=true;
                     return 0;
                 }
             }
+        } else if (httpBuf->outputFd<0) {
+            // Resumed fetch, the stream cipher continues from the previous attempt
+            if (!openOutputFile(httpBuf, httpBuf->dataitem->getContentLength())) {
+                Client::log("Unable to reopen target file, cannot process passthrough fetch write", 1);
+                httpBuf->outputFailed=true;
+                return 0;
+            }
         }
 
-        if (httpBuf->cryptoHelper) {
+        if (httpBuf->cryptoHelper && !httpBuf->stagedCiphertext) {
             // If cryptohelper has been initialized, decrypt the chunk in-place before writing it out
             if (false==httpBuf->cryptoHelper->decryptDataStreamContinue((const byte*) ptr, (byte*) ptr, size*nmemb)) {
                 Client::log("Decryption failed, cannot process passthrough fetch write", 1);
+                httpBuf->outputFailed=true;
                 return 0;
             }
         }
 
-        std::ofstream outputStream(httpBuf->dataitem->getFilePath(), std::fstream::out|std::fstream::binary|std::fstream::app);
-        if (outputStream.fail()) {
-            Client::log("Unable to write to target file, cannot process passthrough fetch write", 1);
-            return 0;
+        // Stage the chunk and write it out with a single positional write once the staging buffer is full
+        const byte *chunk=(const byte*) ptr;
+        size_t remaining=size*nmemb;
+
+        if (httpBuf->compressionHelper) {
+            httpBuf->decompressBuffer.clear();
+            if (!httpBuf->compressionHelper->decompressStreamContinue(chunk, remaining, httpBuf->decompressBuffer)) {
+                Client::log("Decompression failed, cannot process passthrough fetch write", 1);
+                httpBuf->outputFailed=true;
+                return 0;
+            }
+            chunk=httpBuf->decompressBuffer.empty() ? 0 : &httpBuf->decompressBuffer[0];
+            remaining=httpBuf->decompressBuffer.size();
         }
-        outputStream.write((const char*) ptr, size*nmemb);
-        if (outputStream.fail()) {
-            Client::log("Unable to write to target file, cannot process passthrough fetch write", 1);
-            return 0;
+
+        while (remaining>0) {
+            size_t toCopy=passthroughWriteBufferSize-httpBuf->outputBufferUsed;
+            if (toCopy>remaining)
+                toCopy=remaining;
+
+            memcpy(&httpBuf->outputBuffer[httpBuf->outputBufferUsed], chunk, toCopy);
+            httpBuf->outputBufferUsed+=toCopy;
+            chunk+=toCopy;
+            remaining-=toCopy;
+
+            if (httpBuf->outputBufferUsed==passthroughWriteBufferSize && !flushOutputFile(httpBuf)) {
+                Client::log("Unable to write to target file, cannot process passthrough fetch write", 1);
+                httpBuf->outputFailed=true;
+                return 0;
+            }
         }
-        outputStream.close();
         httpBuf->bytesWritten=httpBuf->bytesWritten+size*nmemb;
         return size*nmemb;
     } // if passthrough variables are defined
 
-	while (httpBuf->nextBuffer!=0) {
-		httpBuf = httpBuf->nextBuffer;
-	}
+	return appendToBuffer(httpBuf, ptr, size*nmemb);
+}
 
-	size_t freeBufferMemory = 0;
-	freeBufferMemory = httpBuf->bufferSize - httpBuf->bytesUsed;
+bool ServerConnection::openOutputFile(httpBuffer *pInBuffer, const uint64_t pInExpectedSize) {
 
-	if ((size*nmemb) <= freeBufferMemory) {
-		memcpy(&httpBuf->buffer[httpBuf->bytesUsed], ptr, size*nmemb);
-		httpBuf->bytesUsed += size*nmemb;
-	} else {
-		memcpy(&httpBuf->buffer[httpBuf->bytesUsed], ptr, freeBufferMemory);
-		httpBuf->bytesUsed += freeBufferMemory;
+    const uint64_t offset=pInBuffer->resumeOffset;
 
-		httpBuf->nextBuffer = new httpBuffer;
-		httpBuf->nextBuffer->nextBuffer = NULL;
+    int fd=open(pInBuffer->dataitem->getFilePath().c_str(), O_WRONLY|O_CREAT|(offset ? 0 : O_TRUNC), 0600);
+    if (fd<0)
+        return false;
 
-		httpBuf->nextBuffer->bufferSize = 50000;
-		if ((size*nmemb)>(httpBuf->nextBuffer->bufferSize-5000)) {
-			httpBuf->nextBuffer->bufferSize += (size*nmemb);
-		}
+    // Resumed fetch, keep the part received earlier and drop anything past it
+    if (offset>0 && ftruncate(fd, (off_t) offset)!=0) {
+        close(fd);
+        return false;
+    }
+
+#ifdef __linux__
+    if (pInExpectedSize>offset) {
+        // Reserve the blocks up front to avoid fragmentation, the file size is kept as is so a partial fetch
+        // leaves only the received bytes visible. Not all file systems support this, failure is not fatal.
+        if (fallocate(fd, FALLOC_FL_KEEP_SIZE, (off_t) offset, (off_t) (pInExpectedSize-offset))!=0) {
+            stringstream ss;
+            ss << "ServerConnection/openOutputFile(): Preallocation of " << pInExpectedSize << " bytes failed, errno " << errno;
+            Client::log(ss.str(), 5);
+        }
+    }
+#endif
 
-		httpBuf->nextBuffer->bytesUsed = 0;
-		httpBuf->nextBuffer->buffer = new byte[httpBuf->nextBuffer->bufferSize];
+    pInBuffer->outputBuffer=(unsigned char*) malloc(passthroughWriteBufferSize);
+    if (!pInBuffer->outputBuffer) {
+        close(fd);
+        return false;
+    }
 
-        if (0==httpBuf->nextBuffer->buffer) {
-            // Failed to allocate new chained buffer, remove references to new buffer and return only the amount of bytes cleared
-            // that got copied into the original last buffer in the chain.
-            delete httpBuf->nextBuffer;
-            httpBuf->nextBuffer=NULL;
+    pInBuffer->outputFd=fd;
+    pInBuffer->outputOffset=offset;
+    pInBuffer->outputBufferUsed=0;
+    return true;
+}
 
-            // Returns to CURL the number of bytes copied to original buffer, the rest cannot be accepted. Original buffer is now full.
-            return freeBufferMemory;
+bool ServerConnection::flushOutputFile(httpBuffer *pInBuffer) {
+
+    // Staged ciphertext is decrypted once and dropped if it cannot be written, a later flush must not decrypt it again
+    if (pInBuffer->stagedCiphertext && pInBuffer->outputBufferUsed>0
+            && !pInBuffer->cryptoHelper->decryptDataStreamContinue(pInBuffer->outputBuffer, pInBuffer->outputBuffer, pInBuffer->outputBufferUsed)) {
+        Client::log("Decryption failed, cannot process passthrough fetch write", 1);
+        pInBuffer->outputBufferUsed=0;
+        return false;
+    }
+
+    unsigned int written=0;
+    while (written<pInBuffer->outputBufferUsed) {
+        ssize_t ret=pwrite(pInBuffer->outputFd, &pInBuffer->outputBuffer[written],
+                           pInBuffer->outputBufferUsed-written, (off_t) (pInBuffer->outputOffset+written));
+        if (ret<0) {
+            if (EINTR==errno)
+                continue;
+            if (pInBuffer->stagedCiphertext)
+                pInBuffer->outputBufferUsed=0;
+            return false;
         }
+        written+=ret;
+    }
 
-        // All provided data has been copied. The function will return with "all given bytes copied" status.
-        memcpy(&httpBuf->nextBuffer->buffer[httpBuf->nextBuffer->bytesUsed],
-               (void*) ((unsigned long) ptr+freeBufferMemory), (size*nmemb)-freeBufferMemory);
-		httpBuf->nextBuffer->bytesUsed += ((size*nmemb)-freeBufferMemory);
-	}
+    pInBuffer->outputOffset+=pInBuffer->outputBufferUsed;
+    pInBuffer->outputBufferUsed=0;
+    return true;
+}
+
+bool ServerConnection::closeOutputFile(httpBuffer *pInBuffer) {
+
+    if (pInBuffer->outputFd<0)
+        return true;
+
+    bool ok=flushOutputFile(pInBuffer);
 
-	return size*nmemb;
+    // Drop any preallocated blocks past the data actually received
+    if (ok && ftruncate(pInBuffer->outputFd, (off_t) pInBuffer->outputOffset)!=0)
+        ok=false;
+
+    if (close(pInBuffer->outputFd)!=0)
+        ok=false;
+
+    free(pInBuffer->outputBuffer);
+    pInBuffer->outputBuffer=0;
+    pInBuffer->outputBufferUsed=0;
+    pInBuffer->outputFd=-1;
+    return ok;
+}
+
+bool ServerConnection::acquireBuffer(httpBuffer *pInBuffer, const unsigned int pInCapacity) {
+
+    std::unique_lock<std::mutex> lock(bufferPoolMutex);
+    if (!bufferPool.empty()) {
+        pInBuffer->buffer=bufferPool.back().first;
+        pInBuffer->bufferSize=bufferPool.back().second;
+        pInBuffer->bytesUsed=0;
+        bufferPool.pop_back();
+    }
+    lock.unlock();
+
+    return reserveBuffer(pInBuffer, pInCapacity);
+}
+
+void ServerConnection::recycleBuffer(httpBuffer *pInBuffer) {
+    recycleBuffer(pInBuffer->buffer, pInBuffer->bufferSize);
+    pInBuffer->buffer=0;
+    pInBuffer->bufferSize=0;
+    pInBuffer->bytesUsed=0;
+}
+
+void ServerConnection::recycleBuffer(unsigned char *pInBuffer, const unsigned int pInCapacity) {
+
+    if (!pInBuffer)
+        return;
+
+    std::lock_guard<std::mutex> lock(bufferPoolMutex);
+    if (bufferPool.size()>=bufferPoolMaxCount || pInCapacity>bufferPoolMaxBufferSize) {
+        free(pInBuffer);
+        return;
+    }
+
+    bufferPool.push_back(make_pair(pInBuffer, pInCapacity));
 }
 
 void ServerConnection::parseHeader(std::map<string, string>& pOutelfcloudHeaders, std::map<string, string>& pOutAllHeaders, httpBuffer* pInHeaderBuffer) {
@@ -697,53 +1711,40 @@ void ServerConnection::parseHeader(std::map<string, string>& pOutelfcloudHeaders
 	}
 }
 
-// Free linked list of body buffers, everything is free's except the initial
-// httpBuffer struct (however, it's contained buffer is freed) which is usually allocated from stack.
-void ServerConnection::deleteBufferChain(httpBuffer *httpBodyBuffer) {
-	httpBuffer *temp_ptr;
-	while (httpBodyBuffer->nextBuffer != 0) {
-		temp_ptr = httpBodyBuffer->nextBuffer;
-		httpBodyBuffer->nextBuffer = temp_ptr->nextBuffer;
-		delete[] temp_ptr->buffer;
-		delete temp_ptr;
-	}
-	delete[] httpBodyBuffer->buffer;
-}
+bool ServerConnection::reserveBuffer(httpBuffer *pInBuffer, const size_t pInCapacity) {
 
-httpBuffer ServerConnection::mergeBufferChain(const httpBuffer& pInBuffer) {
+    if (pInCapacity<=pInBuffer->bufferSize)
+        return true;
 
-	// Calculate total size of the chained buffers
-	unsigned int totalSize = pInBuffer.bytesUsed;
-	httpBuffer *buffer=pInBuffer.nextBuffer;
-	while(buffer!=0) {
-		totalSize += buffer->bytesUsed;
-		buffer = buffer->nextBuffer;
-	}
+    unsigned char *newBuffer=(unsigned char*) realloc(pInBuffer->buffer, pInCapacity);
+    if (!newBuffer)
+        return false;
 
-	// Allocate large buffer, copy each segment.
-    httpBuffer newBuffer;
-    //memset(&newBuffer, 0, sizeof(httpBuffer));
+    pInBuffer->buffer=newBuffer;
+    pInBuffer->bufferSize=pInCapacity;
+    return true;
+}
 
-    try {
-        newBuffer.buffer = new byte[totalSize];
-        newBuffer.bufferSize=totalSize;
+// Returns the number of bytes appended, which is less than requested only when the buffer cannot grow.
+size_t ServerConnection::appendToBuffer(httpBuffer *pInBuffer, const void *pInData, const size_t pInDataSize) {
 
-        memcpy(newBuffer.buffer, pInBuffer.buffer, pInBuffer.bytesUsed);
-        newBuffer.bytesUsed = pInBuffer.bytesUsed;
-        httpBuffer *bufferLoop = pInBuffer.nextBuffer;
-        while(bufferLoop != 0) {
-            memcpy(newBuffer.buffer+newBuffer.bytesUsed, bufferLoop->buffer, bufferLoop->bytesUsed);
-            newBuffer.bytesUsed += bufferLoop->bytesUsed;
-            bufferLoop = bufferLoop->nextBuffer;
-        }
+    if (pInBuffer->bytesUsed+pInDataSize>pInBuffer->bufferSize) {
+        size_t newCapacity=(size_t) pInBuffer->bufferSize*2;
+        if (newCapacity<pInBuffer->bytesUsed+pInDataSize)
+            newCapacity=pInBuffer->bytesUsed+pInDataSize;
 
-        assert(newBuffer.bytesUsed == totalSize);
-    }
-    catch (bad_alloc& e) {
-        throw Exception(ECSCI_EXC_MEMORY_ALLOCATION_ERROR, "Unable to allocate response body buffer");
+        if (!reserveBuffer(pInBuffer, newCapacity)) {
+            // Accept only what still fits, libcurl will abort the transfer on a short write
+            size_t freeBufferMemory=pInBuffer->bufferSize-pInBuffer->bytesUsed;
+            memcpy(&pInBuffer->buffer[pInBuffer->bytesUsed], pInData, freeBufferMemory);
+            pInBuffer->bytesUsed+=freeBufferMemory;
+            return freeBufferMemory;
+        }
     }
 
-    return newBuffer;
+    memcpy(&pInBuffer->buffer[pInBuffer->bytesUsed], pInData, pInDataSize);
+    pInBuffer->bytesUsed+=pInDataSize;
+    return pInDataSize;
 }
 
 } // ns
@@ -38,6 +38,9 @@
 //#endif
 
 #include <map>
+#include <mutex>
+#include <functional>
+#include <vector>
 #include <string>
 
 using namespace std;
@@ -59,21 +62,50 @@ namespace elfcloud {
     class Client;
     class Container;
     class DataItemFilePassthrough;
+    class JsonStreamReader;
+    class CompressionHelper;
+    class CancelToken;
+    class Key;
+    struct fetchStripe;
 }
 
 typedef struct httpBuffer {
 		unsigned int bytesUsed;
 		unsigned char* buffer;
 		unsigned int bufferSize;
-		httpBuffer* nextBuffer;
+
+        // Header buffer only: body buffer of the same request, its capacity is reserved up front
+        // once the Content-Length response header has been received.
+        httpBuffer* bodyBuffer;
 
         // Passthrough fetch handlers
         std::shared_ptr<elfcloud::CryptoHelper> cryptoHelper;
+        // Set for compressed data items, decrypted chunks are decompressed into decompressBuffer
+        std::shared_ptr<elfcloud::CompressionHelper> compressionHelper;
+        std::vector<unsigned char> decompressBuffer;
         std::shared_ptr<elfcloud::DataItemFilePassthrough> dataitem;
         unsigned int bytesWritten;
         elfcloud::Client *client;
         std::string serverResponseHash;
 
+        // Passthrough fetch output file, kept open for the whole transfer. Decrypted chunks are
+        // collected into outputBuffer and written out with pwrite() at outputOffset once it fills up.
+        int outputFd;
+        uint64_t outputOffset;
+        unsigned char* outputBuffer;
+        unsigned int outputBufferUsed;
+        // Set when outputBuffer collects ciphertext, which is then decrypted a whole buffer at a time on flush so
+        // that the decryption can use several threads. Compressed content is decrypted chunk by chunk instead.
+        bool stagedCiphertext;
+
+        // Passthrough fetch continued with a ranged request: offset of the first response byte in the data item
+        uint64_t resumeOffset;
+        // Set when the passthrough output could not be processed locally, the transfer cannot be resumed
+        bool outputFailed;
+
+        // Body buffer only: cancellation token of the thread that started the request, 0 if none
+        elfcloud::CancelToken *cancelToken;
+
         // ELFCLOUD response headers when used as header buffer
         std::map<std::string, std::string> headers;
 
@@ -81,13 +113,67 @@ typedef struct httpBuffer {
             bytesUsed=0;
             buffer=0;
             bufferSize=0;
-            nextBuffer=0;
+            bodyBuffer=0;
             bytesWritten=0;
             client=0;
+            outputFd=-1;
+            outputOffset=0;
+            outputBuffer=0;
+            outputBufferUsed=0;
+            stagedCiphertext=false;
+            resumeOffset=0;
+            outputFailed=false;
+            cancelToken=0;
         }
 
 } httpBuffer;
 
+// Progress of a passthrough fetch. The caller keeps it over the attempts of one fetch so that a transfer
+// interrupted by a connection error continues with a ranged request from offset instead of starting over.
+// cryptoHelper holds the CFB8 stream position (the last 16 ciphertext bytes) and the running ciphertext hash.
+typedef struct passthroughFetchState {
+        uint64_t offset;
+        std::shared_ptr<elfcloud::CryptoHelper> cryptoHelper;
+        std::string serverResponseHash;
+
+        passthroughFetchState() {
+            offset=0;
+        }
+
+        void reset() {
+            offset=0;
+            cryptoHelper.reset();
+            serverResponseHash.clear();
+        }
+} passthroughFetchState;
+
+// Timing of a completed request, used to size store segments. rttSeconds is the TCP connect time when the
+// request opened a new connection and 0 when an existing connection was reused.
+typedef struct requestTiming {
+        double totalSeconds;
+        double rttSeconds;
+
+        requestTiming() {
+            totalSeconds=0;
+            rttSeconds=0;
+        }
+} requestTiming;
+
+// Connection settings derived from the client configuration. Rebuilt by updateConnectionProfile() when the
+// configuration changes, requests read it instead of looking up the configuration keys every time.
+typedef struct connectionProfile {
+        bool jsonOutput;
+        bool dataApiHeaderOutput;
+        // Empty when not configured
+        std::string proxy;
+        std::string proxyCredentials;
+
+        connectionProfile() {
+            jsonOutput=false;
+            dataApiHeaderOutput=false;
+        }
+} connectionProfile;
+
 namespace elfcloud {
 
 
@@ -98,9 +184,23 @@ public:
 
 #ifdef ELFCLOUD_LIB
     Json::Value performServerJSONRequest(const Json::Value& pInServerRequest, bool pInAuthRequest = false);
+
+    // Variant for large responses that avoids building a Json::Value DOM: the "result" member of the response
+    // is passed to pInResultDecoder as a reader positioned at the start of the value.
+    void performServerJSONRequestStreaming(const Json::Value& pInServerRequest,
+            const std::function<void (JsonStreamReader&)>& pInResultDecoder,
+            bool pInAuthRequest = false);
 #endif
     void setAddress(const string& pInAddress);
 
+    // Gets the connection ready for the first request: authenticates, or restores a persisted session and
+    // opens the connection to the server so that DNS and TLS session state are cached. Does nothing once
+    // a request has been made.
+    void warmup();
+
+    // Re-reads the http.* configuration keys, called by Client::setConf()
+    void updateConnectionProfile();
+
 	void performStoreRequestWithFile(
 			const DataItemStoreMode pInStoreMode,
 			const string& pInKey,
@@ -132,29 +232,61 @@ public:
 			byte **pOutResponseBody,
 			unsigned int *pOutResponseBodyLength,
 			const elfcloudInterfaceType pInInterfaceType,
-            shared_ptr<DataItemFilePassthrough> pInDataItem=0);
+            shared_ptr<DataItemFilePassthrough> pInDataItem=0,
+            passthroughFetchState *pInOutFetchState=0,
+            requestTiming *pOutTiming=0);
+
+    // Passthrough fetch of an uncompressed data item of pInTotalLength bytes split into pInStripes byte ranges,
+    // fetched concurrently over pooled connections. The ciphertext is checked against X-ELFCLOUD-HASH (or
+    // pInExpectedHash when the server sends none) once assembled in the target file, and the ranges are then
+    // decrypted in parallel. Returns false without touching the item when the server ignores range requests.
+    bool performStripedFetchRequest(const map<string, string> &pInMapRequestHeaders,
+            shared_ptr<DataItemFilePassthrough> pInDataItem,
+            const uint64_t pInTotalLength,
+            const unsigned int pInStripes,
+            const string& pInExpectedHash,
+            map<string, string> &pOutMapResponseHeaders);
 
 	void setAPIKey(const string& pInAPIKey);
 	void setAuthUsername(const string& pInUsername);
 	void setAuthPassword(const string& pInPassword);
 	void setAuthMethod(const string& pInAuthMethod);
 
-    void setSpeedLimitReceive(unsigned int pInLimit) {
-        speedLimitReceive=pInLimit;
-    }
-
-    void setSpeedLimitSend(unsigned int pInLimit) {
-        speedLimitSend=pInLimit;
-    }
-
 	static size_t write_data(void *ptr, size_t size, size_t nmemb, void *userData);
     static size_t write_header(void *ptr, size_t size, size_t nmemb, void *userData);
+#ifdef ELFCLOUD_LIB
+    // Reports transfer progress to the process-wide BandwidthScheduler and aborts the transfer when the
+    // request's CancelToken has been cancelled, userData is the transfer's progress state
+    static int xferinfo(void *userData, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+#endif
+
+    // Size of the staging buffer used for passthrough fetch file writes
+    static const unsigned int passthroughWriteBufferSize=4*1024*1024;
 
 private:
 	bool authenticated;
+	bool sessionRestoreAttempted;
+
+	// Serializes authentication, held while an auth request is in progress
+	std::recursive_mutex authMutex;
+	// The libcurl handle serves one request at a time
+	std::mutex connectionMutex;
+	std::mutex bufferPoolMutex;
 #ifdef ELFCLOUD_LIB
     CURL *curl;
 	CURLcode res;
+
+	// Cookies, DNS cache and TLS sessions are shared by the main handle and the pooled striped fetch handles
+	CURLSH *share;
+	std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+	static void lockShare(CURL *pInHandle, curl_lock_data pInData, curl_lock_access pInAccess, void *pInUserData);
+	static void unlockShare(CURL *pInHandle, curl_lock_data pInData, void *pInUserData);
+
+	// Idle handles of striped fetches, each keeps its connection to the server open for the next fetch
+	std::vector<CURL*> handlePool;
+	std::mutex handlePoolMutex;
+	CURL *acquireHandle();
+	void releaseHandle(CURL *pInHandle);
 #endif
 
 	Client *client;
@@ -179,23 +311,71 @@ private:
 	string username;
 	string password;
 
-    // Bytes/second, enforced by libcurl. Value of 0 means unlimited speed.
-    unsigned int speedLimitSend;
-
-    // Bytes/second, enforced by libcurl. Value of 0 means unlimited speed.
-    unsigned int speedLimitReceive;
-
 #ifdef ELFCLOUD_LIB
 	Json::Value createRequestAuth();
 #endif
 
-	void deleteBufferChain(httpBuffer *httpBodyBuffer);
+	// Response buffers are malloc'd so that the body can be handed over to DataItem::setDataPtr() as is.
+	// reserveBuffer() grows the capacity to at least pInCapacity bytes, appendToBuffer() grows it geometrically.
+	static bool reserveBuffer(httpBuffer *pInBuffer, const size_t pInCapacity);
+	static size_t appendToBuffer(httpBuffer *pInBuffer, const void *pInData, const size_t pInDataSize);
 
-	// Combine given buffer chain into a single node chain. Returns a new httpBuffer structs that has no further nodes.
-	// Both old and new buffers must be released by the caller.
-	httpBuffer mergeBufferChain(const httpBuffer& pInBuffer);
+	// Scratch buffers recycled between requests of this connection (buffer, capacity). At most
+	// bufferPoolMaxCount buffers of up to bufferPoolMaxBufferSize bytes are kept, larger ones are released.
+	std::vector<std::pair<unsigned char*, unsigned int> > bufferPool;
+	static const unsigned int bufferPoolMaxCount=4;
+	static const unsigned int bufferPoolMaxBufferSize=256*1024;
 
-	void ensureAuthenticatedState();
+	// Takes a buffer of at least pInCapacity bytes from the pool (or heap) into an empty httpBuffer
+	bool acquireBuffer(httpBuffer *pInBuffer, const unsigned int pInCapacity);
+	void recycleBuffer(httpBuffer *pInBuffer);
+	void recycleBuffer(unsigned char *pInBuffer, const unsigned int pInCapacity);
+
+	// Request header list for JSON requests, built once per connection
+	struct curl_slist *jsonRequestHeaders;
+
+	// Same as performServerCoreRequest(), additionally returns the allocated size of the response body buffer
+	// so that the caller can hand it back to the pool with recycleBuffer().
+	void performRequest(const map<string, string> &pInMapRequestHeaders,
+			const byte *pInRequestBody,
+			const unsigned int pInBodyLength,
+			map<string, string> &pOutMapResponseHeaders,
+			byte **pOutResponseBody,
+			unsigned int *pOutResponseBodyLength,
+			unsigned int *pOutResponseBodyCapacity,
+			const elfcloudInterfaceType pInInterfaceType,
+            shared_ptr<DataItemFilePassthrough> pInDataItem,
+            passthroughFetchState *pInOutFetchState,
+            requestTiming *pOutTiming);
+
+	// Passthrough fetch output file handling. openOutputFile() truncates the target file to the resume offset and
+	// preallocates up to pInExpectedSize bytes when known, flushOutputFile() writes out the staged data.
+	// closeOutputFile() flushes and releases the descriptor, returns false if any write failed.
+	static bool openOutputFile(httpBuffer *pInBuffer, const uint64_t pInExpectedSize);
+	static bool flushOutputFile(httpBuffer *pInBuffer);
+	static bool closeOutputFile(httpBuffer *pInBuffer);
+
+	// Returns true when a persisted session was restored, no request has been sent to the server then
+	bool ensureAuthenticatedState();
+
+	// Session cookie persistence (http.session.file). The file is only used when owned by the current user and
+	// not accessible by others, and only for the same user name and server address.
+	bool restoreSession();
+	void saveSession();
+	string getSessionIdentity();
+
+	// Current connection profile, replaced as a whole so that a request keeps using the one it started with
+	std::shared_ptr<const connectionProfile> profile;
+	std::mutex profileMutex;
+	std::shared_ptr<const connectionProfile> getConnectionProfile();
+
+	// Proxy and CA options shared by all requests
+	void applyConnectionOptions(CURL *pInHandle, const connectionProfile &pInProfile);
+
+	// Fetches one range of a striped fetch on a pooled handle, retrying and continuing an interrupted transfer
+	void fetchRange(fetchStripe *pInOutStripe, const map<string, string> &pInMapRequestHeaders, const unsigned int pInMaxRetries);
+	// Decrypts one range of the assembled ciphertext in place, the CFB8 stream restarts from the 16 bytes before it
+	static void decryptRange(fetchStripe *pInOutStripe, const Key *pInKey);
 };
 }
 
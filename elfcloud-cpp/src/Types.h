@@ -39,6 +39,12 @@ namespace elfcloud {
     	ECSCI_ENCALG_AES256
     } ECEncryptionAlgorithm;
 
+    // Cipher mode of data item content, CFB8 with the key IV or CTR with a per data item initial counter block
+    typedef enum ECCipherMode {
+    	ECSCI_CIPHERMODE_CFB8,
+    	ECSCI_CIPHERMODE_CTR
+    } ECCipherMode;
+
     typedef enum ECHashAlgorithm {
     	ECSCI_HASHALG_MD5,
         ECSCI_HASHALG_SHA256
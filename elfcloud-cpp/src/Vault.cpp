@@ -237,9 +237,7 @@ std::list<std::shared_ptr<Vault>> *Vault::ListVaults(Client *pInClient,
 		Json::Value aVault = *iterVaults;
 		vault->initWithDictionary(aVault);
 
-        // setCacheContainer returns either 'vault' back or pointer to the cached object that was updated
-        // In the cache-hit case, the vault instance created here is immediately released.
-        // Cast is safe because if different pointer is returned, it must be a vault due to ID match.
+        // setCacheContainer returns 'vault' back, it replaces any cached object with the same ID.
         vault=std::dynamic_pointer_cast<Vault>(pInClient->setCacheContainer(vault));
 		result->push_back(vault);
 		iterVaults++;
@@ -0,0 +1,466 @@
+/*
+ * Copyright (c) 2015, Ilmi Solutions Oy
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the distribution.
+ * * Neither the name of the <ORGANIZATION> nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Throughput of the library's cipher and hash helpers over buffer sizes
+ * from 1 KB to 256 MB, and over thread counts for the operations that run
+ * on several threads. Each case runs until it has taken the minimum time
+ * and reports MB/s and ns per call. The items cases split the buffer into
+ * small files of BENCH_ITEM_SIZE bytes, encrypted and hashed one at a time
+ * and with the batch API. With -j every result is one JSON
+ * object per line, for tracking regressions between builds.
+ *
+ * Usage: bench-crypto [-j] [-s max buffer bytes] [-t max threads] [-m min seconds per case]
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <memory>
+
+#include <API.h>
+#include <CryptoHelper.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <cryptopp/config.h>
+#include <cryptopp/cpu.h>
+#include <cryptopp/files.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/hex.h>
+#include <cryptopp/whrlpool.h>
+
+using namespace std;
+using namespace elfcloud;
+
+/**
+ * Helpers formatting strings one byte at a time are measured up to this size only
+ */
+#define BENCH_FORMAT_MAX_SIZE (16 * 1024 * 1024)
+
+/**
+ * Size of one item in the small file cases
+ */
+#define BENCH_ITEM_SIZE 4096
+
+static bool g_bJSON = false;
+static double g_dMinSeconds = 0.5;
+
+typedef bool (*benchOperation)(byte *buffer, size_t size);
+
+static const Key *g_pKey = NULL;
+static byte g_cCounterBlock[CipherEngine::ivSize];
+static string g_strHashFile;
+
+static bool encryptCFB8(byte *buffer, size_t size)
+{
+    return CryptoHelper::encryptData(g_pKey, buffer, buffer, size);
+}
+
+static bool decryptCFB8(byte *buffer, size_t size)
+{
+    return CryptoHelper::decryptData(g_pKey, buffer, buffer, size);
+}
+
+static bool encryptCTR(byte *buffer, size_t size)
+{
+    return CryptoHelper::encryptData(g_pKey, buffer, buffer, size, NULL, NULL, ECSCI_CIPHERMODE_CTR, g_cCounterBlock);
+}
+
+static bool decryptCTR(byte *buffer, size_t size)
+{
+    return CryptoHelper::decryptData(g_pKey, buffer, buffer, size, NULL, NULL, ECSCI_CIPHERMODE_CTR, g_cCounterBlock);
+}
+
+/**
+ * Encryption and decryption with both hashes, as done on store and fetch
+ */
+static bool encryptCFB8Hashed(byte *buffer, size_t size)
+{
+    string l_strPlain, l_strCipher;
+    return CryptoHelper::encryptData(g_pKey, buffer, buffer, size, &l_strPlain, &l_strCipher);
+}
+
+static bool decryptCFB8Hashed(byte *buffer, size_t size)
+{
+    string l_strCipher, l_strPlain;
+    return CryptoHelper::decryptData(g_pKey, buffer, buffer, size, &l_strCipher, &l_strPlain);
+}
+
+/**
+ * Buffer as many small items, each encrypted with both hashes as on store
+ */
+static bool encryptItems(byte *buffer, size_t size)
+{
+    string l_strPlain, l_strCipher;
+
+    for (size_t l_iDone = 0; l_iDone < size; l_iDone += BENCH_ITEM_SIZE)
+    {
+        if (!CryptoHelper::encryptData(g_pKey, buffer + l_iDone, buffer + l_iDone, min((size_t) BENCH_ITEM_SIZE, size - l_iDone),
+                                       &l_strPlain, &l_strCipher))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool encryptItemsBatch(byte *buffer, size_t size)
+{
+    size_t l_iItems = (size + BENCH_ITEM_SIZE - 1) / BENCH_ITEM_SIZE;
+    vector<CryptoHelper::BatchItem> l_SItems(l_iItems);
+    vector<string> l_SHashes(2 * l_iItems);
+
+    for (size_t i = 0; i < l_iItems; i++)
+    {
+        l_SItems[i].data = buffer + i * BENCH_ITEM_SIZE;
+        l_SItems[i].outData = buffer + i * BENCH_ITEM_SIZE;
+        l_SItems[i].dataSize = min((size_t) BENCH_ITEM_SIZE, size - i * BENCH_ITEM_SIZE);
+        l_SItems[i].iv = NULL;
+        l_SItems[i].plaintextHash = &l_SHashes[2 * i];
+        l_SItems[i].ciphertextHash = &l_SHashes[2 * i + 1];
+    }
+
+    return CryptoHelper::encryptDataBatch(g_pKey, &l_SItems[0], l_iItems);
+}
+
+/**
+ * Stream variants are fed in passthrough write sized pieces
+ */
+static bool encryptStream(byte *buffer, size_t size)
+{
+    CryptoHelper l_SHelper;
+
+    if (!l_SHelper.encryptDataStreamBegin(g_pKey))
+    {
+        return false;
+    }
+
+    for (size_t l_iDone = 0; l_iDone < size; l_iDone += 1024 * 1024)
+    {
+        size_t l_iChunk = min((size_t) 1024 * 1024, size - l_iDone);
+
+        if (!l_SHelper.encryptDataStreamContinue(buffer + l_iDone, buffer + l_iDone, l_iChunk))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool decryptStream(byte *buffer, size_t size)
+{
+    CryptoHelper l_SHelper;
+
+    if (!l_SHelper.decryptDataStreamBegin(g_pKey))
+    {
+        return false;
+    }
+
+    for (size_t l_iDone = 0; l_iDone < size; l_iDone += 1024 * 1024)
+    {
+        size_t l_iChunk = min((size_t) 1024 * 1024, size - l_iDone);
+
+        if (!l_SHelper.decryptDataStreamContinue(buffer + l_iDone, buffer + l_iDone, l_iChunk))
+        {
+            return false;
+        }
+    }
+
+    l_SHelper.getHashEncryptedDataStream();
+    l_SHelper.getHashDecryptedDataStream();
+    return true;
+}
+
+static bool md5Hex(byte *buffer, size_t size)
+{
+    return CryptoHelper::getHashMD5AsHexString(buffer, size).size() == 32;
+}
+
+static bool hexString(byte *buffer, size_t size)
+{
+    return CryptoHelper::byteArrayToHexString(buffer, size).size() == 2 * size;
+}
+
+static bool base64(byte *buffer, size_t size)
+{
+    return !CryptoHelper::base64Encode(buffer, size).empty();
+}
+
+/**
+ * Whole-file Whirlpool through a FileSource pipeline, over a file holding the
+ * buffer. The file is in the page cache, so this is mostly the hash.
+ */
+static bool whirlpoolFile(byte *buffer, size_t size)
+{
+    string l_strResult;
+    CryptoPP::Whirlpool l_SWhirlpool;
+    CryptoPP::FileSource(g_strHashFile.c_str(), true,
+                         new CryptoPP::HashFilter(l_SWhirlpool, new CryptoPP::HexEncoder(
+                                     new CryptoPP::StringSink(l_strResult), true)));
+    return l_strResult.size() == 128;
+}
+
+static bool writeHashFile(const byte *buffer, size_t size)
+{
+    FILE *l_pFile = fopen(g_strHashFile.c_str(), "wb");
+
+    if (!l_pFile)
+    {
+        return false;
+    }
+
+    bool l_bOk = fwrite(buffer, 1, size, l_pFile) == size;
+    return fclose(l_pFile) == 0 && l_bOk;
+}
+
+static void printCPUFeatures()
+{
+    unsigned int l_iCores = thread::hardware_concurrency();
+    string l_strFeatures;
+
+#if CRYPTOPP_BOOL_X86 || CRYPTOPP_BOOL_X64
+    if (CryptoPP::HasSSE2())
+    {
+        l_strFeatures += " sse2";
+    }
+
+    if (CryptoPP::HasSSSE3())
+    {
+        l_strFeatures += " ssse3";
+    }
+
+    if (CryptoPP::HasAESNI())
+    {
+        l_strFeatures += " aesni";
+    }
+
+    if (CryptoPP::HasCLMUL())
+    {
+        l_strFeatures += " clmul";
+    }
+#endif
+
+    if (l_strFeatures.empty())
+    {
+        l_strFeatures = " none";
+    }
+
+    if (g_bJSON)
+    {
+        printf("{\"cryptopp\": %d, \"cores\": %u, \"features\": \"%s\"}\n", CRYPTOPP_VERSION, l_iCores, l_strFeatures.c_str() + 1);
+    }
+    else
+    {
+        printf("Crypto++ %d, %u cores, CPU features detected:%s\n\n", CRYPTOPP_VERSION, l_iCores, l_strFeatures.c_str());
+        printf("%-20s %10s %7s %10s %14s %10s\n", "operation", "bytes", "threads", "calls", "ns/call", "MB/s");
+    }
+}
+
+/**
+ * Run operation on buffer until minimum time has passed and print the result
+ */
+static bool runCase(const char *name, benchOperation operation, byte *buffer, size_t size, unsigned int threads)
+{
+    CryptoHelper::setDecryptionThreads(threads);
+
+    // Warm up, also catches a failing operation before it is timed
+    if (!operation(buffer, size))
+    {
+        fprintf(stderr, "bench-crypto: %s failed at %lu bytes\n", name, (unsigned long) size);
+        return false;
+    }
+
+    unsigned long long l_iCalls = 0;
+    double l_dSeconds = 0;
+    chrono::steady_clock::time_point l_SStart = chrono::steady_clock::now();
+
+    while (l_dSeconds < g_dMinSeconds)
+    {
+        operation(buffer, size);
+        l_iCalls++;
+        l_dSeconds = chrono::duration<double>(chrono::steady_clock::now() - l_SStart).count();
+    }
+
+    double l_dNsPerCall = l_dSeconds * 1e9 / l_iCalls;
+    double l_dMBps = (double) size * l_iCalls / l_dSeconds / (1024 * 1024);
+
+    if (g_bJSON)
+    {
+        printf("{\"operation\": \"%s\", \"bytes\": %lu, \"threads\": %u, \"calls\": %llu, \"ns_per_call\": %.1f, \"mb_per_s\": %.2f}\n",
+               name, (unsigned long) size, threads, l_iCalls, l_dNsPerCall, l_dMBps);
+    }
+    else
+    {
+        printf("%-20s %10lu %7u %10llu %14.1f %10.2f\n", name, (unsigned long) size, threads, l_iCalls, l_dNsPerCall, l_dMBps);
+    }
+
+    fflush(stdout);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t l_iMaxSize = 256 * 1024 * 1024;
+    unsigned int l_iMaxThreads = thread::hardware_concurrency();
+    int l_iOpt;
+
+    while ((l_iOpt = getopt(argc, argv, "js:t:m:")) != -1)
+    {
+        switch (l_iOpt)
+        {
+            case 'j':
+                g_bJSON = true;
+                break;
+
+            case 's':
+                l_iMaxSize = strtoull(optarg, NULL, 10);
+                break;
+
+            case 't':
+                l_iMaxThreads = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'm':
+                g_dMinSeconds = strtod(optarg, NULL);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: bench-crypto [-j] [-s max buffer bytes] [-t max threads] [-m min seconds per case]\n");
+                return 1;
+        }
+    }
+
+    if (l_iMaxThreads == 0)
+    {
+        l_iMaxThreads = 1;
+    }
+
+    byte l_cKeyData[32];
+    byte l_cIV[CipherEngine::ivSize];
+
+    for (unsigned int i = 0; i < sizeof(l_cKeyData); i++)
+    {
+        l_cKeyData[i] = i;
+    }
+
+    memset(l_cIV, 0x5a, sizeof(l_cIV));
+    CryptoHelper::generateCipherIV(g_cCounterBlock);
+
+    unique_ptr<Key> l_pKey(Key::CreateKey("bench", "bench-crypto", ECSCI_ENCALG_AES256, "CFB8",
+                                          l_cKeyData, sizeof(l_cKeyData), l_cIV, sizeof(l_cIV), ECSCI_HASHALG_MD5));
+    g_pKey = l_pKey.get();
+
+    char l_strHashFile[] = "/tmp/bench-crypto-XXXXXX";
+    int l_iFd = mkstemp(l_strHashFile);
+
+    if (l_iFd < 0)
+    {
+        perror("bench-crypto: temporary file");
+        return 1;
+    }
+
+    close(l_iFd);
+    g_strHashFile = l_strHashFile;
+
+    vector<size_t> l_SSizes;
+
+    for (size_t l_iSize = 1024; l_iSize <= l_iMaxSize && l_iSize <= (size_t) 256 * 1024 * 1024; l_iSize *= 16)
+    {
+        l_SSizes.push_back(l_iSize);
+    }
+
+    vector<unsigned int> l_SThreads;
+
+    for (unsigned int l_iThreads = 1; l_iThreads < l_iMaxThreads; l_iThreads *= 2)
+    {
+        l_SThreads.push_back(l_iThreads);
+    }
+
+    l_SThreads.push_back(l_iMaxThreads);
+
+    vector<byte> l_SBuffer(l_SSizes.empty() ? 1 : l_SSizes.back());
+
+    for (size_t i = 0; i < l_SBuffer.size(); i++)
+    {
+        l_SBuffer[i] = (byte)(i * 131 + (i >> 8));
+    }
+
+    printCPUFeatures();
+
+    bool l_bOk = true;
+
+    for (size_t s = 0; s < l_SSizes.size() && l_bOk; s++)
+    {
+        size_t l_iSize = l_SSizes[s];
+        byte *l_pBuffer = &l_SBuffer[0];
+
+        // Serial operations
+        l_bOk = runCase("encrypt-cfb8", encryptCFB8, l_pBuffer, l_iSize, 1)
+                && runCase("encrypt-cfb8-hashed", encryptCFB8Hashed, l_pBuffer, l_iSize, 1)
+                && runCase("encrypt-stream", encryptStream, l_pBuffer, l_iSize, 1)
+                && runCase("encrypt-items", encryptItems, l_pBuffer, l_iSize, 1)
+                && runCase("md5-hex", md5Hex, l_pBuffer, l_iSize, 1);
+
+        if (l_bOk && writeHashFile(l_pBuffer, l_iSize))
+        {
+            l_bOk = runCase("whirlpool-file", whirlpoolFile, l_pBuffer, l_iSize, 1);
+        }
+
+        if (l_bOk && l_iSize <= BENCH_FORMAT_MAX_SIZE)
+        {
+            l_bOk = runCase("hex-string", hexString, l_pBuffer, l_iSize, 1)
+                    && runCase("base64", base64, l_pBuffer, l_iSize, 1);
+        }
+
+        // Operations split over threads
+        for (size_t t = 0; t < l_SThreads.size() && l_bOk; t++)
+        {
+            l_bOk = runCase("decrypt-cfb8", decryptCFB8, l_pBuffer, l_iSize, l_SThreads[t])
+                    && runCase("decrypt-cfb8-hashed", decryptCFB8Hashed, l_pBuffer, l_iSize, l_SThreads[t])
+                    && runCase("decrypt-stream", decryptStream, l_pBuffer, l_iSize, l_SThreads[t])
+                    && runCase("encrypt-ctr", encryptCTR, l_pBuffer, l_iSize, l_SThreads[t])
+                    && runCase("decrypt-ctr", decryptCTR, l_pBuffer, l_iSize, l_SThreads[t])
+                    && runCase("encrypt-items-batch", encryptItemsBatch, l_pBuffer, l_iSize, l_SThreads[t]);
+        }
+    }
+
+    unlink(g_strHashFile.c_str());
+    return l_bOk ? 0 : 1;
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2015, Ilmi Solutions Oy
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the distribution.
+ * * Neither the name of the <ORGANIZATION> nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/*
+ * Per-request overhead of the library against a local keep-alive HTTP
+ * server that answers every request immediately. The time measured is what
+ * the client side adds to a request: header list building, libcurl setup,
+ * logging, buffer handling and response parsing.
+ *
+ * Passthrough fetch throughput is measured with unencrypted content, so the
+ * time is spent on receiving and writing out the target file.
+ *
+ * Usage: bench-request [requests] [store body bytes] [fetch bytes] [fetches]
+ */
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+
+#include <API.h>
+#include <ServerConnection.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace std;
+using namespace elfcloud;
+
+/**
+ * Requests that asked for "100 Continue" before sending the body
+ */
+static atomic<unsigned int> g_iExpectContinue(0);
+
+/**
+ * Content of data item returned to passthrough fetch requests
+ */
+static string g_strFetchBody;
+
+static bool sendAll(int fd, const string &data)
+{
+    size_t l_iSent = 0;
+
+    while (l_iSent < data.size())
+    {
+        ssize_t l_iRtn = send(fd, data.data() + l_iSent, data.size() - l_iSent, 0);
+
+        if (l_iRtn <= 0)
+        {
+            return false;
+        }
+
+        l_iSent += l_iRtn;
+    }
+
+    return true;
+}
+
+/**
+ * Serve requests of one keep-alive connection until client closes it
+ */
+static void serveConnection(int fd)
+{
+    string l_strIn;
+    char l_cBuf[65536];
+
+    while (true)
+    {
+        size_t l_iHeaderEnd;
+
+        while ((l_iHeaderEnd = l_strIn.find("\r\n\r\n")) == string::npos)
+        {
+            ssize_t l_iRead = recv(fd, l_cBuf, sizeof(l_cBuf), 0);
+
+            if (l_iRead <= 0)
+            {
+                close(fd);
+                return;
+            }
+
+            l_strIn.append(l_cBuf, l_iRead);
+        }
+
+        string l_strHead = l_strIn.substr(0, l_iHeaderEnd + 4);
+        l_strIn.erase(0, l_iHeaderEnd + 4);
+        transform(l_strHead.begin(), l_strHead.end(), l_strHead.begin(), ::tolower);
+
+        size_t l_iContentLength = 0;
+        size_t l_iPos = l_strHead.find("\r\ncontent-length:");
+
+        if (l_iPos != string::npos)
+        {
+            l_iContentLength = strtoul(l_strHead.c_str() + l_iPos + 17, NULL, 10);
+        }
+
+        if (l_strHead.find("\r\nexpect: 100-continue") != string::npos)
+        {
+            g_iExpectContinue++;
+
+            if (!sendAll(fd, "HTTP/1.1 100 Continue\r\n\r\n"))
+            {
+                break;
+            }
+        }
+
+        while (l_strIn.size() < l_iContentLength)
+        {
+            ssize_t l_iRead = recv(fd, l_cBuf, sizeof(l_cBuf), 0);
+
+            if (l_iRead <= 0)
+            {
+                close(fd);
+                return;
+            }
+
+            l_strIn.append(l_cBuf, l_iRead);
+        }
+
+        l_strIn.erase(0, l_iContentLength);
+
+        string l_strBody;
+        const string *l_pBody = &l_strBody;
+        const char *l_strMeta = "";
+
+        if (l_strHead.find("/json ") != string::npos)
+        {
+            l_strBody = "{\"result\": true}";
+        }
+        else if (l_strHead.find("/fetch ") != string::npos)
+        {
+            l_pBody = &g_strFetchBody;
+            l_strMeta = "X-ELFCLOUD-META: v1:ENC:NONE:KHA:none::\r\n";
+        }
+
+        char l_strResponse[256];
+        snprintf(l_strResponse, sizeof(l_strResponse),
+                 "HTTP/1.1 200 OK\r\nContent-Length: %u\r\nX-ELFCLOUD-RESULT: OK\r\n%s\r\n", (unsigned int) l_pBody->size(), l_strMeta);
+
+        if (!sendAll(fd, l_strResponse) || !sendAll(fd, *l_pBody))
+        {
+            break;
+        }
+    }
+
+    close(fd);
+}
+
+static void serve(int listenfd)
+{
+    while (true)
+    {
+        int l_iFd = accept(listenfd, NULL, NULL);
+
+        if (l_iFd < 0)
+        {
+            return;
+        }
+
+        thread(serveConnection, l_iFd).detach();
+    }
+}
+
+/**
+ * Run requests and print time used per request
+ */
+static void report(const char *name, unsigned int requests, chrono::steady_clock::time_point start)
+{
+    double l_dSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    printf("%-8s %8u requests %10.3f s %10.1f us/request\n", name, requests, l_dSeconds, l_dSeconds * 1000000 / requests);
+}
+
+/**
+ * Print transfer rate of requests moving given number of bytes each
+ */
+static void reportThroughput(const char *name, unsigned int requests, uint64_t bytes, chrono::steady_clock::time_point start)
+{
+    double l_dSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    printf("%-8s %8u requests %10.3f s %10.1f MB/s\n", name, requests, l_dSeconds, (double) bytes * requests / l_dSeconds / (1024 * 1024));
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int l_iRequests = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+    unsigned int l_iBodySize = argc > 2 ? strtoul(argv[2], NULL, 10) : 64 * 1024;
+    unsigned int l_iFetchSize = argc > 3 ? strtoul(argv[3], NULL, 10) : 256 * 1024 * 1024;
+    unsigned int l_iFetches = argc > 4 ? strtoul(argv[4], NULL, 10) : 4;
+    char l_strFetchPath[] = "/tmp/bench-request-XXXXXX";
+    struct sockaddr_in l_SAddr;
+    socklen_t l_iAddrLen = sizeof(l_SAddr);
+
+    if (l_iRequests == 0)
+    {
+        l_iRequests = 1;
+    }
+
+    g_strFetchBody.assign(l_iFetchSize, 'x');
+
+    int l_iFetchFd = mkstemp(l_strFetchPath);
+
+    if (l_iFetchFd < 0)
+    {
+        perror("bench-request: fetch target file");
+        return 1;
+    }
+
+    close(l_iFetchFd);
+
+    int l_iListen = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&l_SAddr, 0x00, sizeof(l_SAddr));
+    l_SAddr.sin_family = AF_INET;
+    l_SAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    l_SAddr.sin_port = 0;
+
+    if (l_iListen < 0 || bind(l_iListen, (struct sockaddr *) &l_SAddr, sizeof(l_SAddr)) != 0
+            || listen(l_iListen, 16) != 0 || getsockname(l_iListen, (struct sockaddr *) &l_SAddr, &l_iAddrLen) != 0)
+    {
+        perror("bench-request: local server");
+        return 1;
+    }
+
+    thread(serve, l_iListen).detach();
+
+    char l_strAddress[64];
+    snprintf(l_strAddress, sizeof(l_strAddress), "http://127.0.0.1:%u", (unsigned int) ntohs(l_SAddr.sin_port));
+
+    Client *l_pClient = new Client();
+    l_pClient->setAddress(l_strAddress);
+    l_pClient->setPasswordAuthenticationCredentials("bench@localhost", "benchpassword");
+
+    ServerConnection *l_pConn = l_pClient->getServerConnection();
+
+    try
+    {
+        Json::Value l_SRequest;
+        l_SRequest["method"] = "ping";
+
+        // Authenticates and opens the connection
+        l_pConn->performServerJSONRequest(l_SRequest);
+
+        chrono::steady_clock::time_point l_SStart = chrono::steady_clock::now();
+
+        for (unsigned int i = 0; i < l_iRequests; i++)
+        {
+            l_pConn->performServerJSONRequest(l_SRequest);
+        }
+
+        report("json", l_iRequests, l_SStart);
+
+        string l_strBody(l_iBodySize, 'x');
+        map<string, string> l_SHeaders;
+        l_SHeaders["X-ELFCLOUD-PARENT"] = "1";
+        l_SHeaders["X-ELFCLOUD-KEY"] = "YmVuY2g=";
+        l_SHeaders["X-ELFCLOUD-STORE-MODE"] = "REPLACE";
+        l_SHeaders["X-ELFCLOUD-META"] = "v1:";
+
+        l_SStart = chrono::steady_clock::now();
+
+        for (unsigned int i = 0; i < l_iRequests; i++)
+        {
+            map<string, string> l_SResponseHeaders;
+            byte *l_pResponse = NULL;
+            unsigned int l_iResponseLength = 0;
+
+            l_pConn->performServerCoreRequest(l_SHeaders, (const byte *) l_strBody.data(), l_strBody.size(),
+                                              l_SResponseHeaders, &l_pResponse, &l_iResponseLength, ELFCLOUD_INTERFACE_STORE);
+            free(l_pResponse);
+        }
+
+        report("store", l_iRequests, l_SStart);
+
+        map<string, string> l_SFetchHeaders;
+        l_SFetchHeaders["X-ELFCLOUD-PARENT"] = "1";
+        l_SFetchHeaders["X-ELFCLOUD-KEY"] = "YmVuY2g=";
+
+        l_SStart = chrono::steady_clock::now();
+
+        for (unsigned int i = 0; i < l_iFetches; i++)
+        {
+            shared_ptr<DataItemFilePassthrough> l_SFile(new DataItemFilePassthrough(l_pClient));
+            map<string, string> l_SResponseHeaders;
+            byte *l_pResponse = NULL;
+            unsigned int l_iResponseLength = 0;
+
+            l_SFile->setFilePath(l_strFetchPath);
+            l_pConn->performServerCoreRequest(l_SFetchHeaders, NULL, 0, l_SResponseHeaders, &l_pResponse, &l_iResponseLength,
+                                              ELFCLOUD_INTERFACE_FETCH, l_SFile);
+            free(l_pResponse);
+        }
+
+        if (l_iFetches > 0)
+        {
+            reportThroughput("fetch", l_iFetches, l_iFetchSize, l_SStart);
+        }
+    }
+
+    catch(elfcloud::Exception &e)
+    {
+        cerr << "bench-request: " << e.getCode() << ", " << e.getMsg() << endl;
+        unlink(l_strFetchPath);
+        delete l_pClient;
+        return 1;
+    }
+
+    unlink(l_strFetchPath);
+
+    printf("Expect: 100-continue requests: %u\n", g_iExpectContinue.load());
+
+    delete l_pClient;
+    return 0;
+}
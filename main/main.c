@@ -73,6 +73,21 @@ struct ecOptionsData
      */
     char *passfile;
 
+    /**
+     * File where session is kept between mounts
+     */
+    char *sessionfile;
+
+    /**
+     * File where directory metadata is kept between mounts
+     */
+    char *snapshotfile;
+
+    /**
+     * Seconds before directory metadata is listed again
+     */
+    long metadataTTL;
+
     /**
      * Max speed up
      */
@@ -275,6 +290,9 @@ int main(
         EC_FUSE_OPT3("-k %s", "--password-file=%s", "passwordfile=%s", passfile, -1),
         EC_FUSE_OPT3("-D %ld", "--download-max-speed=%ld", "download-max-speed=%ld", maxSpeedDown, -1),
         EC_FUSE_OPT3("-U %ld", "--upload-max-speed=%ld", "upload-max-speed=%ld", maxSpeedUp, -1),
+        EC_FUSE_OPT3("-S %s", "--session-file=%s", "sessionfile=%s", sessionfile, -1),
+        EC_FUSE_OPT3("-M %s", "--metadata-snapshot=%s", "metadatasnapshot=%s", snapshotfile, -1),
+        EC_FUSE_OPT3("-T %ld", "--metadata-ttl=%ld", "metadatattl=%ld", metadataTTL, -1),
         FUSE_OPT_END
     };
 
@@ -315,6 +333,9 @@ int main(
 
     ec.password = NULL;
     ec.username = NULL;
+    ec.sessionfile = NULL;
+    ec.snapshotfile = NULL;
+    ec.metadataTTL = -1;
     ec.maxSpeedDown = -1;
     ec.maxSpeedUp = -1;
 
@@ -339,6 +360,19 @@ int main(
         return -1;
     }
 
+    /* Authenticate and connect in background while mounting */
+    if (ec_fusewrap_createElfcloudClient(m_SParams.userConfig) < 0)
+    {
+        return -1;
+    }
+
+    if (ec_fusewrap_warmup(m_SParams.username, m_SParams.password, ec.maxSpeedUp, ec.maxSpeedDown, ec.sessionfile, ec.snapshotfile, ec.metadataTTL) < 0)
+    {
+        ec_fusewrap_disconnect();
+        ec_fusewrap_free();
+        return -1;
+    }
+
     l_iRtn = stat(m_SParams.mountpoint, &l_SStat);
     if (l_iRtn == -1)
     {
@@ -347,6 +381,8 @@ int main(
         fprintf(stderr, "Please try root or sudo 'umount %s' if it helps\n", m_SParams.mountpoint);
         perror(m_SParams.mountpoint);
         fprintf(stderr, "Correct this! exiting!\n");
+        ec_fusewrap_disconnect();
+        ec_fusewrap_free();
         return -1;
     }
 
@@ -357,6 +393,8 @@ int main(
         fprintf(stderr, "Do you have permission to read and write to directory!\n");
         fprintf(stderr, "because can't mount: (%s)!\n", m_SParams.mountpoint);
         fprintf(stderr, "Correct this! exiting!\n");
+        ec_fusewrap_disconnect();
+        ec_fusewrap_free();
         return -1;
     }
 
@@ -368,17 +406,12 @@ int main(
         perror(m_SParams.mountpoint);
         fuse_unmount(m_SParams.mountpoint, l_SCh);
         fprintf(stderr, "Correct this! exiting!\n");
+        ec_fusewrap_disconnect();
+        ec_fusewrap_free();
         return -1;
 
     }
 
-    if (ec_fusewrap_createElfcloudClient(m_SParams.userConfig) < 0)
-    {
-        fuse_destroy(l_SFuse);
-        fuse_unmount(m_SParams.mountpoint, l_SCh);
-        return -1;
-    }
-
     if (ec_fusewrap_connect(m_SParams.username, m_SParams.password, ec.maxSpeedUp, ec.maxSpeedDown) < 0)
     {
         fuse_destroy(l_SFuse);
@@ -42,8 +42,6 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <cryptopp/whrlpool.h>
-#include <cryptopp/hex.h>
 
 #include <map>
 
@@ -128,6 +126,16 @@ string ElfcloudFSCache::getCacheFilename()
     return m_strCacheFilename;
 }
 
+string ElfcloudFSCache::getHashTreeFilename()
+{
+    return m_strCacheFilename + ".hashtree";
+}
+
+void ElfcloudFSCache::markWritten(uint64_t offset, uint64_t size)
+{
+    m_SHashTree.markWritten(offset, size);
+}
+
 bool ElfcloudFSCache::createItemToCache()
 {
     m_SCacheFile = fopen(getCacheFilename().data(), "w+");
@@ -142,15 +150,18 @@ bool ElfcloudFSCache::createItemToCache()
 }
 
 
-bool ElfcloudFSCache::fetchItemToCache()
+bool ElfcloudFSCache::fetchItemToCache(shared_ptr<elfcloud::DataItem> dataitem)
 {
     shared_ptr<elfcloud::DataItemFilePassthrough> l_SFile(new DataItemFilePassthrough(m_SEclib));
-    string l_SChecksum;
-    FILE *l_SChecksumFile = NULL;
-    std::stringstream l_strSs;
 
     l_SFile->setFilePath(getCacheFilename().data());
 
+    // Listing says size of file, so cluster doesn't have to be listed again
+    if( dataitem != 0x00 )
+    {
+        l_SFile->setListedContent(dataitem->getDataLength(), dataitem->getDataItemMd5Sum(), dataitem->getCompression().size() > 0);
+    }
+
     try
     {
         l_SFile->setDataItemName(getOriginalFilename());
@@ -185,45 +196,38 @@ bool ElfcloudFSCache::fetchItemToCache()
 
     }
 
-    l_SChecksum = getFileHash(getCacheFilename().data());
-    l_strSs << getCacheFilename() << "." << "whirlpool";
-    l_SChecksumFile = fopen(l_strSs.str().data(), "w");
-
-    if( l_SChecksumFile == NULL )
+    // Tree of fetched file is baseline for change detection in storeItemToCloud()
+    if( m_SHashTree.build(getCacheFilename().data()) == false ||
+            m_SHashTree.save(getHashTreeFilename().data()) == false )
     {
         cerr << "ElfcloudFSCache::fetchItemToCache: Cache error" << endl;
         ElfcloudFSCache::removeItemFromCache();
         return false;
     }
 
-    fwrite(l_SChecksum.data(), 128, 1, l_SChecksumFile);
-    fclose(l_SChecksumFile);
-
     return true;
 }
 
-bool ElfcloudFSCache::storeItemToCloud()
+bool ElfcloudFSCache::storeItemToCloud(bool &uploaded)
 {
     shared_ptr<elfcloud::DataItemFilePassthrough> l_SFile(new DataItemFilePassthrough(m_SEclib));
-    char l_strFileChecksum[128];
-    string l_SChecksum;
-    FILE *l_SChecksumFile = NULL;
-    std::stringstream l_strSs;
-
-    l_strSs << getCacheFilename() << "." << "whirlpool";
-    l_SChecksumFile = fopen(l_strSs.str().data(), "r");
+    ElfcloudFSHashTree l_SBaseline;
+    bool l_bHashed = false;
 
-    memset(l_strFileChecksum, 0x00, 128);
+    uploaded = false;
 
-    if( l_SChecksumFile != NULL )
+    if( m_SCacheFile != NULL )
     {
-        fread(l_strFileChecksum, 128, 1, l_SChecksumFile);
-        fclose(l_SChecksumFile);
+        fflush(m_SCacheFile);
+    }
 
-        if( strncmp( l_strFileChecksum, getFileHash(getCacheFilename().data()).data(), 128) == 0 )
-        {
-            return true;
-        }
+    // Only blocks written since last fetch or store are rehashed
+    l_bHashed = m_SHashTree.refresh(getCacheFilename().data());
+
+    if( l_bHashed && l_SBaseline.load(getHashTreeFilename().data()) &&
+            l_SBaseline.getRootHash() == m_SHashTree.getRootHash() )
+    {
+        return true;
     }
 
     l_SFile->setFilePath(getCacheFilename().data());
@@ -258,6 +262,12 @@ bool ElfcloudFSCache::storeItemToCloud()
     }
 
     m_SDataItem = l_SFile;
+    uploaded = true;
+
+    if( l_bHashed )
+    {
+        m_SHashTree.save(getHashTreeFilename().data());
+    }
 
     return true;
 }
@@ -267,7 +277,7 @@ bool ElfcloudFSCache::removeItemFromCache()
     struct stat l_SSb;
     std::stringstream l_strSs;
 
-    l_strSs << getCacheFilename() << "." << "whirlpool";
+    l_strSs << getHashTreeFilename();
 
     if( m_SCacheFile != NULL )
     {
@@ -289,18 +299,6 @@ bool ElfcloudFSCache::removeItemFromCache()
     return true;
 }
 
-
-string ElfcloudFSCache::getFileHash(const char *path)
-{
-    string l_strResult;
-    CryptoPP::Whirlpool l_SWhirlpool;
-    CryptoPP::FileSource(path, true,
-                         new CryptoPP::HashFilter(l_SWhirlpool, new CryptoPP::HexEncoder(
-                                     new CryptoPP::StringSink(l_strResult), true)));
-    return l_strResult;
-
-}
-
 shared_ptr < elfcloud::DataItem > ElfcloudFSCache::getStoredDataItem()
 {
     return m_SDataItem;
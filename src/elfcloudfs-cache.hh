@@ -63,6 +63,8 @@
 
 #include <API.h>
 
+#include "elfcloudfs-hashtree.hh"
+
 using namespace std;
 using namespace elfcloud;
 
@@ -80,6 +82,7 @@ private:
     string m_strCacheFilename;
     string m_strOrigFilename;
     Client *m_SEclib;
+    ElfcloudFSHashTree m_SHashTree;
 
 
     string getOpenFileCacheWholePathByPath(
@@ -92,11 +95,9 @@ private:
         uint64_t fh
     );
 
-    string getFileHash(
-        const char *path
+    string getHashTreeFilename(
     );
 
-
 public:
 
     /**
@@ -179,16 +180,31 @@ public:
 
     /**
      * Fetch item to cache
+     * @param dataitem Dataitem as listed, its size and md5sum let large
+     * file to be fetched in parallel ranges. May be NULL
      * @return true if succes false if not
      */
     bool fetchItemToCache(
+        shared_ptr <elfcloud::DataItem> dataitem
     );
 
     /**
      * Send file to cloud
+     * @param uploaded set to false when the file was unchanged and nothing was sent
      * @return true is success and false if not
      */
     bool storeItemToCloud(
+        bool &uploaded
+    );
+
+    /**
+     * Tell cache that part of file has been written
+     * @param offset Offset of write
+     * @param size Bytes written
+     */
+    void markWritten(
+        uint64_t offset,
+        uint64_t size
     );
 
     /**
@@ -42,6 +42,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <string.h>
+#include <time.h>
 
 #include <map>
 
@@ -61,9 +63,25 @@ ElfcloudDirCache::ElfcloudDirCache(
     m_SEclib = eclib;
     m_SCluster = cluster;
     m_strPath = path;
+    m_lGeneration = 0;
 
-    reloadDirectories();
-    reloadFiles();
+    reload();
+}
+
+ElfcloudDirCache::ElfcloudDirCache(
+    Client *eclib,
+    string path,
+    shared_ptr < elfcloud::Cluster > cluster,
+    list < shared_ptr < elfcloud::Cluster >> &clusters,
+    list < shared_ptr < elfcloud::DataItem >> &dataitems
+)
+{
+    m_SEclib = eclib;
+    m_SCluster = cluster;
+    m_strPath = path;
+    m_lGeneration = 0;
+
+    setContents(clusters, dataitems);
 }
 
 /**
@@ -154,6 +172,175 @@ vector<string> ElfcloudDirCache::getDirectoryNames()
     return l_SNames;
 }
 
+string ElfcloudDirCache::getPath()
+{
+    return m_strPath;
+}
+
+uint64_t ElfcloudDirCache::getGeneration()
+{
+    return m_lGeneration;
+}
+
+void ElfcloudDirCache::setContents(list<shared_ptr<elfcloud::Cluster>> &clusters, list<shared_ptr<elfcloud::DataItem>> &dataitems)
+{
+    m_SDirs.clear();
+    m_SFiles.clear();
+    m_lGeneration++;
+
+    for (list<shared_ptr<elfcloud::Cluster>>::iterator iter = clusters.begin(); iter != clusters.end(); iter++)
+    {
+        m_SDirs.insert(std::pair<string, shared_ptr<elfcloud::Cluster>>((*iter)->getClusterName(), (*iter)));
+    }
+
+    for (list<shared_ptr<elfcloud::DataItem>>::iterator iter = dataitems.begin(); iter != dataitems.end(); iter++)
+    {
+        m_SFiles.insert(std::pair<string, shared_ptr<elfcloud::DataItem>>((*iter)->getDataItemName(), (*iter)));
+    }
+}
+
+size_t ElfcloudDirCache::applyListing(list<shared_ptr<elfcloud::Cluster>> &clusters, list<shared_ptr<elfcloud::DataItem>> &dataitems)
+{
+    map<uint64_t, shared_ptr<elfcloud::Cluster>> l_SOldDirs;
+    map<uint64_t, shared_ptr<elfcloud::DataItem>> l_SOldFiles;
+    map<string, shared_ptr<elfcloud::Cluster>> l_SDirs;
+    map<string, shared_ptr<elfcloud::DataItem>> l_SFiles;
+    size_t l_iMatched = 0;
+    size_t l_iChanged = 0;
+
+    for (map<string, shared_ptr<elfcloud::Cluster>>::iterator iter = m_SDirs.begin(); iter != m_SDirs.end(); iter++)
+    {
+        l_SOldDirs[(*iter).second->getClusterId()] = (*iter).second;
+    }
+
+    for (map<string, shared_ptr<elfcloud::DataItem>>::iterator iter = m_SFiles.begin(); iter != m_SFiles.end(); iter++)
+    {
+        l_SOldFiles[(*iter).second->getId()] = (*iter).second;
+    }
+
+    // Unchanged entries keep their objects, anyone holding one keeps seeing the current entry
+    for (list<shared_ptr<elfcloud::Cluster>>::iterator iter = clusters.begin(); iter != clusters.end(); iter++)
+    {
+        map<uint64_t, shared_ptr<elfcloud::Cluster>>::iterator l_SOld = l_SOldDirs.find((*iter)->getClusterId());
+        shared_ptr<elfcloud::Cluster> l_SCluster = (*iter);
+
+        if (l_SOld != l_SOldDirs.end())
+        {
+            l_iMatched++;
+        }
+
+        if (l_SOld != l_SOldDirs.end() &&
+                (*l_SOld).second->getClusterName() == (*iter)->getClusterName() &&
+                (*l_SOld).second->getLastModified() == (*iter)->getLastModified())
+        {
+            l_SCluster = (*l_SOld).second;
+        }
+        else
+        {
+            l_iChanged++;
+        }
+
+        l_SDirs.insert(std::pair<string, shared_ptr<elfcloud::Cluster>>(l_SCluster->getClusterName(), l_SCluster));
+    }
+
+    for (list<shared_ptr<elfcloud::DataItem>>::iterator iter = dataitems.begin(); iter != dataitems.end(); iter++)
+    {
+        map<uint64_t, shared_ptr<elfcloud::DataItem>>::iterator l_SOld = l_SOldFiles.find((*iter)->getId());
+        shared_ptr<elfcloud::DataItem> l_SDataItem = (*iter);
+
+        if (l_SOld != l_SOldFiles.end())
+        {
+            l_iMatched++;
+        }
+
+        if (l_SOld != l_SOldFiles.end() &&
+                (*l_SOld).second->getDataItemName() == (*iter)->getDataItemName() &&
+                (*l_SOld).second->getLastModified() == (*iter)->getLastModified() &&
+                (*l_SOld).second->getDataItemMd5Sum() == (*iter)->getDataItemMd5Sum())
+        {
+            l_SDataItem = (*l_SOld).second;
+        }
+        else
+        {
+            l_iChanged++;
+        }
+
+        l_SFiles.insert(std::pair<string, shared_ptr<elfcloud::DataItem>>(l_SDataItem->getDataItemName(), l_SDataItem));
+    }
+
+    // IDs not listed are gone from cloud
+    l_iChanged += l_SOldDirs.size() + l_SOldFiles.size() - l_iMatched;
+
+    if (l_iChanged > 0)
+    {
+        m_SDirs.swap(l_SDirs);
+        m_SFiles.swap(l_SFiles);
+        m_lGeneration++;
+    }
+
+    return l_iChanged;
+}
+
+bool ElfcloudDirCache::updateFile(string fileName, uint64_t size)
+{
+    shared_ptr<elfcloud::DataItem> l_SOldDataItem = getFile(fileName);
+    char l_strTime[48];
+    time_t l_STime = time(NULL);
+
+    if( l_SOldDataItem == 0x00 )
+    {
+        return false;
+    }
+
+    // Entry is replaced, not changed, object may be held elsewhere
+    shared_ptr<elfcloud::DataItem> l_SDataItem(new elfcloud::DataItem(m_SEclib));
+    l_SDataItem->assign(l_SOldDataItem);
+
+    memset(l_strTime, 0x00, 48);
+    strftime(l_strTime, 48, "%Y-%m-%dT%H:%M:%S", localtime(&l_STime));
+
+    l_SDataItem->setCompression("", 0);
+    l_SDataItem->setDataLength(size);
+    l_SDataItem->setLastModified(l_strTime);
+    l_SDataItem->setLastAccessed(l_strTime);
+    l_SDataItem->setMD5Sum("");
+    m_SFiles[fileName] = l_SDataItem;
+    m_lGeneration++;
+
+    return true;
+}
+
+bool ElfcloudDirCache::renameFile(string fileName, string newFileName)
+{
+    shared_ptr<elfcloud::DataItem> l_SDataItem = getFile(fileName);
+
+    if( l_SDataItem == 0x00 )
+    {
+        return false;
+    }
+
+    m_SFiles.erase(fileName);
+    m_SFiles[newFileName] = l_SDataItem;
+    m_lGeneration++;
+
+    return true;
+}
+
+bool ElfcloudDirCache::reload()
+{
+    std::map<std::string, std::list<shared_ptr<elfcloud::Object>>*> *l_SMapContents = m_SCluster->listContents();
+    list < shared_ptr < elfcloud::Cluster >> *l_SListClusters = (list < shared_ptr < elfcloud::Cluster >> *) (*l_SMapContents)["clusters"];
+    list < shared_ptr < elfcloud::DataItem >> *l_SListDataItems = (list < shared_ptr < elfcloud::DataItem >> *) (*l_SMapContents)["dataitems"];
+
+    setContents(*l_SListClusters, *l_SListDataItems);
+
+    delete l_SListClusters;
+    delete l_SListDataItems;
+    delete l_SMapContents;
+
+    return true;
+}
+
 bool ElfcloudDirCache::reloadDirectories()
 {
     shared_ptr<elfcloud::Cluster> l_STmpCluster = 0x00;
@@ -161,6 +348,7 @@ bool ElfcloudDirCache::reloadDirectories()
     std::map<string, ElfcloudDirCache *>::iterator l_pCache;
 
     m_SDirs.clear();
+    m_lGeneration++;
 
     for (list<shared_ptr<elfcloud::Cluster>>::iterator iter = l_SListClusters->begin(); iter != l_SListClusters->end(); iter++)
     {
@@ -179,6 +367,7 @@ bool ElfcloudDirCache::reloadFiles()
     list < shared_ptr < elfcloud::DataItem >> *l_SListDataItems =  m_SCluster->listDataItems();
 
     m_SFiles.clear();
+    m_lGeneration++;
 
     for (list<shared_ptr<elfcloud::DataItem>>::iterator iter = l_SListDataItems->begin(); iter != l_SListDataItems->end(); iter++)
     {
@@ -205,6 +394,7 @@ bool ElfcloudDirCache::removeDirectory(string cluster)
     if( l_SIMapterator != m_SDirs.end() )
     {
         m_SDirs.erase(l_SIMapterator);
+        m_lGeneration++;
         return true;
     }
 
@@ -226,6 +416,7 @@ bool ElfcloudDirCache::removeFile(string fileName)
     if( l_SIMapterator != m_SFiles.end() )
     {
         m_SFiles.erase(l_SIMapterator);
+        m_lGeneration++;
     }
 
     return false;
@@ -237,6 +428,7 @@ bool ElfcloudDirCache::addDirectory(shared_ptr<elfcloud::Cluster> cluster)
     removeDirectory(cluster->getClusterName());
 
     m_SDirs.insert(std::pair<string, shared_ptr<elfcloud::Cluster>>(cluster->getClusterName(), cluster));
+    m_lGeneration++;
 
     return true;
 }
@@ -246,6 +438,7 @@ bool ElfcloudDirCache::addFile(shared_ptr<elfcloud::DataItem> dataitem)
     removeFile(dataitem->getDataItemName());
 
     m_SFiles.insert(std::pair<string, shared_ptr<elfcloud::DataItem>>(dataitem->getDataItemName(), dataitem));
+    m_lGeneration++;
 
     return true;
 }
@@ -56,6 +56,7 @@ private:
     shared_ptr <elfcloud::Cluster> m_SCluster;
     string m_strPath;
     long l_STime;
+    uint64_t m_lGeneration;
 
     map <string, shared_ptr <elfcloud::Cluster>> m_SDirs;
 
@@ -76,6 +77,23 @@ public:
         shared_ptr <elfcloud::Cluster> cluster
     );
 
+    /**
+     *  Constructor for contents known already (metadata snapshot),
+     *  nothing is loaded from cloud
+     * @param eclib Elfcloud lib
+     * @param path What path this prensents
+     * @param cluster Cluster for this path
+     * @param clusters Sub-clusters
+     * @param dataitems Dataitems
+     */
+    ElfcloudDirCache(
+        Client *eclib,
+        string path,
+        shared_ptr <elfcloud::Cluster> cluster,
+        list <shared_ptr <elfcloud::Cluster>> &clusters,
+        list <shared_ptr <elfcloud::DataItem>> &dataitems
+    );
+
     /**
      * Destructor
      */
@@ -156,6 +174,78 @@ public:
     vector <string> getDirectoryNames(
     );
 
+    /**
+     * Path this cache presents
+     * @return path
+     */
+    string getPath(
+    );
+
+    /**
+     * Counter of changes to contents, any reload, add or remove changes it
+     * @return generation
+     */
+    uint64_t getGeneration(
+    );
+
+    /**
+     * Replace both Clusters/Directories and Files/Dataitems
+     * @param clusters Sub-clusters
+     * @param dataitems Dataitems
+     */
+    void setContents(
+        list <shared_ptr <elfcloud::Cluster>> &clusters,
+        list <shared_ptr <elfcloud::DataItem>> &dataitems
+    );
+
+    /**
+     * Bring contents up to date with a listing from cloud. Entries are
+     * matched by ID, those with same name, modified date (and md5sum for
+     * Files/Dataitems) are kept as they are, others are replaced, added
+     * or removed. Listing must be decoded into objects of its own (not
+     * from Client caches) so that they can be compared with the kept ones
+     * @param clusters Sub-clusters as listed
+     * @param dataitems Dataitems as listed
+     * @return number of entries changed
+     */
+    size_t applyListing(
+        list <shared_ptr <elfcloud::Cluster>> &clusters,
+        list <shared_ptr <elfcloud::DataItem>> &dataitems
+    );
+
+    /**
+     * Update file after it has been written, without listing it from
+     * cloud. Size and timestamps are set to a copy of entry and md5sum
+     * is cleared so that next listing replaces entry with one from cloud
+     * @param fileName File that has been written
+     * @param size Content size
+     * @return true if file was found false if not
+     */
+    bool updateFile(
+        string fileName,
+        uint64_t size
+    );
+
+    /**
+     * Move file to new name in list, after it has been renamed in cloud
+     * @param fileName Old name
+     * @param newFileName New name
+     * @return true if file was found false if not
+     */
+    bool renameFile(
+        string fileName,
+        string newFileName
+    );
+
+    /**
+     * Reload both Clusters/Directories and Files/Dataitems
+     * with a single list_contents request
+     *
+     * @return true is success false if not
+     */
+    bool reload(
+    );
+
     /**
      * Reload Clusters/Directories
      *
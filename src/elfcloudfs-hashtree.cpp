@@ -0,0 +1,437 @@
+
+/*
+ * Copyright (c) 2015, Ilmi Solutions Oy
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Ilmi Solutions Oy nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Revision info:
+ * $Date$
+ * $Rev$
+ * $Author$
+ */
+
+#include "elfcloudfs-hashtree.hh"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+#include <thread>
+
+using namespace std;
+
+static size_t getBlockCountForSize(uint64_t size)
+{
+    return (size + ElfcloudFSHashTree::BLOCK_SIZE - 1) / ElfcloudFSHashTree::BLOCK_SIZE;
+}
+
+static string toHex(const string &data)
+{
+    static const char l_cDigits[] = "0123456789abcdef";
+    string l_strHex;
+
+    l_strHex.reserve(data.size() * 2);
+
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        l_strHex += l_cDigits[(unsigned char) data[i] >> 4];
+        l_strHex += l_cDigits[(unsigned char) data[i] & 0x0f];
+    }
+
+    return l_strHex;
+}
+
+static bool fromHex(const string &hex, string &data)
+{
+    data.clear();
+
+    if (hex.size() % 2)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < hex.size(); i += 2)
+    {
+        char l_strByte[3] = { hex[i], hex[i + 1], 0 };
+        char *l_pEnd = NULL;
+        long l_iByte = strtol(l_strByte, &l_pEnd, 16);
+
+        if (*l_pEnd != 0)
+        {
+            return false;
+        }
+
+        data += (char) l_iByte;
+    }
+
+    return true;
+}
+
+ElfcloudFSHashTree::ElfcloudFSHashTree()
+{
+    m_lFileSize = 0;
+    m_iDirtyCount = 0;
+}
+
+bool ElfcloudFSHashTree::hashBlocks(const char *path, const vector<size_t> &blocks)
+{
+    if (blocks.empty())
+    {
+        return true;
+    }
+
+    int l_iFd = open(path, O_RDONLY);
+
+    if (l_iFd < 0)
+    {
+        cerr << "ElfcloudFSHashTree::hashBlocks: Can't open " << path << endl;
+        return false;
+    }
+
+    atomic<size_t> l_iNext(0);
+    atomic<bool> l_bFailed(false);
+
+    // Blocks are taken from a shared counter, pread() keeps threads off each other's file position
+    auto l_SWorker = [&]()
+    {
+        vector<byte> l_SBuffer(BLOCK_SIZE);
+        CryptoPP::Whirlpool l_SWhirlpool;
+        byte l_cDigest[CryptoPP::Whirlpool::DIGESTSIZE];
+
+        for (size_t i = l_iNext++; i < blocks.size() && !l_bFailed; i = l_iNext++)
+        {
+            uint64_t l_lStart = (uint64_t) blocks[i] * BLOCK_SIZE;
+            size_t l_iLength = (size_t) min((uint64_t) BLOCK_SIZE, m_lFileSize - l_lStart);
+            size_t l_iRead = 0;
+
+            while (l_iRead < l_iLength)
+            {
+                ssize_t l_iRtn = pread(l_iFd, &l_SBuffer[l_iRead], l_iLength - l_iRead, l_lStart + l_iRead);
+
+                if (l_iRtn < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+
+                if (l_iRtn <= 0)
+                {
+                    l_bFailed = true;
+                    return;
+                }
+
+                l_iRead += l_iRtn;
+            }
+
+            l_SWhirlpool.CalculateDigest(l_cDigest, &l_SBuffer[0], l_iLength);
+            m_SBlockHashes[blocks[i]].assign((const char *) l_cDigest, sizeof(l_cDigest));
+        }
+    };
+
+    unsigned int l_iThreads = thread::hardware_concurrency();
+
+    if (l_iThreads == 0)
+    {
+        l_iThreads = 1;
+    }
+
+    if (l_iThreads > blocks.size())
+    {
+        l_iThreads = blocks.size();
+    }
+
+    vector<thread> l_SWorkers;
+
+    for (unsigned int i = 1; i < l_iThreads; i++)
+    {
+        try
+        {
+            l_SWorkers.push_back(thread(l_SWorker));
+        }
+
+        catch (system_error &)
+        {
+            // Out of threads, the rest is hashed by the threads already running
+            break;
+        }
+    }
+
+    l_SWorker();
+
+    for (size_t i = 0; i < l_SWorkers.size(); i++)
+    {
+        l_SWorkers[i].join();
+    }
+
+    close(l_iFd);
+
+    if (l_bFailed)
+    {
+        cerr << "ElfcloudFSHashTree::hashBlocks: Can't read " << path << endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool ElfcloudFSHashTree::build(const char *path)
+{
+    struct stat l_SSb;
+
+    if (stat(path, &l_SSb) != 0)
+    {
+        return false;
+    }
+
+    m_lFileSize = l_SSb.st_size;
+    m_SBlockHashes.assign(getBlockCountForSize(m_lFileSize), string());
+    m_SDirty.assign(m_SBlockHashes.size(), 0);
+    m_iDirtyCount = 0;
+
+    vector<size_t> l_SBlocks;
+
+    for (size_t i = 0; i < m_SBlockHashes.size(); i++)
+    {
+        l_SBlocks.push_back(i);
+    }
+
+    if (!hashBlocks(path, l_SBlocks))
+    {
+        m_SDirty.assign(m_SBlockHashes.size(), 1);
+        m_iDirtyCount = m_SDirty.size();
+        return false;
+    }
+
+    return true;
+}
+
+void ElfcloudFSHashTree::markWritten(uint64_t offset, uint64_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    if (offset + size > m_lFileSize)
+    {
+        setFileSize(offset + size);
+    }
+
+    for (size_t i = offset / BLOCK_SIZE; i <= (offset + size - 1) / BLOCK_SIZE; i++)
+    {
+        if (!m_SDirty[i])
+        {
+            m_SDirty[i] = 1;
+            m_iDirtyCount++;
+        }
+    }
+}
+
+void ElfcloudFSHashTree::setFileSize(uint64_t size)
+{
+    size_t l_iOldBlocks = m_SBlockHashes.size();
+    size_t l_iNewBlocks = getBlockCountForSize(size);
+
+    if (size == m_lFileSize)
+    {
+        return;
+    }
+
+    // Partial last block changes length in both directions
+    size_t l_iLastBlock = (size < m_lFileSize ? l_iNewBlocks : l_iOldBlocks);
+
+    m_SBlockHashes.resize(l_iNewBlocks);
+    m_SDirty.resize(l_iNewBlocks, 1);
+    m_lFileSize = size;
+
+    if (l_iLastBlock > 0 && l_iLastBlock <= l_iNewBlocks)
+    {
+        m_SDirty[l_iLastBlock - 1] = 1;
+    }
+
+    m_iDirtyCount = 0;
+
+    for (size_t i = 0; i < m_SDirty.size(); i++)
+    {
+        m_iDirtyCount += m_SDirty[i] ? 1 : 0;
+    }
+}
+
+bool ElfcloudFSHashTree::refresh(const char *path)
+{
+    struct stat l_SSb;
+
+    // Size of file decides, it may have been changed without a write (open with O_TRUNC)
+    if (stat(path, &l_SSb) != 0)
+    {
+        return false;
+    }
+
+    setFileSize(l_SSb.st_size);
+
+    if (m_iDirtyCount == 0)
+    {
+        return true;
+    }
+
+    vector<size_t> l_SBlocks;
+
+    for (size_t i = 0; i < m_SDirty.size(); i++)
+    {
+        if (m_SDirty[i])
+        {
+            l_SBlocks.push_back(i);
+        }
+    }
+
+    if (!hashBlocks(path, l_SBlocks))
+    {
+        return false;
+    }
+
+    m_SDirty.assign(m_SDirty.size(), 0);
+    m_iDirtyCount = 0;
+    return true;
+}
+
+string ElfcloudFSHashTree::getRootHash()
+{
+    CryptoPP::Whirlpool l_SWhirlpool;
+    byte l_cDigest[CryptoPP::Whirlpool::DIGESTSIZE];
+    char l_strSize[32];
+
+    snprintf(l_strSize, sizeof(l_strSize), "%llu:", (unsigned long long) m_lFileSize);
+    l_SWhirlpool.Update((const byte *) l_strSize, strlen(l_strSize));
+
+    for (size_t i = 0; i < m_SBlockHashes.size(); i++)
+    {
+        l_SWhirlpool.Update((const byte *) m_SBlockHashes[i].data(), m_SBlockHashes[i].size());
+    }
+
+    l_SWhirlpool.Final(l_cDigest);
+    return toHex(string((const char *) l_cDigest, sizeof(l_cDigest)));
+}
+
+vector<size_t> ElfcloudFSHashTree::getChangedBlocks(const ElfcloudFSHashTree &other)
+{
+    vector<size_t> l_SChanged;
+
+    for (size_t i = 0; i < m_SBlockHashes.size(); i++)
+    {
+        if (i >= other.m_SBlockHashes.size() || m_SDirty[i] || m_SBlockHashes[i] != other.m_SBlockHashes[i])
+        {
+            l_SChanged.push_back(i);
+        }
+    }
+
+    return l_SChanged;
+}
+
+bool ElfcloudFSHashTree::save(const char *path)
+{
+    // Written to a temporary file first, a crash must not leave a truncated tree behind
+    string l_strTmp = string(path) + ".tmp";
+    ofstream l_SOut(l_strTmp.c_str(), ofstream::out | ofstream::trunc);
+
+    l_SOut << "v1" << endl << m_lFileSize << endl << BLOCK_SIZE << endl;
+
+    for (size_t i = 0; i < m_SBlockHashes.size(); i++)
+    {
+        l_SOut << toHex(m_SBlockHashes[i]) << endl;
+    }
+
+    l_SOut.close();
+
+    if (l_SOut.fail() || rename(l_strTmp.c_str(), path) != 0)
+    {
+        unlink(l_strTmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool ElfcloudFSHashTree::load(const char *path)
+{
+    ifstream l_SIn(path);
+    string l_strVersion;
+    uint64_t l_lFileSize = 0;
+    size_t l_iBlockSize = 0;
+
+    l_SIn >> l_strVersion >> l_lFileSize >> l_iBlockSize;
+
+    if (l_SIn.fail() || l_strVersion != "v1" || l_iBlockSize != BLOCK_SIZE)
+    {
+        return false;
+    }
+
+    vector<string> l_SHashes(getBlockCountForSize(l_lFileSize));
+
+    for (size_t i = 0; i < l_SHashes.size(); i++)
+    {
+        string l_strHex;
+        l_SIn >> l_strHex;
+
+        if (l_SIn.fail() || l_strHex.size() != 2 * CryptoPP::Whirlpool::DIGESTSIZE || !fromHex(l_strHex, l_SHashes[i]))
+        {
+            return false;
+        }
+    }
+
+    m_lFileSize = l_lFileSize;
+    m_SBlockHashes.swap(l_SHashes);
+    m_SDirty.assign(m_SBlockHashes.size(), 0);
+    m_iDirtyCount = 0;
+    return true;
+}
+
+uint64_t ElfcloudFSHashTree::getFileSize()
+{
+    return m_lFileSize;
+}
+
+size_t ElfcloudFSHashTree::getBlockCount()
+{
+    return m_SBlockHashes.size();
+}
+
+size_t ElfcloudFSHashTree::getDirtyCount()
+{
+    return m_iDirtyCount;
+}
@@ -0,0 +1,162 @@
+
+/*
+ * Copyright (c) 2015, Ilmi Solutions Oy
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Ilmi Solutions Oy nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Revision info:
+ * $Date$
+ * $Rev$
+ * $Author$
+ */
+
+#ifndef _ELFCLOUDFS_HASHTREE_H_
+#define _ELFCLOUDFS_HASHTREE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <cryptopp/whrlpool.h>
+
+using namespace std;
+
+/**
+ * Block hashes of a cache file. The file is split into BLOCK_SIZE blocks,
+ * each block has a Whirlpool digest and the root hash covers the file size
+ * and all block digests. Writes only mark blocks dirty, refresh() rehashes
+ * the dirty blocks, so change detection costs time proportional to what
+ * was written instead of the whole file. Blocks are hashed on several
+ * threads.
+ */
+class ElfcloudFSHashTree
+{
+private:
+    uint64_t m_lFileSize;
+    vector<string> m_SBlockHashes;
+    vector<char> m_SDirty;
+    size_t m_iDirtyCount;
+
+    bool hashBlocks(
+        const char *path,
+        const vector<size_t> &blocks
+    );
+
+public:
+    static const size_t BLOCK_SIZE = 1024 * 1024;
+
+    /**
+     * Constructor, empty tree of empty file
+     */
+    ElfcloudFSHashTree(
+    );
+
+    /**
+     * Hash all blocks of file
+     * @param path File to hash
+     * @return true if success and false if not
+     */
+    bool build(
+        const char *path
+    );
+
+    /**
+     * Mark blocks written dirty, file grows if write goes past end
+     * @param offset Offset of write
+     * @param size Bytes written
+     */
+    void markWritten(
+        uint64_t offset,
+        uint64_t size
+    );
+
+    /**
+     * Set file size, last block and blocks past old end become dirty
+     * @param size New file size
+     */
+    void setFileSize(
+        uint64_t size
+    );
+
+    /**
+     * Rehash dirty blocks
+     * @param path File to hash
+     * @return true if success and false if not
+     */
+    bool refresh(
+        const char *path
+    );
+
+    /**
+     * Root hash, valid when there are no dirty blocks
+     * @return hex encoded Whirlpool digest
+     */
+    string getRootHash(
+    );
+
+    /**
+     * Blocks whose hash differs from other tree, blocks past end of other tree count as changed
+     * @param other Tree to compare with
+     * @return indexes of changed blocks
+     */
+    vector<size_t> getChangedBlocks(
+        const ElfcloudFSHashTree &other
+    );
+
+    /**
+     * Save tree to sidecar file
+     * @param path Sidecar file
+     * @return true if success and false if not
+     */
+    bool save(
+        const char *path
+    );
+
+    /**
+     * Load tree from sidecar file
+     * @param path Sidecar file
+     * @return true if success and false if file is missing or damaged
+     */
+    bool load(
+        const char *path
+    );
+
+    uint64_t getFileSize(
+    );
+
+    size_t getBlockCount(
+    );
+
+    size_t getDirtyCount(
+    );
+};
+
+#endif
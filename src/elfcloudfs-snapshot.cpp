@@ -0,0 +1,494 @@
+
+/*
+ * Copyright (c) 2015, Ilmi Solutions Oy
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Ilmi Solutions Oy nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Revision info:
+ * $Date$
+ * $Rev$
+ * $Author$
+ */
+
+#include "elfcloudfs-snapshot.hh"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace elfcloud;
+
+static const char SNAPSHOT_MAGIC[8] = { 'E', 'C', 'F', 'S', 'S', 'N', 'A', 'P' };
+
+/**
+ * Smallest possible sizes (all strings empty), counts read from file are
+ * checked against them before anything is allocated for the records
+ */
+static const size_t SNAPSHOT_HEADER_SIZE = sizeof(SNAPSHOT_MAGIC) + 4 + 4 + 8;
+static const size_t SNAPSHOT_CLUSTER_SIZE = 8 + 8 + 4 + 8 + 8 + 8 + 4 + 4 + 4;
+static const size_t SNAPSHOT_DATAITEM_SIZE = 8 + 8 + 4 + 8 + 4 + 4 + 4 + 4;
+static const size_t SNAPSHOT_DIR_SIZE = 4 + SNAPSHOT_CLUSTER_SIZE + 8 + 8;
+
+/**
+ * DataItem::parseMetaDataString() copies meta to a 40960 byte buffer
+ * with terminating zero, longer one can't come from cloud
+ */
+static const size_t SNAPSHOT_META_MAX = 40960 - 1;
+
+/**
+ * Snapshot is written in host byte order, it is a cache of one machine
+ */
+static void putU32(string &out, uint32_t value)
+{
+    out.append((const char *) &value, sizeof(value));
+}
+
+static void putU64(string &out, uint64_t value)
+{
+    out.append((const char *) &value, sizeof(value));
+}
+
+static void putString(string &out, const string &value)
+{
+    putU32(out, value.size());
+    out.append(value);
+}
+
+static void putCluster(string &out, shared_ptr<elfcloud::Cluster> cluster)
+{
+    vector<string> l_SPermissions = cluster->getPermissions();
+
+    putU64(out, cluster->getClusterId());
+    putU64(out, cluster->getClusterParentId());
+    putString(out, cluster->getClusterName());
+    putU64(out, cluster->getClusterDescendants());
+    putU64(out, cluster->getClusterDataItems());
+    putU64(out, cluster->getSizeBytes());
+    putString(out, cluster->getLastAccessed());
+    putString(out, cluster->getLastModified());
+    putU32(out, l_SPermissions.size());
+
+    for (size_t i = 0; i < l_SPermissions.size(); i++)
+    {
+        putString(out, l_SPermissions[i]);
+    }
+}
+
+static void putDataItem(string &out, shared_ptr<elfcloud::DataItem> dataitem)
+{
+    std::map<string, string> &l_SMeta = dataitem->getMetaHeaderKVPairs();
+    string l_strMeta = "v1:";
+
+    // Values are kept escaped as parsed, so they go back to parser as they are
+    for (std::map<string, string>::iterator iter = l_SMeta.begin(); iter != l_SMeta.end(); iter++)
+    {
+        l_strMeta += (*iter).first + ":" + (*iter).second + ":";
+    }
+
+    l_strMeta += ":";
+
+    putU64(out, dataitem->getId());
+    putU64(out, dataitem->getParentId());
+    putString(out, dataitem->getDataItemName());
+    putU64(out, dataitem->getDataLength());
+    putString(out, dataitem->getLastAccessed());
+    putString(out, dataitem->getLastModified());
+    putString(out, dataitem->getDataItemMd5Sum());
+    putString(out, l_strMeta);
+}
+
+/**
+ * Bounds checked reader over mapped snapshot
+ */
+class ElfcloudFSSnapshotReader
+{
+private:
+    const char *m_pPos;
+    const char *m_pEnd;
+
+public:
+    ElfcloudFSSnapshotReader(const char *begin, const char *end)
+    {
+        m_pPos = begin;
+        m_pEnd = end;
+    }
+
+    bool getBytes(void *out, size_t size)
+    {
+        if ((size_t)(m_pEnd - m_pPos) < size)
+        {
+            return false;
+        }
+
+        memcpy(out, m_pPos, size);
+        m_pPos += size;
+        return true;
+    }
+
+    bool getU32(uint32_t &value)
+    {
+        return getBytes(&value, sizeof(value));
+    }
+
+    bool getU64(uint64_t &value)
+    {
+        return getBytes(&value, sizeof(value));
+    }
+
+    bool getString(string &value)
+    {
+        uint32_t l_iSize = 0;
+
+        if (!getU32(l_iSize) || (size_t)(m_pEnd - m_pPos) < l_iSize)
+        {
+            return false;
+        }
+
+        value.assign(m_pPos, l_iSize);
+        m_pPos += l_iSize;
+        return true;
+    }
+
+    bool atEnd()
+    {
+        return m_pPos == m_pEnd;
+    }
+
+    /**
+     * Check that count records of at least size bytes each can follow
+     */
+    bool hasRecords(uint64_t count, size_t size)
+    {
+        return count <= (uint64_t)(m_pEnd - m_pPos) / size;
+    }
+
+    size_t getOffset(const char *begin)
+    {
+        return m_pPos - begin;
+    }
+};
+
+static shared_ptr<elfcloud::Cluster> getCluster(ElfcloudFSSnapshotReader &in, Client *eclib)
+{
+    uint64_t l_lId = 0, l_lParentId = 0, l_lDescendants = 0, l_lDataItems = 0, l_lSize = 0;
+    uint32_t l_iPermissions = 0;
+    string l_strName, l_strAccessed, l_strModified;
+    vector<string> l_SPermissions;
+
+    if (!in.getU64(l_lId) || !in.getU64(l_lParentId) || !in.getString(l_strName) ||
+            !in.getU64(l_lDescendants) || !in.getU64(l_lDataItems) || !in.getU64(l_lSize) ||
+            !in.getString(l_strAccessed) || !in.getString(l_strModified) || !in.getU32(l_iPermissions))
+    {
+        return 0x00;
+    }
+
+    for (uint32_t i = 0; i < l_iPermissions; i++)
+    {
+        string l_strPermission;
+
+        if (!in.getString(l_strPermission))
+        {
+            return 0x00;
+        }
+
+        l_SPermissions.push_back(l_strPermission);
+    }
+
+    shared_ptr<elfcloud::Cluster> l_SCluster(new elfcloud::Cluster(eclib));
+    l_SCluster->setClusterName(l_strName);
+    l_SCluster->setClusterID(l_lId);
+    l_SCluster->setClusterParentId(l_lParentId);
+    l_SCluster->setClusterDescendants(l_lDescendants);
+    l_SCluster->setClusterDataItems(l_lDataItems);
+    l_SCluster->setSizeBytes(l_lSize);
+    l_SCluster->setLastAccessed(l_strAccessed);
+    l_SCluster->setLastModified(l_strModified);
+    l_SCluster->setPermissions(l_SPermissions);
+    return l_SCluster;
+}
+
+static shared_ptr<elfcloud::DataItem> getDataItem(ElfcloudFSSnapshotReader &in, Client *eclib)
+{
+    uint64_t l_lId = 0, l_lParentId = 0, l_lSize = 0;
+    string l_strName, l_strAccessed, l_strModified, l_strMd5, l_strMeta;
+
+    if (!in.getU64(l_lId) || !in.getU64(l_lParentId) || !in.getString(l_strName) || !in.getU64(l_lSize) ||
+            !in.getString(l_strAccessed) || !in.getString(l_strModified) || !in.getString(l_strMd5) ||
+            !in.getString(l_strMeta) || l_strMeta.size() > SNAPSHOT_META_MAX)
+    {
+        return 0x00;
+    }
+
+    // Same order as when listed from cloud, name before ID
+    shared_ptr<elfcloud::DataItem> l_SDataItem(new elfcloud::DataItem(eclib));
+    l_SDataItem->setParentId(l_lParentId);
+    l_SDataItem->setDataItemName(l_strName);
+    l_SDataItem->setId(l_lId);
+    l_SDataItem->setLastModified(l_strModified);
+    l_SDataItem->setMD5Sum(l_strMd5);
+    l_SDataItem->setLastAccessed(l_strAccessed);
+    l_SDataItem->parseMetaDataString(l_strMeta);
+    l_SDataItem->setDataLength(l_lSize);
+    return l_SDataItem;
+}
+
+ElfcloudFSSnapshot::ElfcloudFSSnapshot(
+    Client *eclib,
+    string filename,
+    string user
+)
+{
+    m_SEclib = eclib;
+    m_strFilename = filename;
+    m_strUser = user;
+}
+
+bool ElfcloudFSSnapshot::save(map<string, ElfcloudDirCache *> &dirs)
+{
+    string l_strOut;
+
+    l_strOut.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    putU32(l_strOut, VERSION);
+    putString(l_strOut, m_strUser);
+    putU64(l_strOut, dirs.size());
+
+    for (map<string, ElfcloudDirCache *>::iterator iter = dirs.begin(); iter != dirs.end(); iter++)
+    {
+        ElfcloudDirCache *l_SDirCache = (*iter).second;
+        vector<string> l_SNames = l_SDirCache->getDirectoryNames();
+
+        putString(l_strOut, (*iter).first);
+        putCluster(l_strOut, l_SDirCache->getCluster());
+
+        putU64(l_strOut, l_SNames.size());
+
+        for (size_t i = 0; i < l_SNames.size(); i++)
+        {
+            putCluster(l_strOut, l_SDirCache->getDirectory(l_SNames[i]));
+        }
+
+        l_SNames = l_SDirCache->getFileNames();
+        putU64(l_strOut, l_SNames.size());
+
+        for (size_t i = 0; i < l_SNames.size(); i++)
+        {
+            putDataItem(l_strOut, l_SDirCache->getFile(l_SNames[i]));
+        }
+    }
+
+    // Temporary file first, a crash must not leave half a snapshot behind
+    string l_strTmp = m_strFilename + ".tmp";
+    int l_iFd = open(l_strTmp.data(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    if (l_iFd < 0)
+    {
+        cerr << "ElfcloudFSSnapshot::save: Can't open " << l_strTmp << endl;
+        return false;
+    }
+
+    size_t l_iWritten = 0;
+
+    while (l_iWritten < l_strOut.size())
+    {
+        ssize_t l_iRtn = write(l_iFd, l_strOut.data() + l_iWritten, l_strOut.size() - l_iWritten);
+
+        if (l_iRtn <= 0)
+        {
+            break;
+        }
+
+        l_iWritten += l_iRtn;
+    }
+
+    if (close(l_iFd) != 0 || l_iWritten != l_strOut.size() || rename(l_strTmp.data(), m_strFilename.data()) != 0)
+    {
+        cerr << "ElfcloudFSSnapshot::save: Can't write " << m_strFilename << endl;
+        unlink(l_strTmp.data());
+        return false;
+    }
+
+    return true;
+}
+
+size_t ElfcloudFSSnapshot::load(map<string, ElfcloudDirCache *> &dirs)
+{
+    struct stat l_SSb;
+    int l_iFd = open(m_strFilename.data(), O_RDONLY);
+
+    if (l_iFd < 0)
+    {
+        return 0;
+    }
+
+    if (fstat(l_iFd, &l_SSb) != 0)
+    {
+        close(l_iFd);
+        return 0;
+    }
+
+    if (l_SSb.st_size < (off_t) SNAPSHOT_HEADER_SIZE)
+    {
+        cerr << "ElfcloudFSSnapshot::load: Ignoring " << m_strFilename << ": truncated header (" << l_SSb.st_size << " bytes)" << endl;
+        close(l_iFd);
+        return 0;
+    }
+
+    void *l_pMap = mmap(NULL, l_SSb.st_size, PROT_READ, MAP_PRIVATE, l_iFd, 0);
+    close(l_iFd);
+
+    if (l_pMap == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    const char *l_pBegin = (const char *) l_pMap;
+    ElfcloudFSSnapshotReader l_SIn(l_pBegin, l_pBegin + l_SSb.st_size);
+    char l_strMagic[sizeof(SNAPSHOT_MAGIC)];
+    uint32_t l_iVersion = 0;
+    uint64_t l_lDirs = 0;
+    string l_strUser;
+    string l_strError;
+
+    // Header is large enough for these, the user name is the first length to check
+    l_SIn.getBytes(l_strMagic, sizeof(l_strMagic));
+    l_SIn.getU32(l_iVersion);
+
+    if (memcmp(l_strMagic, SNAPSHOT_MAGIC, sizeof(l_strMagic)))
+    {
+        l_strError = "not a snapshot";
+    }
+    else if (l_iVersion != VERSION)
+    {
+        stringstream l_SError;
+        l_SError << "unknown version " << l_iVersion;
+        l_strError = l_SError.str();
+    }
+    else if (!l_SIn.getString(l_strUser) || !l_SIn.getU64(l_lDirs))
+    {
+        l_strError = "truncated header";
+    }
+    else if (l_strUser != m_strUser)
+    {
+        l_strError = "snapshot of another user";
+    }
+    else if (!l_SIn.hasRecords(l_lDirs, SNAPSHOT_DIR_SIZE))
+    {
+        l_strError = "directory count larger than file";
+    }
+
+    // Whole snapshot is parsed before any of it is used
+    map<string, ElfcloudDirCache *> l_SRestored;
+
+    try
+    {
+        for (uint64_t d = 0; d < l_lDirs && l_strError.empty(); d++)
+        {
+            string l_strPath;
+            shared_ptr<elfcloud::Cluster> l_SCluster;
+            list<shared_ptr<elfcloud::Cluster>> l_SClusters;
+            list<shared_ptr<elfcloud::DataItem>> l_SDataItems;
+            uint64_t l_lCount = 0;
+            bool l_bOk = l_SIn.getString(l_strPath) && (l_SCluster = getCluster(l_SIn, m_SEclib)) != 0x00 &&
+                         l_SIn.getU64(l_lCount) && l_SIn.hasRecords(l_lCount, SNAPSHOT_CLUSTER_SIZE);
+
+            for (uint64_t i = 0; i < l_lCount && l_bOk; i++)
+            {
+                shared_ptr<elfcloud::Cluster> l_SSubCluster = getCluster(l_SIn, m_SEclib);
+                l_bOk = l_SSubCluster != 0x00;
+                l_SClusters.push_back(l_SSubCluster);
+            }
+
+            l_bOk = l_bOk && l_SIn.getU64(l_lCount) && l_SIn.hasRecords(l_lCount, SNAPSHOT_DATAITEM_SIZE);
+
+            for (uint64_t i = 0; i < l_lCount && l_bOk; i++)
+            {
+                shared_ptr<elfcloud::DataItem> l_SDataItem = getDataItem(l_SIn, m_SEclib);
+                l_bOk = l_SDataItem != 0x00;
+                l_SDataItems.push_back(l_SDataItem);
+            }
+
+            if (!l_bOk)
+            {
+                stringstream l_SError;
+                l_SError << "truncated or invalid record of directory " << d << " at offset " << l_SIn.getOffset(l_pBegin);
+                l_strError = l_SError.str();
+            }
+            else if (l_SRestored.find(l_strPath) == l_SRestored.end())
+            {
+                l_SRestored[l_strPath] = new ElfcloudDirCache(m_SEclib, l_strPath, l_SCluster, l_SClusters, l_SDataItems);
+            }
+        }
+
+        if (l_strError.empty() && !l_SIn.atEnd())
+        {
+            l_strError = "data after last directory";
+        }
+    }
+
+    catch (elfcloud::Exception &e)
+    {
+        stringstream l_SError;
+        l_SError << "invalid record at offset " << l_SIn.getOffset(l_pBegin) << ": " << e.getCode() << ", " << e.getMsg();
+        l_strError = l_SError.str();
+    }
+
+    munmap(l_pMap, l_SSb.st_size);
+
+    size_t l_iRestored = 0;
+
+    for (map<string, ElfcloudDirCache *>::iterator iter = l_SRestored.begin(); iter != l_SRestored.end(); iter++)
+    {
+        if (l_strError.empty() && dirs.find((*iter).first) == dirs.end())
+        {
+            dirs[(*iter).first] = (*iter).second;
+            l_iRestored++;
+        }
+        else
+        {
+            delete (*iter).second;
+        }
+    }
+
+    if (!l_strError.empty())
+    {
+        cerr << "ElfcloudFSSnapshot::load: Ignoring " << m_strFilename << ": " << l_strError << endl;
+    }
+
+    return l_iRestored;
+}
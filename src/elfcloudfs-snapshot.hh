@@ -0,0 +1,107 @@
+
+/*
+ * Copyright (c) 2015, Ilmi Solutions Oy
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Ilmi Solutions Oy nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Revision info:
+ * $Date$
+ * $Rev$
+ * $Author$
+ */
+
+#ifndef _ELFCLOUDFS_SNAPSHOT_H_
+#define _ELFCLOUDFS_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <API.h>
+
+#include "elfcloudfs-dircache.hh"
+
+using namespace std;
+using namespace elfcloud;
+
+/**
+ * On-disk copy of directory caches, so that a remount can answer getattr
+ * and readdir before anything has been listed from cloud. The file holds
+ * every cached directory with its cluster, sub-clusters and dataitems
+ * (ids, names, sizes, timestamps, md5sum and meta) in a binary format
+ * with magic and version. It is mapped to memory when loaded and
+ * ignored as a whole if it belongs to another user, has another version,
+ * is truncated or has a record that does not parse. Reason is logged.
+ */
+class ElfcloudFSSnapshot
+{
+private:
+    Client *m_SEclib;
+    string m_strFilename;
+    string m_strUser;
+
+public:
+    static const uint32_t VERSION = 1;
+
+    /**
+     *  Constructor
+     * @param eclib Elfcloud lib, owner of restored objects
+     * @param filename Snapshot file
+     * @param user User snapshot belongs to
+     */
+    ElfcloudFSSnapshot(
+        Client *eclib,
+        string filename,
+        string user
+    );
+
+    /**
+     * Write directory caches to snapshot file
+     * @param dirs Directory caches by path
+     * @return true if success and false if not
+     */
+    bool save(
+        map <string, ElfcloudDirCache *> &dirs
+    );
+
+    /**
+     * Restore directory caches from snapshot file. Paths already in dirs
+     * are left as they are
+     * @param dirs Directory caches by path, restored ones are added
+     * @return number of directories restored
+     */
+    size_t load(
+        map <string, ElfcloudDirCache *> &dirs
+    );
+};
+
+#endif
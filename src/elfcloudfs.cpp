@@ -68,6 +68,10 @@ ElfcloudFS::ElfcloudFS()
     m_SVaults = 0x00;
     m_SCurrentVault = 0x00;
     m_lFh = 0;
+    m_bConfigured = false;
+    m_SSnapshot = NULL;
+    m_lMetadataTTL = 60;
+    m_bStopRefresh = false;
 }
 
 ElfcloudFS::~ElfcloudFS()
@@ -237,9 +241,9 @@ int ElfcloudFS::Getattr(const char *path, struct stat *statbuf)
             time_t t2 = mktime(&t);
 
             statbuf->st_mode = S_IFREG | l_iFilePerm;
-            statbuf->st_size = l_SDataItem->getDataLength();
+            statbuf->st_size = l_SDataItem->getContentLength();
 
-            statbuf->st_size = l_SDataItem->getDataLength();
+            statbuf->st_size = l_SDataItem->getContentLength();
 
             statbuf->st_nlink = 1;
 
@@ -274,6 +278,8 @@ int ElfcloudFS::Readlink(const char *path, char *link, size_t size)
 
 int ElfcloudFS::Mknod(const char *path, mode_t mode, dev_t dev)
 {
+    // Creating the empty item is a namespace change the caller waits for
+    RequestScheduler::Scope l_SPriority(ELFCLOUD_PRIORITY_METADATA);
 
     vector<string> l_SPaths = getSplittedPath(path);
     shared_ptr<elfcloud::Vault> l_SVault = getVaultByName(l_SPaths[0].data());
@@ -572,6 +578,9 @@ int ElfcloudFS::Rmdir(const char *path)
         if(l_SIMapterator != m_SDirs.end())
         {
             m_SDirs.erase(l_SIMapterator);
+
+            lock_guard<mutex> l_SLock(m_SRefreshMutex);
+            m_SRefreshDirs.erase(string(path));
         }
 
         for(int i = 0; i < l_SPaths.size() - 1; i++ )
@@ -641,7 +650,7 @@ int ElfcloudFS::Rename(const char *path, const char *newpath)
             return -ENOENT;
         }
 
-        l_SDirCache->reloadFiles();
+        l_SDirCache->renameFile(l_SPaths[l_SPaths.size() - 1], l_SPathsNew[l_SPathsNew.size() - 1]);
         return 0;
     }
 
@@ -738,6 +747,9 @@ int ElfcloudFS::Utime(const char *path, struct utimbuf *ubuf)
 
 int ElfcloudFS::Open(const char *path, struct fuse_file_info *fileInfo)
 {
+    RequestScheduler::Scope l_SPriority(ELFCLOUD_PRIORITY_FOREGROUND_FETCH);
+    CancelToken l_SCancel;
+    pid_t l_iPid = fuse_get_context()->pid;
     vector<string> l_SPaths = getSplittedPath(path);
     shared_ptr<elfcloud::DataItem> l_SDataItem = 0x00;
     shared_ptr<elfcloud::DataItemFilePassthrough> m_SFile(new DataItemFilePassthrough(m_SEclib));
@@ -780,7 +792,17 @@ int ElfcloudFS::Open(const char *path, struct fuse_file_info *fileInfo)
 
         if(fileInfo->flags & O_RDWR || (fileInfo->flags & O_WRONLY) == 0 || (fileInfo->flags & O_APPEND))
         {
-            l_SCacheItem->fetchItemToCache();
+            // Download is stopped if process gives up waiting (Ctrl-C)
+            l_SCancel.setCheck([l_iPid]() { return ElfcloudFS::isRequestInterrupted(l_iPid); });
+            CancelToken::Scope l_SCancelScope(l_SCancel);
+
+            if(l_SCacheItem->fetchItemToCache(l_SDataItem) == false && l_SCancel.isCancelled())
+            {
+                cerr << "ElfcloudFS::Open: Fetch interrupted: " << path << endl;
+                l_SCacheItem->removeItemFromCache();
+                delete l_SCacheItem;
+                return -EINTR;
+            }
         }
 
         else
@@ -865,6 +887,8 @@ int ElfcloudFS::Write(const char *path, const char *buf, size_t size, off_t offs
         return -1;
     }
 
+    l_SCacheItem->markWritten(offset, l_iWritten);
+
     return l_iWritten;
 }
 
@@ -900,16 +924,27 @@ int ElfcloudFS::Release(const char *path, struct fuse_file_info *fileInfo)
 
     if(fileInfo->flags & O_RDWR || fileInfo->flags & O_WRONLY)
     {
+        // Write-back of the whole file must not hold up interactive requests
+        RequestScheduler::Scope l_SPriority(ELFCLOUD_PRIORITY_BACKGROUND_STORE);
+        bool l_bUploaded = false;
 
-        if(l_SCacheItem->storeItemToCloud() == false)
+        if(l_SCacheItem->storeItemToCloud(l_bUploaded) == false)
         {
             cerr << "ElfcloudFS::release: Can't store item to cloud" << endl;
             return -ENOENT;
         }
 
-        if(l_SDirCache != NULL)
+        // Entry is updated here, refresher brings in rest of metadata from cloud.
+        // Unchanged file was not sent and its entry is still valid.
+        if(l_bUploaded && l_SDirCache != NULL)
         {
-            l_SDirCache->reloadFiles();
+            struct stat l_SSb;
+
+            if(stat(l_SCacheItem->getCacheFilename().data(), &l_SSb) != 0 ||
+                    l_SDirCache->updateFile(l_SPaths[l_SPaths.size() - 1], l_SSb.st_size) == false)
+            {
+                l_SDirCache->reloadFiles();
+            }
         }
 
     }
@@ -1149,7 +1184,59 @@ int ElfcloudFS::createElfcloudClient(char *configpath)
     return 0;
 }
 
+int ElfcloudFS::Warmup(char *username, char *password, long upspeed, long downspeed, char *sessionfile, char *snapshotfile, long metadatattl)
+{
+    if(m_SEclib == NULL)
+    {
+        cerr << "** Elfcloud-fuse there is problem:" << endl;
+        cerr << "   Client not initalized!" << endl;
+        return -1;
+    }
+
+    if(sessionfile != NULL && strlen(sessionfile) > 0)
+    {
+        m_SEclib->setConf("http.session.file", sessionfile);
+    }
+
+    if(Connect(username, password, upspeed, downspeed, false) < 0)
+    {
+        return -1;
+    }
+
+    // Configuration is not touched after this, warmup thread reads it
+    m_bConfigured = true;
+    m_SEclib->warmup();
+
+    if(metadatattl >= 0)
+    {
+        m_lMetadataTTL = metadatattl;
+    }
+
+    // Directories from last mount are served until refresher lists them again,
+    // into objects of its own that applyRefreshed swaps in on FUSE thread
+    if(snapshotfile != NULL && strlen(snapshotfile) > 0 && username != NULL)
+    {
+        map<string, ElfcloudDirCache *> l_SRestored;
+
+        m_SSnapshot = new ElfcloudFSSnapshot(m_SEclib, snapshotfile, username);
+        cerr << "ElfcloudFS::Warmup: Restored " << m_SSnapshot->load(l_SRestored) << " directories from " << snapshotfile << endl;
+
+        for(std::map<string, ElfcloudDirCache *>::iterator iter = l_SRestored.begin(); iter != l_SRestored.end(); iter++)
+        {
+            addDirCache((*iter).first, (*iter).second, false);
+        }
+    }
+
+    return 0;
+}
+
 int ElfcloudFS::Connect(char *username, char *password, long upspeed, long downspeed)
+{
+    return Connect(username, password, upspeed, downspeed, true);
+}
+
+// Private
+int ElfcloudFS::Connect(char *username, char *password, long upspeed, long downspeed, bool listvaults)
 {
     char l_strSpeed[32];
 
@@ -1164,6 +1251,13 @@ int ElfcloudFS::Connect(char *username, char *password, long upspeed, long downs
 
     try
     {
+        if(m_bConfigured)
+        {
+            m_SVaults = Vault::ListVaults(m_SEclib);
+            startRefresher();
+            return 0;
+        }
+
         m_SEclib->setPasswordAuthenticationCredentials(username, password);
 
         if(downspeed > 0)
@@ -1180,7 +1274,11 @@ int ElfcloudFS::Connect(char *username, char *password, long upspeed, long downs
             memset(l_strSpeed, 0x00, 32);
         }
 
-        m_SVaults = Vault::ListVaults(m_SEclib);
+        if(listvaults)
+        {
+            m_SVaults = Vault::ListVaults(m_SEclib);
+            startRefresher();
+        }
     }
 
     catch(elfcloud::Exception &e)
@@ -1202,14 +1300,295 @@ int ElfcloudFS::Disconnect()
         return -1;
     }
 
+    for(int i = 0; i < ELFCLOUD_PRIORITY_CLASSES; i ++)
+    {
+        RequestPriority l_ePriority = (RequestPriority) i;
+        RequestSchedulerStats l_SStats = m_SEclib->getRequestScheduler()->getStats(l_ePriority);
+
+        if(l_SStats.admitted > 0)
+        {
+            cerr << "ElfcloudFS::Disconnect: " << RequestScheduler::getPriorityName(l_ePriority) << " requests: " << l_SStats.admitted
+                 << ", average wait: " << l_SStats.totalWaitMicroseconds / l_SStats.admitted << " us"
+                 << ", max wait: " << l_SStats.maxWaitMicroseconds << " us" << endl;
+        }
+    }
+
+    SegmentSizerStats l_SSegmentStats = m_SEclib->getSegmentSizer()->getStats();
+
+    if(l_SSegmentStats.segments > 0)
+    {
+        cerr << "ElfcloudFS::Disconnect: store segments: " << l_SSegmentStats.segments
+             << ", failed: " << l_SSegmentStats.failures
+             << ", size: " << l_SSegmentStats.smallestSize << " - " << l_SSegmentStats.largestSize << " bytes"
+             << " (now " << l_SSegmentStats.currentSize << ")"
+             << ", throughput: " << l_SSegmentStats.throughputBps << " B/s"
+             << ", RTT: " << l_SSegmentStats.rttMicroseconds << " us" << endl;
+    }
+
+    stopRefresher();
+
+    if(m_SSnapshot != NULL)
+    {
+        m_SSnapshot->save(m_SDirs);
+        delete m_SSnapshot;
+        m_SSnapshot = NULL;
+    }
+
     m_SEclib->clearCache();
     delete m_SVaults;
     delete m_SEclib;
     m_SEclib = NULL;
+    m_bConfigured = false;
     return 0;
 }
 
 // Private
+void ElfcloudFS::addDirCache(string path, ElfcloudDirCache *dircache, bool listed)
+{
+    // Refresher gets a copy of its own, it never reads objects of directory caches
+    shared_ptr<elfcloud::Cluster> l_SCluster(new elfcloud::Cluster(m_SEclib));
+    l_SCluster->assign(dircache->getCluster());
+
+    m_SDirs[path] = dircache;
+
+    lock_guard<mutex> l_SLock(m_SRefreshMutex);
+    refreshDir &l_SDir = m_SRefreshDirs[path];
+    l_SDir.cluster = l_SCluster;
+    l_SDir.generation = dircache->getGeneration();
+    l_SDir.refreshed = listed ? time(NULL) : 0;
+    l_SDir.used = listed ? time(NULL) : 0;
+    l_SDir.pending = false;
+}
+
+// Private
+void ElfcloudFS::touchDirCache(const string &path)
+{
+    lock_guard<mutex> l_SLock(m_SRefreshMutex);
+    std::map<string, refreshDir>::iterator l_SRefreshDir = m_SRefreshDirs.find(path);
+
+    if(l_SRefreshDir != m_SRefreshDirs.end())
+    {
+        (*l_SRefreshDir).second.used = time(NULL);
+    }
+}
+
+// Private
+void ElfcloudFS::startRefresher()
+{
+    if(m_SRefreshThread.joinable())
+    {
+        return;
+    }
+
+    m_bStopRefresh = false;
+
+    try
+    {
+        m_SRefreshThread = thread(&ElfcloudFS::refreshDirs, this);
+    }
+
+    catch(system_error &e)
+    {
+        // Directories stay as they are until they are reloaded
+        cerr << "ElfcloudFS::startRefresher: Can't start thread: " << e.what() << endl;
+    }
+}
+
+// Private
+void ElfcloudFS::refreshDirs()
+{
+    // Requests of FUSE thread go first
+    RequestScheduler::Scope l_SPriority(ELFCLOUD_PRIORITY_PREFETCH);
+    unique_lock<mutex> l_SLock(m_SRefreshMutex);
+
+    while(!m_bStopRefresh)
+    {
+        list<refreshedDir> l_SDirs;
+        list<shared_ptr<elfcloud::Cluster>> l_SClusters;
+        time_t l_STime = time(NULL);
+
+        for(std::map<string, refreshDir>::iterator iter = m_SRefreshDirs.begin(); iter != m_SRefreshDirs.end(); iter++)
+        {
+            refreshDir &l_SDir = (*iter).second;
+
+            if(l_SDir.pending || (l_SDir.refreshed != 0 && (m_lMetadataTTL == 0 || l_STime - l_SDir.refreshed < m_lMetadataTTL)))
+            {
+                continue;
+            }
+
+            // Idle directory is listed again when it is accessed next time
+            if(l_SDir.used == 0 || (m_lMetadataTTL != 0 && l_STime - l_SDir.used >= m_lMetadataTTL))
+            {
+                continue;
+            }
+
+            refreshedDir l_SRefreshed;
+            l_SRefreshed.path = (*iter).first;
+            l_SRefreshed.generation = l_SDir.generation;
+            l_SDirs.push_back(l_SRefreshed);
+            l_SClusters.push_back(l_SDir.cluster);
+            l_SDir.pending = true;
+        }
+
+        list<shared_ptr<elfcloud::Cluster>>::iterator l_SCluster = l_SClusters.begin();
+
+        for(list<refreshedDir>::iterator iter = l_SDirs.begin(); iter != l_SDirs.end(); iter++, l_SCluster++)
+        {
+            std::map<std::string, std::list<shared_ptr<elfcloud::Object>>*> *l_SMapContents = NULL;
+
+            if(m_bStopRefresh)
+            {
+                break;
+            }
+
+            l_SLock.unlock();
+
+            try
+            {
+                // Decoded into new objects, Client caches and directory caches are not touched here
+                l_SMapContents = (*l_SCluster)->listContents(false);
+            }
+
+            catch(elfcloud::Exception &e)
+            {
+                cerr << "ElfcloudFS::refreshDirs: " << (*iter).path << ": Exception: " << e.getCode() << ", " << e.getMsg() << endl;
+            }
+
+            if(l_SMapContents != NULL)
+            {
+                list<shared_ptr<elfcloud::Cluster>> *l_SListClusters = (list<shared_ptr<elfcloud::Cluster>> *) (*l_SMapContents)["clusters"];
+                list<shared_ptr<elfcloud::DataItem>> *l_SListDataItems = (list<shared_ptr<elfcloud::DataItem>> *) (*l_SMapContents)["dataitems"];
+
+                (*iter).clusters.swap(*l_SListClusters);
+                (*iter).dataitems.swap(*l_SListDataItems);
+
+                delete l_SListClusters;
+                delete l_SListDataItems;
+                delete l_SMapContents;
+            }
+
+            l_SLock.lock();
+
+            if(l_SMapContents != NULL)
+            {
+                m_SRefreshed.push_back(*iter);
+            }
+            else if(m_SRefreshDirs.count((*iter).path))
+            {
+                // Tried again after TTL
+                m_SRefreshDirs[(*iter).path].pending = false;
+                m_SRefreshDirs[(*iter).path].refreshed = time(NULL);
+            }
+        }
+
+        m_SRefreshWakeup.wait_for(l_SLock, chrono::seconds(1));
+    }
+}
+
+// Private
+void ElfcloudFS::applyRefreshed()
+{
+    list<refreshedDir> l_SDirs;
+
+    lock_guard<mutex> l_SLock(m_SRefreshMutex);
+    l_SDirs.swap(m_SRefreshed);
+
+    for(list<refreshedDir>::iterator iter = l_SDirs.begin(); iter != l_SDirs.end(); iter++)
+    {
+        std::map<string, ElfcloudDirCache *>::iterator l_SIMapterator = m_SDirs.find((*iter).path);
+        std::map<string, refreshDir>::iterator l_SRefreshDir = m_SRefreshDirs.find((*iter).path);
+
+        if(l_SIMapterator == m_SDirs.end() || l_SRefreshDir == m_SRefreshDirs.end())
+        {
+            continue;
+        }
+
+        ElfcloudDirCache *l_SDirCache = (*l_SIMapterator).second;
+        refreshDir &l_SDir = (*l_SRefreshDir).second;
+
+        l_SDir.pending = false;
+
+        // Changed here while it was listed, listing may miss the change
+        if(l_SDirCache->getGeneration() != (*iter).generation)
+        {
+            l_SDir.generation = l_SDirCache->getGeneration();
+            l_SDir.refreshed = 0;
+            continue;
+        }
+
+        l_SDirCache->applyListing((*iter).clusters, (*iter).dataitems);
+        l_SDir.generation = l_SDirCache->getGeneration();
+        l_SDir.refreshed = time(NULL);
+    }
+}
+
+// Private
+void ElfcloudFS::stopRefresher()
+{
+    {
+        lock_guard<mutex> l_SLock(m_SRefreshMutex);
+        m_bStopRefresh = true;
+    }
+
+    m_SRefreshWakeup.notify_all();
+
+    if(m_SRefreshThread.joinable())
+    {
+        m_SRefreshThread.join();
+    }
+
+    applyRefreshed();
+}
+
+// Private
+bool ElfcloudFS::isRequestInterrupted(pid_t pid)
+{
+    char l_strPath[64];
+    char l_strLine[256];
+    unsigned long long l_lPending = 0;
+    unsigned long long l_lBlocked = 0;
+    unsigned long long l_lIgnored = 0;
+    unsigned long long l_lValue = 0;
+    FILE *l_SStatus = NULL;
+
+    if(fuse_interrupted())
+    {
+        return true;
+    }
+
+    snprintf(l_strPath, 64, "/proc/%d/status", (int) pid);
+    l_SStatus = fopen(l_strPath, "r");
+
+    // Process has gone away
+    if(l_SStatus == NULL)
+    {
+        return errno == ENOENT;
+    }
+
+    while(fgets(l_strLine, 256, l_SStatus) != NULL)
+    {
+        if(sscanf(l_strLine, "SigPnd: %llx", &l_lValue) == 1 || sscanf(l_strLine, "ShdPnd: %llx", &l_lValue) == 1)
+        {
+            l_lPending |= l_lValue;
+        }
+
+        else if(sscanf(l_strLine, "SigBlk: %llx", &l_lValue) == 1)
+        {
+            l_lBlocked = l_lValue;
+        }
+
+        else if(sscanf(l_strLine, "SigIgn: %llx", &l_lValue) == 1)
+        {
+            l_lIgnored = l_lValue;
+        }
+    }
+
+    fclose(l_SStatus);
+
+    // Same signals that make kernel send FUSE interrupt
+    return (l_lPending & ~l_lBlocked & ~l_lIgnored) != 0;
+}
+
 shared_ptr<elfcloud::Vault> ElfcloudFS::getVaultByName(const char *name)
 {
     shared_ptr<Vault> l_STmpVault = 0x00;
@@ -1276,6 +1655,8 @@ ElfcloudDirCache *ElfcloudFS::getClusterByPath(const char *path)
         return NULL;
     }
 
+    applyRefreshed();
+
     l_STmpVault = getVaultByName(l_SPaths[0].data());
 
     // Is there that named Vault?
@@ -1291,6 +1672,7 @@ ElfcloudDirCache *ElfcloudFS::getClusterByPath(const char *path)
     // If we do then return it.
     if(l_SIMapterator != m_SDirs.end())
     {
+        touchDirCache(string(path));
         return (*l_SIMapterator).second;
     }
 
@@ -1308,6 +1690,7 @@ ElfcloudDirCache *ElfcloudFS::getClusterByPath(const char *path)
 
         if(l_SDirCache->isFile(l_SPaths[l_SPaths.size() - 1]) == true)
         {
+            touchDirCache(l_strTempPath);
             return l_SDirCache;
         }
     }
@@ -1360,7 +1743,7 @@ ElfcloudDirCache *ElfcloudFS::getClusterByPath(const char *path)
                         try
                         {
                             l_SDirCache = new ElfcloudDirCache(m_SEclib, path, l_SCluster);
-                            m_SDirs.insert(std::pair<string, ElfcloudDirCache *>(string(path), l_SDirCache));
+                            addDirCache(path, l_SDirCache, true);
                         }
 
                         catch(elfcloud::Exception &e)
@@ -1393,7 +1776,7 @@ ElfcloudDirCache *ElfcloudFS::getClusterByPath(const char *path)
                         try
                         {
                             l_SDirCache = new ElfcloudDirCache(m_SEclib, path, l_SIterCluster);
-                            m_SDirs.insert(std::pair<string, ElfcloudDirCache *>(string(path), l_SDirCache));
+                            addDirCache(path, l_SDirCache, true);
                         }
 
                         catch(elfcloud::Exception &e)
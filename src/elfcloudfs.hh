@@ -43,6 +43,7 @@
 
 #include "elfcloudfs-cache.hh"
 #include "elfcloudfs-dircache.hh"
+#include "elfcloudfs-snapshot.hh"
 
 #include <ctype.h>
 #include <sstream>
@@ -59,6 +60,10 @@
 #include <sys/xattr.h>
 #include <time.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <API.h>
 
 using namespace std;
@@ -78,9 +83,119 @@ private:
     map <string, ElfcloudFSCache *>m_SOpenFile;
     map <string, string> m_SCacheFile;
     uint64_t m_lFh;
+    bool m_bConfigured;
+    ElfcloudFSSnapshot *m_SSnapshot;
+    long m_lMetadataTTL;
+
+    ///
+    // Directory cache as the refresher thread sees it. Generation is the
+    // one of directory cache when it was last brought up to date,
+    // refreshed is zero for directories never listed (restored from
+    // snapshot). Used is time of last access, zero for directories not
+    // accessed since restored
+    //
+    typedef struct refreshDir
+    {
+        shared_ptr <elfcloud::Cluster> cluster;
+        uint64_t generation;
+        time_t refreshed;
+        time_t used;
+        bool pending;
+    } refreshDir;
+
+    ///
+    // Directory contents listed by the refresher thread. Objects are
+    // decoded for this listing only, applyRefreshed swaps them in
+    //
+    typedef struct refreshedDir
+    {
+        string path;
+        uint64_t generation;
+        list <shared_ptr <elfcloud::Cluster>> clusters;
+        list <shared_ptr <elfcloud::DataItem>> dataitems;
+    } refreshedDir;
+
+    thread m_SRefreshThread;
+    mutex m_SRefreshMutex;
+    condition_variable m_SRefreshWakeup;
+    bool m_bStopRefresh;
+    map <string, refreshDir> m_SRefreshDirs;
+    list <refreshedDir> m_SRefreshed;
 
     static ElfcloudFS *m_SInstance;
 
+    ///
+    // Add directory cache to memory map and to refresher
+    // @param path Directory path
+    // @param dircache Directory cache
+    // @param listed true if contents came from cloud just now
+    //
+    void addDirCache(
+        string path,
+        ElfcloudDirCache *dircache,
+        bool listed
+    );
+
+    ///
+    // Mark directory cache accessed, refresher only lists directories
+    // accessed within metadata TTL
+    // @param path Directory path
+    //
+    void touchDirCache(
+        const string &path
+    );
+
+    ///
+    // Start refresher thread that lists directories again when they are
+    // older than metadata TTL and have been accessed within it
+    //
+    void startRefresher(
+    );
+
+    ///
+    // Refresher thread body, queues listings for applyRefreshed
+    //
+    void refreshDirs(
+    );
+
+    ///
+    // Apply listings of refresher to directory caches. Called from FUSE
+    // thread, directory caches are not locked. A directory changed
+    // locally while it was listed is listed again
+    //
+    void applyRefreshed(
+    );
+
+    ///
+    // Stop refresher and wait for it
+    //
+    void stopRefresher(
+    );
+
+    ///
+    // Check if FUSE request has been abandoned: interrupted by FUSE or process
+    // that made it has signal pending. Single threaded loop never sees FUSE
+    // interrupt while request is running, pending signal shows up anyway
+    // @param pid Process that made the request
+    // @return true if nobody waits for the request anymore
+    //
+    static bool isRequestInterrupted(
+        pid_t pid
+    );
+
+    ///
+    // Configure client with credentials and speed limits and optionally list vaults.
+    // After Warmup only vaults are listed
+    // @return below zero if not ok 0 is ok
+    //
+    int Connect(
+        char *username,
+        char *password,
+        long upspeed,
+        long downspeed,
+        bool listvaults
+    );
+
     ///
     // Find Vault by vault name
     // @param name Vault name
@@ -523,6 +638,31 @@ public:
         char *configpath
     );
 
+    /**
+     * Configure client and start authentication and connection setup in
+     * background so they overlap with mounting. Connect uses the same
+     * configuration if this has been called
+     * @param username username of user something@something.tld
+     * @param password password of user
+     * @param upspeed Speed for uploading
+     * @param downspeed Speed for download
+     * @param sessionfile File where session is kept between mounts or NULL
+     * @param snapshotfile File where directory metadata is kept between
+     * mounts or NULL
+     * @param metadatattl Seconds before directory is listed again, 0 never
+     * and below zero for default
+     * @return below zero if not ok 0 is ok
+     */
+    int Warmup(
+        char *username,
+        char *password,
+        long upspeed,
+        long downspeed,
+        char *sessionfile,
+        char *snapshotfile,
+        long metadatattl
+    );
+
     /**
      * Connect to Elfcloud instace
      * @param username username of user something@something.tld
@@ -193,6 +193,11 @@ int ec_fusewrap_createElfcloudClient(char *configpath)
     return ElfcloudFS::Instance()->createElfcloudClient(configpath);
 }
 
+int ec_fusewrap_warmup(char *username, char *password, long upspeed, long downspeed, char *sessionfile, char *snapshotfile, long metadatattl)
+{
+    return ElfcloudFS::Instance()->Warmup(username, password, upspeed, downspeed, sessionfile, snapshotfile, metadatattl);
+}
+
 int ec_fusewrap_connect(char *username, char *password, long upspeed, long downspeed)
 {
     return ElfcloudFS::Instance()->Connect(username, password, upspeed, downspeed);
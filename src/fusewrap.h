@@ -199,6 +199,15 @@ extern "C"
     int ec_fusewrap_createElfcloudClient(
     char *configpath
     );
+    int ec_fusewrap_warmup(
+    char *username,
+    char *password,
+    long upspeed,
+    long downspeed,
+    char *sessionfile,
+    char *snapshotfile,
+    long metadatattl
+    );
     int ec_fusewrap_connect(
     char *username,
     char *password,
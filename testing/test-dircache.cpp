@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2015, Ilmi Solutions Oy
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Ilmi Solutions Oy nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Revision info:
+ * $Date$
+ * $Rev$
+ * $Author$
+ */
+
+#include "elfcloudfs-dircache.hh"
+
+#include <iostream>
+
+using namespace std;
+using namespace elfcloud;
+
+static int g_iFailed = 0;
+
+#define CHECK(cond) \
+    if(!(cond)) \
+    { \
+        cerr << "test-dircache: " << __LINE__ << ": " << #cond << " failed" << endl; \
+        g_iFailed++; \
+    }
+
+static shared_ptr<elfcloud::Cluster> newCluster(Client *eclib, uint64_t id, string name, string modified)
+{
+    shared_ptr<elfcloud::Cluster> l_SCluster(new elfcloud::Cluster(eclib));
+
+    l_SCluster->setClusterName(name);
+    l_SCluster->setClusterID(id);
+    l_SCluster->setClusterParentId(1);
+    l_SCluster->setLastModified(modified);
+    return l_SCluster;
+}
+
+// Decoded the way a listing does it, every call gives an object of its own
+static shared_ptr<elfcloud::DataItem> newDataItem(Client *eclib, uint64_t id, string name, string modified, string md5, uint64_t size)
+{
+    shared_ptr<elfcloud::DataItem> l_SDataItem(new elfcloud::DataItem(eclib));
+
+    l_SDataItem->setParentId(1);
+    l_SDataItem->setDataItemName(name);
+    l_SDataItem->setId(id);
+    l_SDataItem->setLastModified(modified);
+    l_SDataItem->setMD5Sum(md5);
+    l_SDataItem->setDataLength(size);
+    return l_SDataItem;
+}
+
+static void listing(Client *eclib, list<shared_ptr<elfcloud::Cluster>> &clusters, list<shared_ptr<elfcloud::DataItem>> &dataitems,
+                    string md5, uint64_t size)
+{
+    clusters.clear();
+    dataitems.clear();
+    clusters.push_back(newCluster(eclib, 10, "dir", "2015-06-01T10:00:00"));
+    dataitems.push_back(newDataItem(eclib, 100, "file1", "2015-06-01T10:00:00", md5, size));
+    dataitems.push_back(newDataItem(eclib, 101, "file2", "2015-06-01T10:00:00", "22222222222222222222222222222222", 200));
+}
+
+int main(int argc, char *argv[])
+{
+    Client *l_SEclib = new Client();
+    list<shared_ptr<elfcloud::Cluster>> l_SClusters;
+    list<shared_ptr<elfcloud::DataItem>> l_SDataItems;
+
+    listing(l_SEclib, l_SClusters, l_SDataItems, "11111111111111111111111111111111", 100);
+    ElfcloudDirCache *l_SDirCache = new ElfcloudDirCache(l_SEclib, "/vault", newCluster(l_SEclib, 1, "vault", ""), l_SClusters, l_SDataItems);
+    shared_ptr<elfcloud::DataItem> l_SFile1 = l_SDirCache->getFile("file1");
+    shared_ptr<elfcloud::DataItem> l_SFile2 = l_SDirCache->getFile("file2");
+    uint64_t l_lGeneration = l_SDirCache->getGeneration();
+
+    // Same listing again: nothing changes and objects are kept
+    listing(l_SEclib, l_SClusters, l_SDataItems, "11111111111111111111111111111111", 100);
+    CHECK(l_SDirCache->applyListing(l_SClusters, l_SDataItems) == 0);
+    CHECK(l_SDirCache->getGeneration() == l_lGeneration);
+    CHECK(l_SDirCache->getFile("file1") == l_SFile1);
+
+    // file1 changed remotely: new contents, same ID
+    listing(l_SEclib, l_SClusters, l_SDataItems, "33333333333333333333333333333333", 300);
+    CHECK(l_SDirCache->applyListing(l_SClusters, l_SDataItems) == 1);
+    CHECK(l_SDirCache->getGeneration() != l_lGeneration);
+    CHECK(l_SDirCache->getFile("file1") != l_SFile1);
+    CHECK(l_SDirCache->getFile("file1")->getDataItemMd5Sum() == "33333333333333333333333333333333");
+    CHECK(l_SDirCache->getFile("file1")->getDataLength() == 300);
+    CHECK(l_SDirCache->getFile("file2") == l_SFile2);
+    // Object handed out before is left as it was
+    CHECK(l_SFile1->getDataItemMd5Sum() == "11111111111111111111111111111111");
+    CHECK(l_SFile1->getDataLength() == 100);
+
+    // Written locally: entry is a new object and next listing replaces it
+    l_SFile1 = l_SDirCache->getFile("file1");
+    l_lGeneration = l_SDirCache->getGeneration();
+    CHECK(l_SDirCache->updateFile("file1", 400));
+    CHECK(l_SDirCache->getGeneration() != l_lGeneration);
+    CHECK(l_SDirCache->getFile("file1") != l_SFile1);
+    CHECK(l_SDirCache->getFile("file1")->getDataLength() == 400);
+    CHECK(l_SFile1->getDataLength() == 300);
+
+    listing(l_SEclib, l_SClusters, l_SDataItems, "44444444444444444444444444444444", 400);
+    CHECK(l_SDirCache->applyListing(l_SClusters, l_SDataItems) == 1);
+    CHECK(l_SDirCache->getFile("file1")->getDataItemMd5Sum() == "44444444444444444444444444444444");
+
+    // Removed and renamed remotely
+    l_SClusters.clear();
+    l_SDataItems.clear();
+    l_SDataItems.push_back(newDataItem(l_SEclib, 101, "file3", "2015-06-01T10:00:00", "22222222222222222222222222222222", 200));
+    CHECK(l_SDirCache->applyListing(l_SClusters, l_SDataItems) == 3);
+    CHECK(!l_SDirCache->isDirectory("dir"));
+    CHECK(!l_SDirCache->isFile("file1"));
+    CHECK(!l_SDirCache->isFile("file2"));
+    CHECK(l_SDirCache->isFile("file3"));
+
+    // Copy owns a key hint of its own, listed object can go away
+    {
+        shared_ptr<elfcloud::DataItem> l_SListed = newDataItem(l_SEclib, 102, "file4", "", "", 0);
+        KeyHint l_SHint(ECSCI_HASHALG_MD5, "55555555555555555555555555555555", ECSCI_ENCALG_AES256);
+
+        l_SListed->setKeyHint(&l_SHint);
+        l_SFile1 = newDataItem(l_SEclib, 102, "file4", "", "", 0);
+        l_SFile1->assign(l_SListed);
+        l_SListed->assign(l_SFile2);
+    }
+    CHECK(l_SFile1->getKeyHint()->getKeyHash() == "55555555555555555555555555555555");
+
+    delete l_SDirCache;
+    delete l_SEclib;
+
+    if(g_iFailed > 0)
+    {
+        cerr << "test-dircache: " << g_iFailed << " checks failed" << endl;
+        return 1;
+    }
+
+    return 0;
+}
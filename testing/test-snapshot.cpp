@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2015, Ilmi Solutions Oy
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Ilmi Solutions Oy nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Revision info:
+ * $Date$
+ * $Rev$
+ * $Author$
+ */
+
+#include "elfcloudfs-snapshot.hh"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace elfcloud;
+
+static int g_iFailed = 0;
+
+#define CHECK(cond) \
+    if(!(cond)) \
+    { \
+        cerr << "test-snapshot: " << __LINE__ << ": " << #cond << " failed" << endl; \
+        g_iFailed++; \
+    }
+
+static const string USER = "tester";
+static const string PATH = "/vault";
+
+static shared_ptr<elfcloud::Cluster> newCluster(Client *eclib, uint64_t id, string name)
+{
+    shared_ptr<elfcloud::Cluster> l_SCluster(new elfcloud::Cluster(eclib));
+
+    l_SCluster->setClusterName(name);
+    l_SCluster->setClusterID(id);
+    l_SCluster->setClusterParentId(1);
+    l_SCluster->setLastModified("2015-06-01T10:00:00");
+    return l_SCluster;
+}
+
+static shared_ptr<elfcloud::DataItem> newDataItem(Client *eclib, uint64_t id, string name, uint64_t size)
+{
+    shared_ptr<elfcloud::DataItem> l_SDataItem(new elfcloud::DataItem(eclib));
+
+    l_SDataItem->setParentId(1);
+    l_SDataItem->setDataItemName(name);
+    l_SDataItem->setId(id);
+    l_SDataItem->setLastModified("2015-06-01T10:00:00");
+    l_SDataItem->setMD5Sum("11111111111111111111111111111111");
+    l_SDataItem->setCompression("zlib", size * 2);
+    l_SDataItem->setDataLength(size);
+    return l_SDataItem;
+}
+
+static string readFile(string filename)
+{
+    ifstream l_SIn(filename.data(), ios::binary);
+    stringstream l_SData;
+
+    l_SData << l_SIn.rdbuf();
+    return l_SData.str();
+}
+
+static void writeFile(string filename, string data)
+{
+    ofstream l_SOut(filename.data(), ios::binary | ios::trunc);
+
+    l_SOut.write(data.data(), data.size());
+}
+
+static void clearDirs(map<string, ElfcloudDirCache *> &dirs)
+{
+    for(map<string, ElfcloudDirCache *>::iterator iter = dirs.begin(); iter != dirs.end(); iter++)
+    {
+        delete (*iter).second;
+    }
+
+    dirs.clear();
+}
+
+static size_t load(Client *eclib, string filename, string user, map<string, ElfcloudDirCache *> &dirs)
+{
+    ElfcloudFSSnapshot l_SSnapshot(eclib, filename, user);
+
+    clearDirs(dirs);
+    return l_SSnapshot.load(dirs);
+}
+
+int main(int argc, char *argv[])
+{
+    Client *l_SEclib = new Client();
+    char l_strFilename[] = "/tmp/test-snapshot-XXXXXX";
+    int l_iFd = mkstemp(l_strFilename);
+    list<shared_ptr<elfcloud::Cluster>> l_SClusters;
+    list<shared_ptr<elfcloud::DataItem>> l_SDataItems;
+    map<string, ElfcloudDirCache *> l_SDirs;
+    map<string, ElfcloudDirCache *> l_SLoaded;
+
+    if(l_iFd < 0)
+    {
+        cerr << "test-snapshot: Can't create temporary file" << endl;
+        return 1;
+    }
+
+    close(l_iFd);
+
+    l_SClusters.push_back(newCluster(l_SEclib, 10, "dir"));
+    l_SDataItems.push_back(newDataItem(l_SEclib, 100, "file1", 100));
+    l_SDataItems.push_back(newDataItem(l_SEclib, 101, "file2", 200));
+    l_SDirs[PATH] = new ElfcloudDirCache(l_SEclib, PATH, newCluster(l_SEclib, 1, "vault"), l_SClusters, l_SDataItems);
+
+    ElfcloudFSSnapshot l_SSnapshot(l_SEclib, l_strFilename, USER);
+    CHECK(l_SSnapshot.save(l_SDirs));
+
+    // Round trip
+    CHECK(load(l_SEclib, l_strFilename, USER, l_SLoaded) == 1);
+    CHECK(l_SLoaded.count(PATH) == 1);
+
+    if(l_SLoaded.count(PATH) == 1)
+    {
+        ElfcloudDirCache *l_SDirCache = l_SLoaded[PATH];
+
+        CHECK(l_SDirCache->getCluster()->getClusterId() == 1);
+        CHECK(l_SDirCache->isDirectory("dir"));
+        CHECK(l_SDirCache->isFile("file1"));
+        CHECK(l_SDirCache->isFile("file2"));
+        CHECK(l_SDirCache->getFile("file2")->getId() == 101);
+        CHECK(l_SDirCache->getFile("file2")->getDataLength() == 200);
+        CHECK(l_SDirCache->getFile("file2")->getContentLength() == 400);
+        CHECK(l_SDirCache->getFile("file2")->getDataItemMd5Sum() == "11111111111111111111111111111111");
+    }
+
+    string l_strData = readFile(l_strFilename);
+
+    // Every truncation is rejected as a whole
+    for(size_t i = 0; i < l_strData.size(); i++)
+    {
+        writeFile(l_strFilename, l_strData.substr(0, i));
+
+        if(load(l_SEclib, l_strFilename, USER, l_SLoaded) != 0 || !l_SLoaded.empty())
+        {
+            cerr << "test-snapshot: truncated to " << i << " bytes was loaded" << endl;
+            g_iFailed++;
+        }
+    }
+
+    // Data after last directory
+    writeFile(l_strFilename, l_strData + string(1, '\0'));
+    CHECK(load(l_SEclib, l_strFilename, USER, l_SLoaded) == 0);
+
+    // Snapshot of another user
+    writeFile(l_strFilename, l_strData);
+    CHECK(load(l_SEclib, l_strFilename, "other", l_SLoaded) == 0);
+
+    // Unknown version
+    string l_strCorrupt = l_strData;
+    l_strCorrupt[8] ^= 0xff;
+    writeFile(l_strFilename, l_strCorrupt);
+    CHECK(load(l_SEclib, l_strFilename, USER, l_SLoaded) == 0);
+
+    // Bad magic
+    l_strCorrupt = l_strData;
+    l_strCorrupt[0] = 'X';
+    writeFile(l_strFilename, l_strCorrupt);
+    CHECK(load(l_SEclib, l_strFilename, USER, l_SLoaded) == 0);
+
+    // Directory count larger than file
+    size_t l_iDirsOffset = 8 + 4 + 4 + USER.size();
+    l_strCorrupt = l_strData;
+    memset(&l_strCorrupt[l_iDirsOffset], 0xff, 8);
+    writeFile(l_strFilename, l_strCorrupt);
+    CHECK(load(l_SEclib, l_strFilename, USER, l_SLoaded) == 0);
+
+    // Zero cluster ID is not accepted by Cluster
+    size_t l_iClusterOffset = l_iDirsOffset + 8 + 4 + PATH.size();
+    l_strCorrupt = l_strData;
+    memset(&l_strCorrupt[l_iClusterOffset], 0x00, 8);
+    writeFile(l_strFilename, l_strCorrupt);
+    CHECK(load(l_SEclib, l_strFilename, USER, l_SLoaded) == 0);
+
+    // String length past end of file
+    l_strCorrupt = l_strData;
+    memset(&l_strCorrupt[l_iDirsOffset + 8], 0xff, 4);
+    writeFile(l_strFilename, l_strCorrupt);
+    CHECK(load(l_SEclib, l_strFilename, USER, l_SLoaded) == 0);
+
+    // Intact file still loads after all that
+    writeFile(l_strFilename, l_strData);
+    CHECK(load(l_SEclib, l_strFilename, USER, l_SLoaded) == 1);
+
+    clearDirs(l_SLoaded);
+    clearDirs(l_SDirs);
+    unlink(l_strFilename);
+    delete l_SEclib;
+
+    if(g_iFailed > 0)
+    {
+        cerr << "test-snapshot: " << g_iFailed << " checks failed" << endl;
+        return 1;
+    }
+
+    return 0;
+}